@@ -0,0 +1,46 @@
+#ifndef BINOP_TRACE_H
+#define BINOP_TRACE_H
+
+/**
+ * Binary trace of the operands of executed binary operators, written by the
+ * runtime to <exe>.binops.bin when BINOPS_FORMAT=binary is set and read back
+ * by binops-decode.
+ *
+ * The file is a sequence of chunks, one per buffer flush: a BinopTraceHeader
+ * with the number of records that follow, then the BinopRecords, all in the
+ * byte order of the traced machine. Every chunk is appended with a single
+ * write, so threads and forked processes can trace into the same file.
+ */
+
+#include <stdint.h>
+
+#define BINOP_TRACE_MAGIC "BINOPS\0\0"
+#define BINOP_TRACE_VERSION 1
+
+typedef struct {
+  char Magic[8];
+  uint16_t Version;
+  uint16_t RecordSize;
+  uint32_t Count;
+} BinopTraceHeader;
+
+typedef struct {
+  int32_t Op1;
+  int32_t Op2;
+  int32_t Line;
+  /* Columns past 65535 are clamped. */
+  uint16_t Col;
+  /* Operator symbol: + - * / % */
+  char Symbol;
+  uint8_t Reserved;
+} BinopRecord;
+
+#ifdef __cplusplus
+static_assert(sizeof(BinopTraceHeader) == 16, "header must be 16 bytes");
+static_assert(sizeof(BinopRecord) == 16, "BinopRecord must be 16 bytes");
+#else
+_Static_assert(sizeof(BinopTraceHeader) == 16, "header must be 16 bytes");
+_Static_assert(sizeof(BinopRecord) == 16, "BinopRecord must be 16 bytes");
+#endif
+
+#endif // BINOP_TRACE_H
@@ -1,19 +1,89 @@
+#include "Selection.h"
+
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <memory>
+#include <vector>
+
 using namespace llvm;
 
 namespace instrument {
 
+/**
+ * @brief The instrumentation of one module by DynamicAnalysisPass, shared
+ * by its passes below.
+ *
+ * The runtime hooks are declared once, when the module is set up, and every
+ * function is instrumented in two steps: the instructions to instrument
+ * are collected first, then the calls are inserted.
+ */
+class DynamicInstrumenter {
+public:
+  /**
+   * @brief Declare the hooks in M and load the selection.
+   */
+  explicit DynamicInstrumenter(Module &M);
+
+  bool instrumentFunction(Function &F);
+
+  /**
+   * @brief Instrument every function defined in the module.
+   */
+  bool instrumentModule();
+
+private:
+  Module &M;
+  Function *CoverageHook, *BinopHook;
+
+  /* Instructions of the function being instrumented, reused across
+   * functions. */
+  std::vector<Instruction *> Points;
+
+  /**
+   * Functions and blocks that get instrumented.
+   */
+  Selection Selected;
+};
+
 struct Instrument : public FunctionPass {
   static char ID;
 
+  /**
+   * The instrumentation of the module being run on by DynamicAnalysisPass,
+   * unused by StaticAnalysisPass.
+   */
+  std::unique_ptr<DynamicInstrumenter> Impl;
+
   Instrument() : FunctionPass(ID) {}
 
+  bool doInitialization(Module &M) override;
   bool runOnFunction(Function &F) override;
 };
+
+/**
+ * @brief Legacy module pass, opt -load DynamicAnalysisPass.so
+ * -DynamicAnalysisModule
+ */
+struct DynamicAnalysisModule : public ModulePass {
+  static char ID;
+
+  DynamicAnalysisModule() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+};
+
+/**
+ * @brief New pass manager pass, opt -load DynamicAnalysisPass.so
+ * -load-pass-plugin DynamicAnalysisPass.so -passes=dynamic-analysis (-load
+ * registers the options).
+ */
+struct DynamicAnalysis : public PassInfoMixin<DynamicAnalysis> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
 } // namespace instrument
@@ -0,0 +1,75 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * @brief The functions and basic blocks to instrument, selected with
+ * -instrument-allowlist, -instrument-denylist and -instrument-profile.
+ *
+ * The lists hold one glob pattern per line, matched against function
+ * names, or against source file names with a "src:" prefix. Empty lines
+ * and lines starting with '#' are ignored. A function is instrumented if
+ * it matches the allowlist (when one is given) and not the denylist.
+ *
+ * A profile is the coverage file of one run of the program built with
+ * lab2's DynamicAnalysisPass, whose runtime logs "line, col" at every
+ * executed instruction. A block is hot if it ran more than
+ * -instrument-hot-threshold times per profiled run, estimated from the
+ * least executed location of the block. A location logs once per
+ * instruction of the module at that location, so its count is divided by
+ * the number of those instructions. Locations are matched by line and
+ * column only, so profiles are per module.
+ */
+class Selection {
+public:
+  /**
+   * @brief Read the lists and the profiles given on the command line,
+   * reporting the files that cannot be read to errs(). M is the module to
+   * instrument, before any instrumentation.
+   */
+  void load(const Module &M);
+
+  bool shouldInstrument(const Function &F) const;
+
+  /**
+   * @brief Did BB run more often than the threshold in the profiles? Always
+   * false without a profile.
+   */
+  bool isHot(const BasicBlock &BB) const;
+
+private:
+  struct PatternList {
+    std::vector<GlobPattern> Functions, Sources;
+
+    bool match(const Function &F) const;
+  };
+
+  bool readPatterns(const std::string &Path, PatternList &List);
+  bool readProfile(const std::string &Path);
+
+  /* Text of the patterns, which a GlobPattern refers to. */
+  BumpPtrAllocator Alloc;
+  StringSaver Saver{Alloc};
+  PatternList Allow, Deny;
+  /* Executions of every (line, col) location over all the profiled runs. */
+  DenseMap<uint64_t, uint64_t> Counts;
+  /* Instructions of the module at every location, with a profile. */
+  DenseMap<uint64_t, unsigned> Sharing;
+  unsigned Runs = 0;
+};
+
+} // namespace instrument
+
+#endif // SELECTION_H
@@ -1,8 +1,13 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 
+#include "BinopTrace.h"
+
 const int STR_MAX_SIZE = 1024;
 
 const char *getBinOpName(char symbol) {
@@ -22,38 +27,218 @@ const char *getBinOpName(char symbol) {
   }
 }
 
-void get_logfile(char *buf, const int buf_size, const char *ext) {
-  char exe[STR_MAX_SIZE];
-  int ret = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+/* Path of the running executable, resolved once at load time. */
+static char exe_path[1024];
+
+static void resolve_exe_path(void) {
+  int ret = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
   if (ret == -1) {
     fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
     exit(1);
   }
-  exe[ret] = 0;
+  exe_path[ret] = 0;
+}
+
+void get_logfile(char *buf, const int buf_size, const char *ext) {
+  if (exe_path[0] == 0) {
+    resolve_exe_path();
+  }
+  snprintf(buf, buf_size, "%s%s", exe_path, ext);
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+  while (fd != -1 && len > 0) {
+    ssize_t ret = write(fd, buf, len);
+    if (ret <= 0) {
+      return;
+    }
+    buf += ret;
+    len -= ret;
+  }
+}
+
+/*
+ * Log files, opened by the first thread that flushes into them. Every flush
+ * is a single O_APPEND write of whole lines or records, so the events of
+ * different threads interleave by chunks but are never torn.
+ */
+enum { COVERAGE_LOG, BINOPS_LOG, BINOPS_TRACE_LOG, NUM_LOGS };
+
+static const char *log_exts[NUM_LOGS] = {".cov", ".binops", ".binops.bin"};
+static int log_fds[NUM_LOGS] = {-1, -1, -1};
+
+static int get_log_fd(int kind) {
+  int fd = __atomic_load_n(&log_fds[kind], __ATOMIC_ACQUIRE);
+  if (fd != -1) {
+    return fd;
+  }
+  char logfile[sizeof(exe_path) + 16];
+  get_logfile(logfile, sizeof(logfile), log_exts[kind]);
+  fd = open(logfile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  int expected = -1;
+  if (!__atomic_compare_exchange_n(&log_fds[kind], &expected, fd, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    close(fd);
+    fd = expected;
+  }
+  return fd;
+}
+
+/*
+ * Every thread logs into its own thread_log, so the hooks never lock or
+ * share cache lines. The logs are heap allocated, to outlive their thread,
+ * and pushed on a lock-free list that the flush walks to merge them.
+ */
+#define TEXT_BUFFER_SIZE 65536
+#define BINOP_BUFFER_RECORDS 65536
+
+typedef struct {
+  size_t len;
+  char data[TEXT_BUFFER_SIZE];
+} text_buffer;
+
+typedef struct thread_log {
+  struct thread_log *next;
+  text_buffer coverage;
+  text_buffer binops;
+  /*
+   * Binary trace mode (BINOPS_FORMAT=binary), see BinopTrace.h. The first
+   * slot of the buffer holds the chunk header so a flush is a single write.
+   */
+  size_t binop_count;
+  BinopRecord binop_buffer[BINOP_BUFFER_RECORDS + 1];
+} thread_log;
+
+static int binop_binary = 0;
+static thread_log *thread_logs = NULL;
+static __thread thread_log *local_log = NULL;
+
+static thread_log *get_thread_log(void) {
+  thread_log *log = local_log;
+  if (log != NULL) {
+    return log;
+  }
+  log = calloc(1, sizeof(thread_log));
+  if (log == NULL) {
+    fprintf(stderr, "Error: Out of memory for the runtime logs\n");
+    exit(1);
+  }
+  log->next = __atomic_load_n(&thread_logs, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&thread_logs, &log->next, log, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  local_log = log;
+  return log;
+}
+
+/*
+ * A buffer is appended to by its thread only, but flushed by whichever
+ * thread exits or crashes first. The flush takes the buffer by exchanging
+ * its length with BUFFER_FLUSHING and gives it back empty once written;
+ * appends only publish their event with a CAS on the length they copied
+ * after, so an event that lands while the buffer is taken is logged again
+ * instead of lost or written twice.
+ */
+#define BUFFER_FLUSHING ((size_t)-1)
+
+/* Length of the events taken from the buffer, 0 if there are none. */
+static size_t take_buffer(size_t *len) {
+  size_t taken = __atomic_exchange_n(len, BUFFER_FLUSHING, __ATOMIC_ACQ_REL);
+  if (taken == BUFFER_FLUSHING) {
+    /* Flushed by another thread, or by this one in a crash handler. */
+    return 0;
+  }
+  if (taken == 0) {
+    __atomic_store_n(len, 0, __ATOMIC_RELEASE);
+  }
+  return taken;
+}
+
+/* Length of the buffer, once no flush holds it. */
+static size_t wait_buffer(size_t *len) {
+  size_t used;
+  while ((used = __atomic_load_n(len, __ATOMIC_ACQUIRE)) == BUFFER_FLUSHING) {
+  }
+  return used;
+}
+
+static void flush_text(text_buffer *buffer, int kind) {
+  size_t len = take_buffer(&buffer->len);
+  if (len == 0) {
+    return;
+  }
+  write_all(get_log_fd(kind), buffer->data, len);
+  __atomic_store_n(&buffer->len, 0, __ATOMIC_RELEASE);
+}
+
+static void log_text(text_buffer *buffer, int kind, const char *line,
+                     int len) {
+  for (;;) {
+    size_t used = wait_buffer(&buffer->len);
+    if (used + len > sizeof(buffer->data)) {
+      flush_text(buffer, kind);
+      continue;
+    }
+    memcpy(buffer->data + used, line, len);
+    if (__atomic_compare_exchange_n(&buffer->len, &used, used + len, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+static void flush_binops(thread_log *log) {
+  size_t count = take_buffer(&log->binop_count);
+  if (count == 0) {
+    return;
+  }
+  BinopTraceHeader header = {BINOP_TRACE_MAGIC, BINOP_TRACE_VERSION,
+                             sizeof(BinopRecord), (uint32_t)count};
+  memcpy(&log->binop_buffer[0], &header, sizeof(header));
+  write_all(get_log_fd(BINOPS_TRACE_LOG), (const char *)log->binop_buffer,
+            (count + 1) * sizeof(BinopRecord));
+  __atomic_store_n(&log->binop_count, 0, __ATOMIC_RELEASE);
+}
 
-  int len = strlen(exe);
-  strncpy(buf, exe, len);
-  buf[len] = 0;
-  for (int i = 0; i <= strlen(ext); ++i) {
-    buf[buf_size-(i+1)] = 0;
+static void log_binop(thread_log *log, const BinopRecord *record) {
+  for (;;) {
+    size_t count = wait_buffer(&log->binop_count);
+    if (count == BINOP_BUFFER_RECORDS) {
+      flush_binops(log);
+      continue;
+    }
+    log->binop_buffer[count + 1] = *record;
+    if (__atomic_compare_exchange_n(&log->binop_count, &count, count + 1, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
   }
-  strncat(buf, ext, strlen(ext));
 }
 
 void __coverage__(int line, int col) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cov");
-  FILE *f = fopen(logfile, "a");
-  fprintf(f, "%d, %d\n", line, col);
-  fclose(f);
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%d, %d\n", line, col);
+  log_text(&get_thread_log()->coverage, COVERAGE_LOG, buf, len);
 }
 
 void __binop_op__(char c, int line, int col, int op1, int op2) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".binops");
-  FILE *f = fopen(logfile, "a");
-  fprintf(
-    f,
+  thread_log *log = get_thread_log();
+  if (binop_binary) {
+    BinopRecord record;
+    record.Op1 = op1;
+    record.Op2 = op2;
+    record.Line = line;
+    record.Col = col > 0xffff ? 0xffff : col;
+    record.Symbol = c;
+    record.Reserved = 0;
+    log_binop(log, &record);
+    return;
+  }
+
+  char buf[160];
+  int len = snprintf(
+    buf,
+    sizeof(buf),
     "%s on Line %d, Column %d with first operand=%d and second operand=%d\n",
     getBinOpName(c),
     line,
@@ -61,5 +246,47 @@ void __binop_op__(char c, int line, int col, int op1, int op2) {
     op1,
     op2
   );
-  fclose(f);
+  log_text(&log->binops, BINOPS_LOG, buf, len);
+}
+
+static void dump_logs(void) {
+  /* Only the first thread to exit or crash writes the logs. */
+  static int dumped = 0;
+  if (__atomic_exchange_n(&dumped, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  for (thread_log *log = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+       log != NULL; log = log->next) {
+    flush_text(&log->coverage, COVERAGE_LOG);
+    flush_text(&log->binops, BINOPS_LOG);
+    flush_binops(log);
+  }
+}
+
+/* Flush the logs when the program crashes, then crash the same way. */
+static void crash_handler(int sig) {
+  dump_logs();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/* Events buffered before a fork belong to the parent. */
+static void reset_logs_in_child(void) {
+  for (thread_log *log = thread_logs; log != NULL; log = log->next) {
+    log->coverage.len = 0;
+    log->binops.len = 0;
+    log->binop_count = 0;
+  }
+}
+
+__attribute__((constructor)) static void init_runtime(void) {
+  resolve_exe_path();
+  const char *format = getenv("BINOPS_FORMAT");
+  binop_binary = format != NULL && strcmp(format, "binary") == 0;
+  atexit(dump_logs);
+  pthread_atfork(NULL, NULL, reset_logs_in_child);
+  const int signals[] = {SIGSEGV, SIGFPE, SIGABRT, SIGBUS, SIGILL};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+    signal(signals[i], crash_handler);
+  }
 }
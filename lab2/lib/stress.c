@@ -0,0 +1,193 @@
+/*
+ * Stress test of the runtime with many threads hitting the hooks at once.
+ *
+ * The workload runs in a child process; once it has exited, the parent
+ * checks that <exe>.cov and <exe>.binops (or <exe>.binops.bin when run with
+ * BINOPS_FORMAT=binary) hold every event of every thread, none of them torn.
+ *
+ * With "exit", thread 0 calls exit() after its iterations while the others
+ * keep logging, so the logs are flushed under the feet of their threads.
+ * Every thread must then have logged a prefix of its events, thread 0 all of
+ * them.
+ *
+ * Usage: runtime-stress [threads] [iterations] [exit]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BinopTrace.h"
+
+void __coverage__(int line, int col);
+void __binop_op__(char c, int line, int col, int op1, int op2);
+
+static int num_threads = 8;
+static int iterations = 20000;
+static int exit_early = 0;
+
+/* Thread t logs its events on line t + 1, with col counting up. */
+static void *worker(void *arg) {
+  int id = (int)(long)arg;
+  for (int i = 0; i < iterations || (exit_early && id != 0); ++i) {
+    __coverage__(id + 1, i);
+    __binop_op__("+-*/%"[i % 5], id + 1, i % 60000, i, -i);
+  }
+  if (exit_early) {
+    exit(0);
+  }
+  return NULL;
+}
+
+static void run_workload(void) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  for (long i = 0; i < num_threads; ++i) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+/*
+ * Every thread must have logged all its events, in order since each thread
+ * flushes its own buffer, and with no event twice.
+ */
+static int check_event(int *next, int line, int col, int *errors) {
+  if (line < 1 || line > num_threads || next[line - 1] != col) {
+    if ((*errors)++ < 10) {
+      fprintf(stderr, "Unexpected event on line %d, col %d\n", line, col);
+    }
+    return 0;
+  }
+  ++next[line - 1];
+  return 1;
+}
+
+static int check_counts(const char *log, int *next, int errors) {
+  for (int i = 0; i < num_threads; ++i) {
+    if (next[i] != iterations && (!exit_early || i == 0)) {
+      fprintf(stderr, "%s: thread %d logged %d events instead of %d\n", log,
+              i, next[i], iterations);
+      ++errors;
+    }
+  }
+  free(next);
+  return errors;
+}
+
+static int check_coverage(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  int *next = calloc(num_threads, sizeof(int));
+  int line, col, errors = 0;
+  while (fscanf(f, "%d, %d\n", &line, &col) == 2) {
+    check_event(next, line, col, &errors);
+  }
+  fclose(f);
+  return check_counts(path, next, errors);
+}
+
+static int check_binops(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  int *next = calloc(num_threads, sizeof(int));
+  char buf[256], name[32];
+  int line, col, op1, op2, errors = 0;
+  while (fgets(buf, sizeof(buf), f)) {
+    if (sscanf(buf,
+               "%31s on Line %d, Column %d with first operand=%d and second "
+               "operand=%d\n",
+               name, &line, &col, &op1, &op2) != 5 ||
+        op1 != -op2 || col != op1 % 60000) {
+      if (errors++ < 10) {
+        fprintf(stderr, "Torn event: %s", buf);
+      }
+      continue;
+    }
+    check_event(next, line, op1, &errors);
+  }
+  fclose(f);
+  return check_counts(path, next, errors);
+}
+
+static int check_binops_trace(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  int *next = calloc(num_threads, sizeof(int));
+  BinopTraceHeader header;
+  BinopRecord record;
+  int errors = 0;
+  while (fread(&header, sizeof(header), 1, f) == 1) {
+    if (memcmp(header.Magic, BINOP_TRACE_MAGIC, sizeof(header.Magic))) {
+      fprintf(stderr, "Torn chunk header\n");
+      ++errors;
+      break;
+    }
+    for (uint32_t i = 0; i < header.Count; ++i) {
+      if (fread(&record, sizeof(record), 1, f) != 1) {
+        fprintf(stderr, "Truncated chunk\n");
+        ++errors;
+        break;
+      }
+      check_event(next, record.Line, record.Op1, &errors);
+    }
+  }
+  fclose(f);
+  return check_counts(path, next, errors);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    num_threads = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    iterations = atoi(argv[2]);
+  }
+  exit_early = argc > 3 && strcmp(argv[3], "exit") == 0;
+  const char *format = getenv("BINOPS_FORMAT");
+  int binary = format != NULL && strcmp(format, "binary") == 0;
+
+  char exe[1024], cov[1040], binops[1040];
+  int len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len == -1) {
+    fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
+    return 1;
+  }
+  exe[len] = 0;
+  snprintf(cov, sizeof(cov), "%s.cov", exe);
+  snprintf(binops, sizeof(binops), "%s.binops%s", exe, binary ? ".bin" : "");
+  unlink(cov);
+  unlink(binops);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    run_workload();
+    exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "Workload did not exit cleanly\n");
+    return 1;
+  }
+
+  int errors = check_coverage(cov) +
+               (binary ? check_binops_trace(binops) : check_binops(binops));
+  printf("%d threads x %d iterations (%s%s): %s\n", num_threads, iterations,
+         binary ? "binary" : "text", exit_early ? ", exit" : "",
+         errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * binops-decode: render a binary operand trace (<exe>.binops.bin, see
+ * BinopTrace.h) in the text format of <exe>.binops, or aggregate it into
+ * per-site operand histograms.
+ *
+ * Usage:
+ *   binops-decode [trace]                 print one line per operation
+ *   binops-decode --histogram [trace]     print operand histograms per site
+ *   binops-decode --histogram=N [trace]   keep the N most frequent values
+ *
+ * The trace is read from stdin when no path is given.
+ */
+
+#include "BinopTrace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const size_t DEFAULT_HISTOGRAM_SIZE = 8;
+
+/**
+ * Same names as getBinOpName in the runtime and in Utils.cpp.
+ */
+const char *getBinOpName(char Symbol) {
+  switch (Symbol) {
+  case '+':
+    return "Addition";
+  case '-':
+    return "Subtraction";
+  case '*':
+    return "Multiplication";
+  case '/':
+    return "Division";
+  case '%':
+    return "Modulo";
+  default:
+    return "Unknown operation";
+  }
+}
+
+struct SiteStats {
+  unsigned long long Count = 0;
+  std::unordered_map<int32_t, unsigned long long> Op1, Op2;
+};
+
+typedef std::tuple<int32_t, uint16_t, char> SiteKey;
+
+void printHistogram(const char *Name,
+                    const std::unordered_map<int32_t, unsigned long long> &Hist,
+                    size_t Size) {
+  typedef std::pair<int32_t, unsigned long long> Value;
+  std::vector<Value> Values(Hist.begin(), Hist.end());
+  std::sort(Values.begin(), Values.end(), [](const Value &A, const Value &B) {
+    return A.second != B.second ? A.second > B.second : A.first < B.first;
+  });
+  printf("  %s:", Name);
+  for (size_t I = 0; I < Values.size() && I < Size; ++I)
+    printf(" %d x%llu", Values[I].first, Values[I].second);
+  if (Values.size() > Size)
+    printf(" (%zu more values)", Values.size() - Size);
+  printf("\n");
+}
+
+/**
+ * Read every chunk of the trace in F, calling Visit on each record.
+ *
+ * @return false if the trace is malformed.
+ */
+template <typename VisitFn> bool readTrace(FILE *F, VisitFn Visit) {
+  std::vector<BinopRecord> Records;
+  BinopTraceHeader Header;
+  while (fread(&Header, sizeof(Header), 1, F) == 1) {
+    if (memcmp(Header.Magic, BINOP_TRACE_MAGIC, sizeof(Header.Magic)) ||
+        Header.Version != BINOP_TRACE_VERSION ||
+        Header.RecordSize != sizeof(BinopRecord)) {
+      fprintf(stderr, "Not a version %d binops trace\n", BINOP_TRACE_VERSION);
+      return false;
+    }
+    Records.resize(Header.Count);
+    if (fread(Records.data(), sizeof(BinopRecord), Header.Count, F) !=
+        Header.Count) {
+      fprintf(stderr, "Truncated binops trace\n");
+      return false;
+    }
+    for (auto &Record : Records)
+      Visit(Record);
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool Histogram = false;
+  size_t HistogramSize = DEFAULT_HISTOGRAM_SIZE;
+  const char *Path = nullptr;
+  for (int I = 1; I < argc; ++I) {
+    if (!strcmp(argv[I], "--histogram")) {
+      Histogram = true;
+    } else if (!strncmp(argv[I], "--histogram=", 12)) {
+      Histogram = true;
+      HistogramSize = strtoul(argv[I] + 12, nullptr, 10);
+    } else {
+      Path = argv[I];
+    }
+  }
+  FILE *F = Path ? fopen(Path, "rb") : stdin;
+  if (!F) {
+    fprintf(stderr, "%s not found\n", Path);
+    return 1;
+  }
+
+  bool Ok;
+  if (!Histogram) {
+    Ok = readTrace(F, [](const BinopRecord &R) {
+      printf("%s on Line %d, Column %d with first operand=%d and second "
+             "operand=%d\n",
+             getBinOpName(R.Symbol), R.Line, R.Col, R.Op1, R.Op2);
+    });
+  } else {
+    std::map<SiteKey, SiteStats> Sites;
+    Ok = readTrace(F, [&](const BinopRecord &R) {
+      auto &Site = Sites[SiteKey(R.Line, R.Col, R.Symbol)];
+      ++Site.Count;
+      ++Site.Op1[R.Op1];
+      ++Site.Op2[R.Op2];
+    });
+    for (auto &Entry : Sites) {
+      auto &Site = Entry.second;
+      printf("%s on Line %d, Column %d: %llu executions\n",
+             getBinOpName(std::get<2>(Entry.first)), std::get<0>(Entry.first),
+             std::get<1>(Entry.first), Site.Count);
+      printHistogram("first operand", Site.Op1, HistogramSize);
+      printHistogram("second operand", Site.Op2, HistogramSize);
+    }
+  }
+  if (F != stdin)
+    fclose(F);
+  return Ok ? 0 : 1;
+}
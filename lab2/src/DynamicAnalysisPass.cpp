@@ -1,6 +1,9 @@
 #include "Instrument.h"
 #include "Utils.h"
 
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
 using namespace llvm;
 
 namespace instrument {
@@ -10,70 +13,111 @@ const auto PASS_DESC = "Dynamic Analysis Pass";
 const auto COVERAGE_FUNCTION_NAME = "__coverage__";
 const auto BINOP_OPERANDS_FUNCTION_NAME = "__binop_op__";
 
-void instrumentCoverage(Module *M, Instruction &I, int Line, int Col);
+void instrumentCoverage(Module *M, Instruction &I, int Line, int Col,
+                        Function *Hook);
 void instrumentBinOpOperands(Module *M, BinaryOperator *BinOp, int Line,
-                             int Col);
-
-bool Instrument::runOnFunction(Function &F) {
-  auto FunctionName = F.getName().str();
-  outs() << "Running " << PASS_DESC << " on function " << FunctionName << "\n";
-
-  outs() << "Instrument Instructions\n";
-  
-  LLVMContext &Context = F.getContext();
-  Module *M = F.getParent();
+                             int Col, Function *Hook);
 
+DynamicInstrumenter::DynamicInstrumenter(Module &M) : M(M) {
+  LLVMContext &Context = M.getContext();
   Type *VoidType = Type::getVoidTy(Context);
   Type *Int32Type = Type::getInt32Ty(Context);
   Type *Int8Type = Type::getInt8Ty(Context);
 
-  M->getOrInsertFunction(COVERAGE_FUNCTION_NAME, VoidType, Int32Type,
-                         Int32Type);
+  M.getOrInsertFunction(COVERAGE_FUNCTION_NAME, VoidType, Int32Type,
+                        Int32Type);
+  M.getOrInsertFunction(BINOP_OPERANDS_FUNCTION_NAME, VoidType, Int8Type,
+                        Int32Type, Int32Type, Int32Type, Int32Type);
+  CoverageHook = M.getFunction(COVERAGE_FUNCTION_NAME);
+  BinopHook = M.getFunction(BINOP_OPERANDS_FUNCTION_NAME);
+
+  Selected.load(M);
+}
 
-  M->getOrInsertFunction(BINOP_OPERANDS_FUNCTION_NAME, VoidType, Int8Type,
-                         Int32Type, Int32Type, Int32Type, Int32Type);
+bool DynamicInstrumenter::instrumentFunction(Function &F) {
+  if (F.isDeclaration())
+    return false;
+  auto FunctionName = F.getName().str();
+  outs() << "Running " << PASS_DESC << " on function " << FunctionName << "\n";
 
-  for (inst_iterator Iter = inst_begin(F), E = inst_end(F); Iter != E; ++Iter) {
-    Instruction &Inst = (*Iter);
-    llvm::DebugLoc DebugLoc = Inst.getDebugLoc();
-    if (!DebugLoc) {
-      // Skip Instruction if it doesn't have debug information.
+  if (!Selected.shouldInstrument(F))
+    return false;
+
+  outs() << "Instrument Instructions\n";
+
+  // Collect the instructions before adding any call, hot blocks are left
+  // out.
+  Points.clear();
+  for (auto &BB : F) {
+    if (Selected.isHot(BB))
       continue;
+    for (auto &Inst : BB) {
+      // Skip Instruction if it doesn't have debug information.
+      if (Inst.getDebugLoc())
+        Points.push_back(&Inst);
     }
+  }
 
-    int Line = DebugLoc.getLine();
-    int Col = DebugLoc.getCol();
-    instrumentCoverage(M, Inst, Line, Col);
+  for (auto *Inst : Points) {
+    const DebugLoc &Loc = Inst->getDebugLoc();
+    int Line = Loc.getLine();
+    int Col = Loc.getCol();
+    instrumentCoverage(&M, *Inst, Line, Col, CoverageHook);
 
     /**
      * TODO: Add code to check if the instruction is a BinaryOperator and if so,
      * instrument the instruction as specified in the Lab document.
      */
     // try casting the instruction to Binary Operator, if null then continue
-    auto *binary = dyn_cast<BinaryOperator>(&Inst);
+    auto *binary = dyn_cast<BinaryOperator>(Inst);
     if(binary!=NULL){
-      instrumentBinOpOperands(M,binary,Line,Col);
+      instrumentBinOpOperands(&M,binary,Line,Col,BinopHook);
     }
   }
 
   return true;
 }
 
-void instrumentCoverage(Module *M, Instruction &I, int Line, int Col) {
+bool DynamicInstrumenter::instrumentModule() {
+  bool Changed = false;
+  for (auto &F : M)
+    Changed |= instrumentFunction(F);
+  return Changed;
+}
+
+bool Instrument::doInitialization(Module &M) {
+  Impl.reset(new DynamicInstrumenter(M));
+  return true;
+}
+
+bool Instrument::runOnFunction(Function &F) {
+  return Impl->instrumentFunction(F);
+}
+
+bool DynamicAnalysisModule::runOnModule(Module &M) {
+  return DynamicInstrumenter(M).instrumentModule();
+}
+
+PreservedAnalyses DynamicAnalysis::run(Module &M, ModuleAnalysisManager &MAM) {
+  bool Changed = DynamicInstrumenter(M).instrumentModule();
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+void instrumentCoverage(Module *M, Instruction &I, int Line, int Col,
+                        Function *Hook) {
   auto &Context = M->getContext();
   auto *Int32Type = Type::getInt32Ty(Context);
 
   auto LineVal = ConstantInt::get(Int32Type, Line);
   auto ColVal = ConstantInt::get(Int32Type, Col);
 
-  std::vector<Value *> Args = {LineVal, ColVal};
+  Value *Args[] = {LineVal, ColVal};
 
-  auto *CoverageFunction = M->getFunction(COVERAGE_FUNCTION_NAME);
-  CallInst::Create(CoverageFunction, Args, "", &I);
+  CallInst::Create(Hook, Args, "", &I);
 }
 
 void instrumentBinOpOperands(Module *M, BinaryOperator *BinOp, int Line,
-                             int Col) {
+                             int Col, Function *Hook) {
   auto &Context = M->getContext();
   auto *Int32Type = Type::getInt32Ty(Context);
   auto *CharType = Type::getInt8Ty(Context);
@@ -98,14 +142,31 @@ void instrumentBinOpOperands(Module *M, BinaryOperator *BinOp, int Line,
   auto LineVal = ConstantInt::get(Int32Type, Line);
   auto ColVal = ConstantInt::get(Int32Type, Col);
   //adding all arguments to a set
-  std::vector<Value *> Args = {Opertor_value,LineVal, ColVal,op1,op2};
-  //Inject function before I(the given instruction)
-  auto *BinopFunction = M->getFunction(BINOP_OPERANDS_FUNCTION_NAME);
+  Value *Args[] = {Opertor_value,LineVal, ColVal,op1,op2};
   //Insert instructions before given instruction.
-  CallInst::Create(BinopFunction, Args,"",BinOp);
+  CallInst::Create(Hook, Args,"",BinOp);
 }
 
 char Instrument::ID = 1;
 static RegisterPass<Instrument> X(PASS_NAME, PASS_NAME, false, false);
 
+char DynamicAnalysisModule::ID = 2;
+static RegisterPass<DynamicAnalysisModule>
+    Y("DynamicAnalysisModule", "Dynamic Analysis Pass (module pass)", false,
+      false);
+
 } // namespace instrument
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "DynamicAnalysis", "v0.1",
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "dynamic-analysis")
+                    return false;
+                  MPM.addPass(instrument::DynamicAnalysis());
+                  return true;
+                });
+          }};
+}
@@ -8,6 +8,8 @@ namespace instrument {
 const auto PASS_NAME = "StaticAnalysisPass";
 const auto PASS_DESC = "Static Analysis Pass";
 
+bool Instrument::doInitialization(Module &M) { return false; }
+
 bool Instrument::runOnFunction(Function &F) {
   auto FunctionName = F.getName().str();
   outs() << "Running " << PASS_DESC << " on function " << FunctionName << "\n";
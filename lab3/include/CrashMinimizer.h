@@ -0,0 +1,62 @@
+#ifndef CRASH_MINIMIZER_H
+#define CRASH_MINIMIZER_H
+
+#include "Delta.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief Background minimization of the crashes found while fuzzing.
+ *
+ * The first crash of every bucket (see readCrashBucket) is queued and
+ * minimized by ddmin (see Delta.h) in a worker thread, on its own fork
+ * server of the target, with a budget of runs per crash. The result is
+ * written to <output dir>/failure/minimized/<bucket>, so the fuzzing loop
+ * never waits for it. Crashes queued when the fuzzer stops are dropped.
+ */
+class CrashMinimizer {
+public:
+  /**
+   * @param Target Target program, linked with this lab's runtime.
+   * @param OutDir Output directory of the fuzzer.
+   * @param Budget Runs of the target allowed per crash.
+   */
+  CrashMinimizer(const std::string &Target, const std::string &OutDir,
+                 uint64_t Budget);
+  ~CrashMinimizer();
+
+  /**
+   * @brief Start the fork server and the worker thread.
+   *
+   * @return false if the target did not start a fork server.
+   */
+  bool start();
+
+  /**
+   * @brief Queue Input, a crash in Bucket, unless Bucket was already seen
+   * in this session or minimized by a previous one.
+   */
+  void add(const std::string &Bucket, const std::string &Input);
+
+private:
+  void work();
+
+  std::string Dir;
+  uint64_t Budget;
+  DeltaDebugger Delta;
+  std::set<std::string> Buckets;
+  std::deque<std::pair<std::string, std::string>> Queue;
+  std::mutex Lock;
+  std::condition_variable Wake;
+  bool Stopping = false;
+  std::thread Worker;
+};
+
+#endif // CRASH_MINIMIZER_H
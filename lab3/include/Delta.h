@@ -0,0 +1,89 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "Runner.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Delta debugging (ddmin) of crashing inputs, on one fork server per
+ * job.
+ *
+ * Minimizes like lab4's delta.py: every round cuts the input in chunks of
+ * len / n bytes and tries, in order, each chunk and then its complement.
+ * The first crashing candidate becomes the input, with n = 2 after a chunk
+ * and n - 1 after a complement. If none crashes, n doubles, until n is
+ * larger than the input. The candidates of a round run concurrently and
+ * the round keeps the first crashing one in that order, so the result is
+ * the same as the sequential one.
+ *
+ * An input crashes the target if it exits with a non-zero status or is
+ * killed by a signal, except by the timeout (SIGKILL). Once a bucket is
+ * set, only crashes in that bucket (see crashBucket in Utils.h) count, so
+ * the minimized input still reproduces the same bug.
+ *
+ * With a budget, minimize stops once that many runs were made and returns
+ * the smallest crashing input found so far.
+ */
+class DeltaDebugger {
+public:
+  DeltaDebugger(const std::string &Target, unsigned Jobs, int TimeoutMs);
+
+  /**
+   * @brief Start the fork servers.
+   */
+  bool start();
+
+  bool crashes(const std::string &Input);
+
+  /**
+   * @brief Crash bucket of Input, empty if it does not crash.
+   */
+  std::string bucket(const std::string &Input);
+
+  /**
+   * @brief Only count the crashes in Bucket from now on, any crash if
+   * empty.
+   */
+  void setBucket(const std::string &Bucket) { this->Bucket = Bucket; }
+
+  /**
+   * @brief Limit the runs of minimize to MaxExecutions in total, counting
+   * the runs made so far.
+   */
+  void setBudget(uint64_t MaxExecutions) { Budget = MaxExecutions; }
+
+  /**
+   * @brief Minimize Input, which must crash the target.
+   *
+   * @return A 1-minimal crashing input, unless the budget ran out.
+   */
+  std::string minimize(const std::string &Input);
+
+  /* Number of target runs so far. */
+  uint64_t executions() const { return Executions; }
+
+private:
+  /**
+   * @brief Index of the first of N candidates that crashes, N if none.
+   */
+  size_t firstCrash(size_t N,
+                    const std::function<std::string(size_t)> &Candidate);
+  bool crashes(ForkServer &Server, const std::string &Input);
+  std::string bucket(ForkServer &Server, const std::string &Input);
+
+  std::string Target;
+  unsigned Jobs;
+  int TimeoutMs;
+  std::vector<std::unique_ptr<ForkServer>> Servers;
+  std::atomic<uint64_t> Executions;
+  uint64_t Budget = UINT64_MAX;
+  std::string Bucket;
+};
+
+#endif // DELTA_H
@@ -0,0 +1,79 @@
+#ifndef DIRECTED_H
+#define DIRECTED_H
+
+#include <string>
+#include <time.h>
+#include <vector>
+
+/**
+ * @brief Power schedule for directed fuzzing towards divisions (AFLGo).
+ *
+ * Every queued input carries the mean distance to the nearest division
+ * observed when it ran. Inputs are picked round-robin, and each one is
+ * mutated as many times as its energy allows. The energy follows a
+ * simulated-annealing schedule: early on every input gets about the same
+ * energy (exploration), and as the temperature drops inputs that got closer
+ * to a division get exponentially more of it (exploitation).
+ */
+class DirectedScheduler {
+public:
+  /**
+   * @param TimeToExploit Seconds after which the schedule is (almost)
+   * entirely exploitation.
+   */
+  explicit DirectedScheduler(double TimeToExploit);
+
+  /**
+   * @brief Add an input to the queue.
+   *
+   * @param Input Input string.
+   * @param Distance Mean distance of the run, or a negative value if the run
+   * did not report one.
+   * @param Alarmed Did the run reach a division flagged by the static
+   * DivZero analysis? Such inputs get extra energy.
+   */
+  void add(const std::string &Input, double Distance, bool Alarmed = false);
+
+  /**
+   * @brief Select the input to mutate next.
+   *
+   * @return std::string the selected input, empty if the queue is empty.
+   */
+  std::string next();
+
+  /**
+   * @return The smallest distance seen so far, or a negative value if none.
+   */
+  double minDistance() const { return MinDistance; }
+
+  /**
+   * @return Number of inputs in the queue.
+   */
+  size_t size() const { return Queue.size(); }
+
+private:
+  struct Entry {
+    std::string Input;
+    double Distance;
+    bool Alarmed;
+  };
+
+  /**
+   * @brief Number of mutations to spend on an input at the current
+   * temperature.
+   */
+  unsigned energy(const Entry &E) const;
+
+  std::vector<Entry> Queue;
+  size_t Current = 0;
+  /* Mutations left for Queue[Current], which gets its energy at the first
+   * selection. */
+  unsigned Remaining = 0;
+  bool Started = false;
+  double MinDistance = -1;
+  double MaxDistance = -1;
+  double TimeToExploit;
+  time_t Start;
+};
+
+#endif // DIRECTED_H
@@ -0,0 +1,77 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Module.h"
+
+#include <string>
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * @brief Is Inst a division that gets guarded by __sanitize__?
+ *
+ * @param Inst Instruction to check.
+ * @return true if Inst is a signed or unsigned integer division.
+ */
+bool isDivision(const Instruction &Inst);
+
+/**
+ * @brief Compute the distance of every basic block in M to the nearest
+ * division (AFLGo-style).
+ *
+ * Blocks containing a division have distance 0. A block calling a function
+ * that (transitively) reaches a division is charged a call-graph distance,
+ * and every other block gets the shortest CFG distance to one of those.
+ * Blocks that cannot reach any division are left out of Distance.
+ *
+ * @param M Module to analyze.
+ * @param Distance Map to store the distance of every basic block.
+ * @param Targets If set, only these divisions are targets.
+ */
+void computeDivDistances(Module &M,
+                         DenseMap<const BasicBlock *, unsigned> &Distance,
+                         const DenseSet<const Instruction *> *Targets = nullptr);
+
+/**
+ * @brief Read the division sites exported by the DivZero analysis
+ * (lab6/lab7, -div-alarms) and map them onto the divisions of M.
+ *
+ * The file has one "<id> <line> <col> <domain>" line per division site,
+ * where ids follow the same module order as the site table. Alarms whose
+ * sites are not at the location of the division with the same id were
+ * computed on another module: they are all ignored, with a warning.
+ *
+ * @param M Module the alarms were computed on.
+ * @param Path Path of the alarm file.
+ * @param Safe Set to store divisions whose divisor is proven NonZero.
+ * @param Alarmed Set to store divisions whose divisor may be zero.
+ * @return false if Path cannot be read.
+ */
+bool readDivAlarms(Module &M, const std::string &Path,
+                   DenseSet<const Instruction *> &Safe,
+                   DenseSet<const Instruction *> &Alarmed);
+
+/**
+ * @brief Write the site table of M to Path.
+ *
+ * Format (one site per line):
+ *   block <id> <line> <col> <distance>
+ *   div <id> <line> <col> <distance>
+ *
+ * Block and division ids are assigned in module order.
+ *
+ * @param M Module to describe.
+ * @param Distance Distance of every basic block to the nearest division.
+ * @param Path Path of the site table.
+ */
+void writeSiteTable(Module &M,
+                    const DenseMap<const BasicBlock *, unsigned> &Distance,
+                    const std::string &Path);
+
+} // namespace instrument
+
+#endif // DISTANCE_H
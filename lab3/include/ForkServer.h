@@ -0,0 +1,29 @@
+#ifndef FORK_SERVER_H
+#define FORK_SERVER_H
+
+/**
+ * Fork server protocol between the minimizer and the runtime. It is a
+ * deliberate fork of the lab5 one (lab5/include/CBIForkServer.h, with the
+ * runner in lab5/src/CBIRunner.cpp): a fix to either copy belongs in both.
+ * The FUZZ_ constants replace the CBI_ ones, and a crashing child writes
+ * its crash record (see dump_crash in runtime.c) to FUZZ_CRASH_FD instead
+ * of <exe>.crash, where lab5 writes its counter record. The children do
+ * not write the .cov and .dist logs.
+ *
+ * Programs with a costly setup can defer the server until the setup is
+ * done by calling __fuzz_init_done(), before reading any input and
+ * starting any thread. The Instrument pass then defines
+ * __fuzz_deferred_init, which tells the runtime not to start the server in
+ * its constructor. With -defer-init, the pass places the calls itself, in
+ * main, before every call that may read the input. A program that exits
+ * without reaching __fuzz_init_done never says hello, and the minimizer
+ * falls back to plain runs.
+ */
+
+#define FUZZ_FORKSRV_ENV "FUZZ_FORKSRV"
+/* Control pipe, the status pipe is FUZZ_FORKSRV_FD + 1. */
+#define FUZZ_FORKSRV_FD 198
+#define FUZZ_CRASH_FD 197
+#define FUZZ_FORKSRV_HELLO 0x46555a5a
+
+#endif // FORK_SERVER_H
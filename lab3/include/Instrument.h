@@ -1,20 +1,147 @@
+#include "Selection.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <memory>
+#include <vector>
+
 using namespace llvm;
 
 namespace instrument {
 
+/**
+ * @brief The instrumentation of one module, shared by the passes below.
+ *
+ * The runtime hooks are declared once, when the module is set up, and
+ * every function is instrumented in two steps: the instructions to
+ * instrument are collected first, then the calls are inserted with one
+ * IRBuilder and fixed argument arrays.
+ */
+class Instrumenter {
+public:
+  /**
+   * @brief Declare the hooks in M, read -div-alarms and, in directed mode,
+   * compute the distances and write the site table.
+   */
+  explicit Instrumenter(Module &M);
+
+  bool instrumentFunction(Function &F);
+
+  /**
+   * @brief Instrument every function defined in the module.
+   */
+  bool instrumentModule();
+
+  /**
+   * @brief Print how many __sanitize__ checks were left out, by -div-alarms
+   * or because the divisor is proven non-zero (see include/NonZero.h), and
+   * how many coverage sites share their id.
+   */
+  void report() const;
+
+private:
+  /* An instruction to instrument, with its location. */
+  struct Point {
+    Instruction *Inst;
+    int Line, Col;
+    bool Sanitize, Coverage;
+  };
+
+  /**
+   * @brief Give every (line, col) coverage location of the module a dense
+   * id and, with -coverage-map, create the map and register it with the
+   * runtime.
+   */
+  void assignLocationIds();
+
+  /**
+   * @brief Does Div, a division of F, need a __sanitize__ call?
+   */
+  bool needsSanitize(const Instruction &Div, Function &F);
+
+  Module &M;
+  Function *CoverageHook, *SanitizeHook, *DistanceHook = nullptr;
+  IRBuilder<> Builder;
+  /* Points and block distances of the function being instrumented, reused
+   * across functions. */
+  std::vector<Point> Points;
+  std::vector<std::pair<BasicBlock *, unsigned>> Distances;
+
+  /**
+   * Distance of every basic block to the nearest division, computed once
+   * per module when running in directed mode.
+   */
+  DenseMap<const BasicBlock *, unsigned> BlockDistance;
+
+  /**
+   * Divisions the DivZero analysis proved safe (NonZero divisor) or flagged
+   * (Zero/MaybeZero divisor), read from -div-alarms.
+   */
+  DenseSet<const Instruction *> SafeDivisions;
+  DenseSet<const Instruction *> AlarmedDivisions;
+
+  /* Dominator tree of the function being instrumented, computed at its
+   * first division. */
+  DominatorTree DT;
+  bool HasDT = false;
+  unsigned NumDivisions = 0, NumElided = 0;
+
+  /* Id of every (line, col) coverage location, in module order. */
+  DenseMap<uint64_t, unsigned> LocationIds;
+  /* One byte per location id, with -coverage-map. */
+  GlobalVariable *CoverageMap = nullptr;
+  /* Coverage sites, distinct (file, line, col), and those whose (line, col)
+   * id is shared with a site of another file. */
+  unsigned NumSites = 0, NumSharedSites = 0;
+
+  /**
+   * Functions and blocks that get coverage and distance instrumentation.
+   * Divisions are sanitized everywhere.
+   */
+  Selection Selected;
+};
+
+/**
+ * @brief Legacy function pass, opt -load InstrumentPass.so -Instrument
+ */
 struct Instrument : public FunctionPass {
   static char ID;
-  static const char *checkFunctionName;
+
+  std::unique_ptr<Instrumenter> Impl;
 
   Instrument() : FunctionPass(ID) {}
 
+  bool doInitialization(Module &M) override;
   bool runOnFunction(Function &F) override;
+  bool doFinalization(Module &M) override;
+};
+
+/**
+ * @brief Legacy module pass, opt -load InstrumentPass.so -InstrumentModule
+ */
+struct InstrumentModule : public ModulePass {
+  static char ID;
+
+  InstrumentModule() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+};
+
+/**
+ * @brief New pass manager pass, opt -load InstrumentPass.so
+ * -load-pass-plugin InstrumentPass.so -passes=instrument (-load registers
+ * the options).
+ */
+struct InstrumentPass : public PassInfoMixin<InstrumentPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
 };
 } // namespace instrument
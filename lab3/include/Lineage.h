@@ -0,0 +1,86 @@
+#ifndef LINEAGE_H
+#define LINEAGE_H
+
+#include "Random.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <time.h>
+#include <unordered_map>
+
+/**
+ * @brief How an input was produced: either read from a file (seeds and
+ * inputs imported from other instances), or by applying one mutation to a
+ * parent queue entry with the generator in a known state.
+ */
+struct Lineage {
+  long Parent = -1;
+  int Op = -1;
+  Xoshiro256::State State = {};
+  std::string Origin;
+
+  bool isRoot() const { return Parent < 0; }
+};
+
+/**
+ * @brief Log of the lineage of every queue entry and saved input, written to
+ * <output dir>/lineage.txt. Mutated queue entries are not stored, they are
+ * regenerated from their root file by replaying the mutations in order.
+ *
+ * Format:
+ *   entry <id> root <path>
+ *   entry <id> mutant <parent id> <op> <s0> <s1> <s2> <s3>
+ *   saved <path> root <path>
+ *   saved <path> mutant <parent id> <op> <s0> <s1> <s2> <s3>
+ */
+class LineageLog {
+public:
+  /**
+   * @brief Start a new log at Path.
+   */
+  bool open(const std::string &Path);
+
+  /**
+   * @brief Add an input to the queue, no-op if it is already there.
+   *
+   * @return the queue id of Input.
+   */
+  long add(const std::string &Input, const Lineage &From);
+
+  /**
+   * @return the queue id of Input, or -1 if Input is not in the queue.
+   */
+  long find(const std::string &Input) const;
+
+  /**
+   * @brief Record how the input saved at Path was produced. The log is
+   * flushed at most once a second from here, and by flush.
+   */
+  void recordSaved(const std::string &Path, const Lineage &From);
+
+  /**
+   * @brief Write out everything logged so far, e.g. before the fuzzer
+   * stops.
+   */
+  void flush();
+
+  /**
+   * @brief Read the log at Path.
+   *
+   * @param Entries Map to store the queue entries by id.
+   * @param Saved Map to store the saved inputs by path.
+   * @return false if Path cannot be read.
+   */
+  static bool load(const std::string &Path, std::map<long, Lineage> &Entries,
+                   std::map<std::string, Lineage> &Saved);
+
+private:
+  void write(const Lineage &From);
+
+  std::ofstream Log;
+  std::unordered_map<std::string, long> Ids;
+  time_t LastFlush = 0;
+};
+
+#endif // LINEAGE_H
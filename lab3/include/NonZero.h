@@ -0,0 +1,34 @@
+#ifndef NON_ZERO_H
+#define NON_ZERO_H
+
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instruction.h"
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * @brief Is the divisor of Div provably non-zero whenever Div runs?
+ *
+ * A lightweight intra-procedural check, meant to leave out __sanitize__
+ * calls. The divisor is non-zero if it is known non-zero to ValueTracking
+ * (e.g. a non-zero constant), or if it is
+ *   - compared by a dominating branch whose edge to Div excludes zero, e.g.
+ *     Div in the body of "if (b != 0)" or "if (b > 0)";
+ *   - a load of a local whose every store is known non-zero, one of them
+ *     dominating the load;
+ *   - a load of a local whose last dominating store is known non-zero,
+ *     when no other store to the local can run in between.
+ * Loads of the same local count as the same value when no store to the
+ * local can run between them. Locals are allocas only used by loads and
+ * stores, so that no call can write them.
+ *
+ * @param Div Signed or unsigned integer division.
+ * @param DT Dominator tree of the function of Div.
+ */
+bool isNonZeroDivision(const Instruction &Div, const DominatorTree &DT);
+
+} // namespace instrument
+
+#endif // NON_ZERO_H
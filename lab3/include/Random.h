@@ -0,0 +1,66 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief xoshiro256** pseudo random number generator.
+ *
+ * Much faster than rand(), and every worker owns its generator instead of
+ * sharing hidden global state, so fuzzing threads never contend on it. The
+ * whole state is four words that can be saved and restored, which is what
+ * makes a mutation replayable from its parent input.
+ *
+ * Satisfies UniformRandomBitGenerator, so it works with std::shuffle.
+ */
+class Xoshiro256 {
+public:
+  typedef uint64_t result_type;
+  typedef std::array<uint64_t, 4> State;
+
+  explicit Xoshiro256(uint64_t Seed = 0) { seed(Seed); }
+
+  /**
+   * @brief Reset the state from a single seed (expanded with splitmix64).
+   */
+  void seed(uint64_t Seed) {
+    for (auto &Word : S) {
+      Seed += 0x9e3779b97f4a7c15ULL;
+      uint64_t Z = Seed;
+      Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+      Word = Z ^ (Z >> 31);
+    }
+  }
+
+  result_type operator()() {
+    const uint64_t Result = rotl(S[1] * 5, 7) * 9;
+    const uint64_t T = S[1] << 17;
+    S[2] ^= S[0];
+    S[3] ^= S[1];
+    S[1] ^= S[2];
+    S[0] ^= S[3];
+    S[2] ^= T;
+    S[3] = rotl(S[3], 45);
+    return Result;
+  }
+
+  /**
+   * @brief Uniform value in [0, Bound), 0 if Bound is 0.
+   */
+  uint64_t below(uint64_t Bound) { return Bound ? (*this)() % Bound : 0; }
+
+  const State &state() const { return S; }
+  void setState(const State &NewState) { S = NewState; }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+private:
+  static uint64_t rotl(uint64_t X, int K) { return (X << K) | (X >> (64 - K)); }
+
+  State S;
+};
+
+#endif // RANDOM_H
@@ -0,0 +1,43 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief A fork server running in one instance of a target linked with the
+ * runtime (see ForkServer.h), so that a run costs a fork instead of a
+ * process start. Forked from cbi::ForkServer (lab5/include/CBIRunner.h),
+ * keeping only what the minimizer needs; keep the two in step.
+ */
+class ForkServer {
+public:
+  explicit ForkServer(const std::string &Target);
+  ~ForkServer();
+
+  /**
+   * @brief Start the target and wait for its hello.
+   */
+  bool start();
+  void stop();
+
+  /**
+   * @brief Run the target on Input and read back its crash record, empty
+   * if the run did not record a crash. A run longer than TimeoutMs (forever
+   * if negative) is killed with SIGKILL.
+   *
+   * @return false if the fork server died.
+   */
+  bool run(const std::string &Input, int TimeoutMs, int &WaitStatus,
+           std::string &Crash);
+
+private:
+  std::string Target;
+  std::vector<std::string> EnvStrings;
+  std::vector<char *> Env;
+  pid_t Pid = -1;
+  int CtlFd = -1, StatusFd = -1, InputFd = -1, CrashFd = -1;
+};
+
+#endif // RUNNER_H
@@ -0,0 +1,100 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/**
+ * @brief Corpus synchronization between fuzzer instances through a shared
+ * (e.g. NFS) directory.
+ *
+ * Layout of the sync directory:
+ *
+ *   <sync dir>/<id>/queue/id:000000         corpus entry published by <id>
+ *   <sync dir>/<id>/queue/id:000000.meta    its metadata
+ *   <sync dir>/<id>/.synced/<other id>      next entry of <other id> that
+ *                                           <id> has not imported yet
+ *
+ * Entries are written under a temporary name and renamed into place, the
+ * metadata first, so readers never see a partial entry. Each instance only
+ * writes below its own <id> directory.
+ */
+class CorpusSync {
+public:
+  /**
+   * @brief Run an input on the target and collect its coverage.
+   */
+  typedef std::function<void(const std::string &Input,
+                             std::vector<std::string> &Coverage)>
+      RunFn;
+
+  /**
+   * @param SyncDir Shared directory.
+   * @param Id Name of this instance, unique among the instances.
+   * @param Interval Seconds between two imports.
+   */
+  CorpusSync(const std::string &SyncDir, const std::string &Id, int Interval);
+
+  /**
+   * @brief Create the directories of this instance and restore its publish
+   * counter and import cursors from a previous session.
+   *
+   * @return false if the sync directory cannot be used.
+   */
+  bool init();
+
+  /**
+   * @brief Record the coverage of a run of this instance.
+   *
+   * @return true if the run covered something this instance never saw.
+   */
+  bool observe(const std::vector<std::string> &Coverage);
+
+  /**
+   * @brief Publish a corpus entry for the other instances.
+   */
+  void publish(const std::string &Input,
+               const std::vector<std::string> &Coverage);
+
+  /**
+   * @return true if it is time to import from the other instances.
+   */
+  bool due() const;
+
+  /**
+   * @brief Import the entries other instances published since the last
+   * import.
+   *
+   * Entries whose coverage signature is already known are skipped without
+   * running them, the others are run once and kept if they cover something
+   * new to this instance.
+   *
+   * @param Run Function running an input on the target.
+   * @param Imported Vector to store the entries that were kept.
+   * @return Number of entries that were run.
+   */
+  int pull(RunFn Run, std::vector<std::string> &Imported);
+
+private:
+  std::string queueDir(const std::string &Instance) const;
+  std::string entryPath(const std::string &Instance, unsigned N) const;
+  void saveCursor(const std::string &Instance, unsigned N);
+
+  std::string SyncDir;
+  std::string Id;
+  int Interval;
+  time_t LastSync;
+  unsigned NextEntry = 0;
+  // Other instance -> first entry not imported yet.
+  std::map<std::string, unsigned> Cursors;
+  // Union of the coverage of every run of this instance.
+  std::set<std::string> Covered;
+  // Coverage signatures of the entries in the local corpus.
+  std::set<unsigned long long> Signatures;
+};
+
+#endif // SYNC_H
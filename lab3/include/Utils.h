@@ -4,6 +4,7 @@
 #include <map>
 #include <regex>
 #include <set>
+#include <sstream>
 #include <streambuf>
 #include <string>
 #include <sys/stat.h>
@@ -27,14 +28,17 @@ void initialize(std::string &OutDir);
 std::string readOneFile(std::string &Path);
 
 /**
- * @brief Read Seed Inputs from a directory.
+ * @brief Read Seed Inputs from a directory, in file name order so that a
+ * random seed always reproduces the same run.
  *
  * @param SeedInputs Vector to store the seeds.
  * @param SeedInputDir Path to the seed directory.
+ * @param SeedPaths Optional vector to store the path of each seed.
  * @return int exit status.
  */
 int readSeedInputs(std::vector<std::string> &SeedInputs,
-                   std::string &SeedInputDir);
+                   std::string &SeedInputDir,
+                   std::vector<std::string> *SeedPaths = nullptr);
 
 /**
  * @brief Read the coverage file generated by running Target
@@ -45,6 +49,48 @@ int readSeedInputs(std::vector<std::string> &SeedInputs,
 void readCoverageFile(std::string &Target,
                       std::vector<std::string> &CoverageData);
 
+/**
+ * @brief Read the mean distance to the nearest division reported by the
+ * last run of a Target instrumented in directed mode.
+ *
+ * @param Target name of target binary
+ * @param Distance variable to store the mean distance.
+ * @return true if the run reported a distance.
+ */
+bool readDistanceFile(std::string &Target, double &Distance);
+
+/**
+ * @brief Name the crash bucket of the last run of Target: "div-<line>-<col>"
+ * for a division by zero and "signal-<n>" for a signal, as recorded by the
+ * runtime in Target.crash, else "exit-<code>".
+ *
+ * @param Target name of target binary
+ * @param ReturnCode wait status of the run, as returned by runTarget.
+ * @return std::string bucket name, usable as a file name.
+ */
+std::string readCrashBucket(std::string &Target, int ReturnCode);
+
+/**
+ * @brief Name the crash bucket of a run from its crash record, the contents
+ * of Target.crash, as readCrashBucket does.
+ *
+ * @param Record crash record written by the runtime, empty if none.
+ * @param ReturnCode wait status of the run.
+ * @return std::string bucket name, usable as a file name.
+ */
+std::string crashBucket(const std::string &Record, int ReturnCode);
+
+/**
+ * @brief Read the division alarms exported for Target by the DivZero
+ * analysis (Target.alarms, "<id> <line> <col> <domain>" per line).
+ *
+ * @param Target name of target binary
+ * @param AlarmSites set to store the coverage entries ("line, col") of the
+ * divisions whose divisor may be zero.
+ * @return true if Target has an alarm file.
+ */
+bool readAlarmFile(std::string &Target, std::set<std::string> &AlarmSites);
+
 /**
  * @brief Save rondom number generator seed to OutDir/randomseed.txt
  *
@@ -58,16 +104,27 @@ void storeSeed(std::string &OutDir, int randomSeed);
  *
  * @param Input Input string.
  * @param OutDir Path to output directory.
+ * @return std::string path of the stored input, relative to OutDir.
  */
-void storePassingInput(std::string &Input, std::string &OutDir);
+std::string storePassingInput(std::string &Input, std::string &OutDir);
 
 /**
  * @brief Store an input, know to cause a crash.
  *
  * @param Input Input string.
  * @param OutDir Path to output directory.
+ * @return std::string path of the stored input, relative to OutDir.
+ */
+std::string storeCrashingInput(std::string &Input, std::string &OutDir);
+
+/**
+ * @brief Store an input imported from another fuzzer instance.
+ *
+ * @param Input Input string.
+ * @param OutDir Path to output directory.
+ * @return std::string path of the stored input, relative to OutDir.
  */
-void storeCrashingInput(std::string &Input, std::string &OutDir);
+std::string storeImportedInput(const std::string &Input, std::string &OutDir);
 
 /**
  * @brief Run the Target binary with Input on its stdin.
@@ -1,39 +1,436 @@
+#include "ForkServer.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
 
 const int STR_MAX_SIZE = 1024;
 
-void get_logfile(char *buf, const int buf_size, const char *ext) {
-  char exe[STR_MAX_SIZE];
-  int ret = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+/* Path of the running executable, resolved once at load time. */
+static char exe_path[1024];
+
+static void resolve_exe_path(void) {
+  int ret = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
   if (ret == -1) {
     fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
     exit(1);
   }
-  exe[ret] = 0;
+  exe_path[ret] = 0;
+}
+
+void get_logfile(char *buf, const int buf_size, const char *ext) {
+  if (exe_path[0] == 0) {
+    resolve_exe_path();
+  }
+  snprintf(buf, buf_size, "%s%s", exe_path, ext);
+}
+
+/*
+ * Async-signal-safe helpers, the log files are also written from the crash
+ * handlers where stdio must not be used.
+ */
+static char *append_str(char *out, const char *str) {
+  while (*str) {
+    *out++ = *str++;
+  }
+  return out;
+}
 
-  int len = strlen(exe);
-  strncpy(buf, exe, len);
-  buf[len] = 0;
-  for (int i = 0; i <= strlen(ext); ++i) {
-    buf[buf_size-(i+1)] = 0;
+static char *append_num(char *out, long long num) {
+  char digits[24];
+  int len = 0;
+  unsigned long long value =
+      num < 0 ? -(unsigned long long)num : (unsigned long long)num;
+  if (num < 0) {
+    *out++ = '-';
+  }
+  do {
+    digits[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (len) {
+    *out++ = digits[--len];
+  }
+  return out;
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(fd, buf, len);
+    if (ret <= 0) {
+      return;
+    }
+    buf += ret;
+    len -= ret;
+  }
+}
+
+static int open_logfile(const char *ext, int flags) {
+  char logfile[sizeof(exe_path) + 16];
+  char *end = append_str(append_str(logfile, exe_path), ext);
+  *end = 0;
+  return open(logfile, O_WRONLY | O_CREAT | flags, 0644);
+}
+
+/* Set in the children of the fork server, which keep no logs. */
+static int under_fork_server = 0;
+/* Where the children of the fork server record their crash, if anywhere. */
+static int crash_fd = -1;
+
+/*
+ * Record where the program crashed in <exe>.crash, "div <line> <col>" for a
+ * division by zero or "signal <sig>", for the fuzzer to bucket crashes.
+ */
+static void dump_crash(const char *kind, int first, int second) {
+  int fd = under_fork_server ? crash_fd : open_logfile(".crash", O_TRUNC);
+  if (fd == -1) {
+    return;
+  }
+  char buf[64];
+  char *end = append_num(append_str(buf, kind), first);
+  if (second >= 0) {
+    *end++ = ' ';
+    end = append_num(end, second);
+  }
+  *end++ = '\n';
+  write_all(fd, buf, end - buf);
+  if (fd != crash_fd) {
+    close(fd);
   }
-  strncat(buf, ext, strlen(ext));
 }
 
 void __sanitize__(int divisor, int line, int col) {
   if (divisor == 0) {
     printf("Divide-by-zero detected at line %d and col %d\n", line, col);
+    dump_crash("div ", line, col);
     exit(1);
   }
 }
 
+/*
+ * Every thread logs into its own thread_log, so the hooks never lock or
+ * share cache lines. The logs are heap allocated, to outlive their thread,
+ * and pushed on a lock-free list that the flush walks to merge them.
+ */
+typedef struct {
+  size_t capacity;
+  uint64_t slots[];
+} cov_index;
+
+typedef struct thread_log {
+  struct thread_log *next;
+  /*
+   * Locations covered by the thread, deduplicated in an open-addressing
+   * hash set and kept in first-hit order.
+   */
+  cov_index *index;
+  uint64_t *order;
+  size_t count;
+  long long distance_sum;
+  long long distance_count;
+} thread_log;
+
+static thread_log *thread_logs = NULL;
+static __thread thread_log *local_log = NULL;
+
+/* Keys are (line + 1, col + 1) so that 0 marks an empty slot. */
+static uint64_t cov_key(int line, int col) {
+  return ((uint64_t)(uint32_t)(line + 1) << 32) | (uint32_t)(col + 1);
+}
+
+static size_t cov_slot(const cov_index *index, uint64_t key) {
+  uint64_t hash = key * 0x9e3779b97f4a7c15ULL;
+  size_t mask = index->capacity - 1;
+  size_t slot = (size_t)(hash >> 32) & mask;
+  while (index->slots[slot] != 0 && index->slots[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/*
+ * The old arrays are not freed, a flush running in another thread may still
+ * be reading them. The leak is bounded by the final size of the set.
+ */
+static void cov_grow(thread_log *log) {
+  size_t capacity = log->index ? log->index->capacity * 2 : 1024;
+  cov_index *index = calloc(1, sizeof(cov_index) + capacity * sizeof(uint64_t));
+  uint64_t *order = malloc(capacity / 2 * sizeof(uint64_t));
+  if (index == NULL || order == NULL) {
+    fprintf(stderr, "Error: Out of memory for coverage\n");
+    exit(1);
+  }
+  index->capacity = capacity;
+  for (size_t i = 0; i < log->count; ++i) {
+    order[i] = log->order[i];
+    index->slots[cov_slot(index, order[i])] = order[i];
+  }
+  __atomic_store_n(&log->order, order, __ATOMIC_RELEASE);
+  __atomic_store_n(&log->index, index, __ATOMIC_RELEASE);
+}
+
+static thread_log *get_thread_log(void) {
+  thread_log *log = local_log;
+  if (log != NULL) {
+    return log;
+  }
+  log = calloc(1, sizeof(thread_log));
+  if (log == NULL) {
+    fprintf(stderr, "Error: Out of memory for coverage\n");
+    exit(1);
+  }
+  cov_grow(log);
+  log->next = __atomic_load_n(&thread_logs, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&thread_logs, &log->next, log, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  local_log = log;
+  return log;
+}
+
 void __coverage__(int line, int col) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cov");
-  FILE *f = fopen(logfile, "a");
-  fprintf(f, "%d, %d\n", line, col);
-  fclose(f);
+  thread_log *log = get_thread_log();
+  uint64_t key = cov_key(line, col);
+  size_t slot = cov_slot(log->index, key);
+  if (log->index->slots[slot] == key) {
+    return;
+  }
+  if (log->count + 1 > log->index->capacity / 2) {
+    cov_grow(log);
+    slot = cov_slot(log->index, key);
+  }
+  log->index->slots[slot] = key;
+  log->order[log->count] = key;
+  __atomic_store_n(&log->count, log->count + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Coverage maps of the modules instrumented with -coverage-map: one byte
+ * per (line, col) location of the module, set by the instrumented code, and
+ * the line and column of every location.
+ */
+typedef struct cov_map {
+  struct cov_map *next;
+  const uint8_t *hits;
+  const int *locations;
+  int count;
+} cov_map;
+
+static cov_map *cov_maps = NULL;
+/* Locations of the maps already dumped, sized for all the maps. */
+static cov_index *cov_dumped = NULL;
+
+/* Called by the module constructors, before main and any thread. */
+void __coverage_map__(uint8_t *hits, const int *locations, int count) {
+  static size_t total = 0;
+  cov_map *map = malloc(sizeof(cov_map));
+  total += count;
+  size_t capacity = 1024;
+  while (capacity < total * 2) {
+    capacity *= 2;
+  }
+  if (cov_dumped == NULL || cov_dumped->capacity < capacity) {
+    free(cov_dumped);
+    cov_dumped = calloc(1, sizeof(cov_index) + capacity * sizeof(uint64_t));
+  }
+  if (map == NULL || cov_dumped == NULL) {
+    fprintf(stderr, "Error: Out of memory for coverage\n");
+    exit(1);
+  }
+  cov_dumped->capacity = capacity;
+  map->hits = hits;
+  map->locations = locations;
+  map->count = count;
+  map->next = cov_maps;
+  cov_maps = map;
+}
+
+/* Was key covered by one of the threads logged before last? */
+static int covered_before(const thread_log *first, const thread_log *last,
+                          uint64_t key) {
+  for (const thread_log *log = first; log != last; log = log->next) {
+    const cov_index *index = __atomic_load_n(&log->index, __ATOMIC_ACQUIRE);
+    if (index->slots[cov_slot(index, key)] == key) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static char *append_location(char *out, uint64_t key) {
+  out = append_num(out, (long long)(key >> 32) - 1);
+  out = append_str(out, ", ");
+  out = append_num(out, (long long)(key & 0xffffffff) - 1);
+  *out++ = '\n';
+  return out;
+}
+
+static void dump_coverage(void) {
+  thread_log *logs = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+  if (logs == NULL && cov_maps == NULL) {
+    return;
+  }
+  int fd = open_logfile(".cov", O_APPEND);
+  if (fd == -1) {
+    return;
+  }
+  char buf[4096];
+  char *end = buf;
+  for (thread_log *log = logs; log != NULL; log = log->next) {
+    size_t count = __atomic_load_n(&log->count, __ATOMIC_ACQUIRE);
+    const uint64_t *order = __atomic_load_n(&log->order, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < count; ++i) {
+      if (covered_before(logs, log, order[i])) {
+        continue;
+      }
+      if (end - buf > (long)sizeof(buf) - 64) {
+        write_all(fd, buf, end - buf);
+        end = buf;
+      }
+      end = append_location(end, order[i]);
+    }
+  }
+  /* Locations shared by several maps, or also logged, are written once. */
+  for (const cov_map *map = cov_maps; map != NULL; map = map->next) {
+    for (int i = 0; i < map->count; ++i) {
+      if (!map->hits[i]) {
+        continue;
+      }
+      uint64_t key = cov_key(map->locations[2 * i], map->locations[2 * i + 1]);
+      size_t slot = cov_slot(cov_dumped, key);
+      if (cov_dumped->slots[slot] == key || covered_before(logs, NULL, key)) {
+        continue;
+      }
+      cov_dumped->slots[slot] = key;
+      if (end - buf > (long)sizeof(buf) - 64) {
+        write_all(fd, buf, end - buf);
+        end = buf;
+      }
+      end = append_location(end, key);
+    }
+  }
+  write_all(fd, buf, end - buf);
+  close(fd);
+}
+
+void __distance__(int distance) {
+  thread_log *log = get_thread_log();
+  log->distance_sum += distance;
+  log->distance_count++;
+}
+
+static void dump_distance(void) {
+  long long distance_sum = 0;
+  long long distance_count = 0;
+  for (thread_log *log = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+       log != NULL; log = log->next) {
+    distance_sum += log->distance_sum;
+    distance_count += log->distance_count;
+  }
+  if (distance_count == 0) {
+    return;
+  }
+  int fd = open_logfile(".dist", O_TRUNC);
+  if (fd == -1) {
+    return;
+  }
+  char buf[64];
+  char *end = append_num(buf, distance_sum);
+  *end++ = ' ';
+  end = append_num(end, distance_count);
+  *end++ = '\n';
+  write_all(fd, buf, end - buf);
+  close(fd);
+}
+
+static void dump_logs(void) {
+  /* Only the first thread to exit or crash writes the logs. */
+  static int dumped = 0;
+  if (__atomic_exchange_n(&dumped, 1, __ATOMIC_ACQ_REL) ||
+      under_fork_server) {
+    return;
+  }
+  dump_coverage();
+  dump_distance();
+}
+
+/* Flush the logs when the program crashes, then crash the same way. */
+static void crash_handler(int sig) {
+  dump_crash("signal ", sig, -1);
+  dump_logs();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/*
+ * Serve the minimizer, see ForkServer.h. Only returns in the children,
+ * which go on to run main.
+ */
+static void run_fork_server(void) {
+  const int ctl_fd = FUZZ_FORKSRV_FD, status_fd = FUZZ_FORKSRV_FD + 1;
+  int hello = FUZZ_FORKSRV_HELLO;
+  if (write(status_fd, &hello, sizeof(hello)) != sizeof(hello)) {
+    return;
+  }
+  under_fork_server = 1;
+  if (fcntl(FUZZ_CRASH_FD, F_GETFD) != -1) {
+    crash_fd = FUZZ_CRASH_FD;
+  }
+  for (;;) {
+    int cmd, status;
+    if (read(ctl_fd, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+      _exit(0);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      _exit(1);
+    }
+    if (pid == 0) {
+      close(ctl_fd);
+      close(status_fd);
+      return;
+    }
+    if (write(status_fd, &pid, sizeof(pid)) != sizeof(pid) ||
+        waitpid(pid, &status, 0) < 0 ||
+        write(status_fd, &status, sizeof(status)) != sizeof(status)) {
+      _exit(0);
+    }
+  }
+}
+
+/*
+ * Defined by the Instrument pass when main calls __fuzz_init_done, see
+ * ForkServer.h.
+ */
+extern const int __fuzz_deferred_init __attribute__((weak));
+
+/* The fork server waits for __fuzz_init_done. */
+static int fork_server_pending = 0;
+
+void __fuzz_init_done(void) {
+  if (fork_server_pending) {
+    fork_server_pending = 0;
+    run_fork_server();
+  }
+}
+
+__attribute__((constructor)) static void init_runtime(void) {
+  resolve_exe_path();
+  atexit(dump_logs);
+  const int signals[] = {SIGSEGV, SIGFPE, SIGABRT, SIGBUS, SIGILL};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+    signal(signals[i], crash_handler);
+  }
+  if (getenv(FUZZ_FORKSRV_ENV)) {
+    if (&__fuzz_deferred_init) {
+      fork_server_pending = 1;
+    } else {
+      run_fork_server();
+    }
+  }
 }
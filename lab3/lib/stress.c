@@ -0,0 +1,127 @@
+/*
+ * Stress test of the runtime with many threads hitting the hooks at once.
+ *
+ * The workload runs in a child process; once it has exited, the parent
+ * checks that <exe>.cov lists every covered location exactly once and that
+ * <exe>.dist adds up the distances of all threads.
+ *
+ * Usage: runtime-stress [threads] [iterations]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void __coverage__(int line, int col);
+void __distance__(int distance);
+
+/* Locations every thread covers, then locations only thread t covers. */
+#define SHARED_SITES 64
+#define PRIVATE_SITES 256
+
+static int num_threads = 8;
+static int iterations = 20000;
+
+static void *worker(void *arg) {
+  int id = (int)(long)arg;
+  for (int i = 0; i < iterations; ++i) {
+    __coverage__(1 + i % SHARED_SITES, 1);
+    __coverage__(1000 * (id + 1) + i % PRIVATE_SITES, 2);
+    __distance__(id + 1);
+  }
+  return NULL;
+}
+
+static void run_workload(void) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  for (long i = 0; i < num_threads; ++i) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+static int check_coverage(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  int expected = SHARED_SITES + num_threads * PRIVATE_SITES;
+  char *seen = calloc(1000 * (num_threads + 1) + PRIVATE_SITES, 1);
+  int line, col, count = 0, errors = 0;
+  while (fscanf(f, "%d, %d\n", &line, &col) == 2) {
+    if (seen[line]++ && errors++ < 10) {
+      fprintf(stderr, "Location %d, %d logged twice\n", line, col);
+    }
+    ++count;
+  }
+  fclose(f);
+  free(seen);
+  if (count != expected) {
+    fprintf(stderr, "Expected %d locations, got %d\n", expected, count);
+    ++errors;
+  }
+  return errors;
+}
+
+static int check_distance(const char *path) {
+  FILE *f = fopen(path, "r");
+  long long sum = 0, count = 0;
+  if (f == NULL || fscanf(f, "%lld %lld", &sum, &count) != 2) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  fclose(f);
+  long long expected_sum =
+      (long long)iterations * num_threads * (num_threads + 1) / 2;
+  long long expected_count = (long long)iterations * num_threads;
+  if (sum != expected_sum || count != expected_count) {
+    fprintf(stderr, "Expected distance %lld %lld, got %lld %lld\n",
+            expected_sum, expected_count, sum, count);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    num_threads = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    iterations = atoi(argv[2]);
+  }
+
+  char exe[1024], cov[1040], dist[1040];
+  int len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len == -1) {
+    fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
+    return 1;
+  }
+  exe[len] = 0;
+  snprintf(cov, sizeof(cov), "%s.cov", exe);
+  snprintf(dist, sizeof(dist), "%s.dist", exe);
+  unlink(cov);
+  unlink(dist);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    run_workload();
+    exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "Workload did not exit cleanly\n");
+    return 1;
+  }
+
+  int errors = check_coverage(cov) + check_distance(dist);
+  printf("%d threads x %d iterations: %s\n", num_threads, iterations,
+         errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+#include "CrashMinimizer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const int TIMEOUT_MS = 1000;
+
+} // namespace
+
+CrashMinimizer::CrashMinimizer(const std::string &Target,
+                               const std::string &OutDir, uint64_t Budget)
+    : Dir(OutDir + "/failure/minimized"), Budget(Budget),
+      Delta(Target, 1, TIMEOUT_MS) {}
+
+CrashMinimizer::~CrashMinimizer() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Stopping = true;
+  }
+  Wake.notify_one();
+  if (Worker.joinable())
+    Worker.join();
+}
+
+bool CrashMinimizer::start() {
+  mkdir(Dir.c_str(), 0755);
+  if (!Delta.start())
+    return false;
+  Worker = std::thread(&CrashMinimizer::work, this);
+  return true;
+}
+
+void CrashMinimizer::add(const std::string &Bucket, const std::string &Input) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Buckets.insert(Bucket).second ||
+        access((Dir + "/" + Bucket).c_str(), F_OK) == 0)
+      return;
+    Queue.emplace_back(Bucket, Input);
+  }
+  Wake.notify_one();
+}
+
+void CrashMinimizer::work() {
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true) {
+    Wake.wait(Guard, [this]() { return Stopping || !Queue.empty(); });
+    if (Stopping)
+      return;
+    std::pair<std::string, std::string> Crash = std::move(Queue.front());
+    Queue.pop_front();
+    Guard.unlock();
+
+    // The crash may not reproduce on the fork server (e.g. a timeout), the
+    // next crash of the bucket gets another chance. Candidates must crash
+    // in the same bucket, not just crash.
+    Delta.setBucket(Crash.first);
+    if (!Delta.crashes(Crash.second)) {
+      Guard.lock();
+      Buckets.erase(Crash.first);
+      continue;
+    }
+    Delta.setBudget(Delta.executions() + Budget);
+    std::string Result = Delta.minimize(Crash.second);
+    // Written under a temporary name, readers never see a partial input.
+    std::string Path = Dir + "/" + Crash.first;
+    {
+      std::ofstream Out(Path + ".tmp", std::ios::binary);
+      Out << Result;
+    }
+    std::rename((Path + ".tmp").c_str(), Path.c_str());
+
+    Guard.lock();
+  }
+}
@@ -0,0 +1,105 @@
+#include "Delta.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <signal.h>
+#include <sys/wait.h>
+#include <thread>
+
+DeltaDebugger::DeltaDebugger(const std::string &Target, unsigned Jobs,
+                             int TimeoutMs)
+    : Target(Target), Jobs(std::max(1u, Jobs)), TimeoutMs(TimeoutMs),
+      Executions(0) {}
+
+bool DeltaDebugger::start() {
+  for (unsigned I = 0; I < Jobs; ++I) {
+    Servers.emplace_back(new ForkServer(Target));
+    if (!Servers.back()->start())
+      return false;
+  }
+  return true;
+}
+
+bool DeltaDebugger::crashes(const std::string &Input) {
+  return crashes(*Servers[0], Input);
+}
+
+std::string DeltaDebugger::bucket(const std::string &Input) {
+  return bucket(*Servers[0], Input);
+}
+
+bool DeltaDebugger::crashes(ForkServer &Server, const std::string &Input) {
+  std::string Found = bucket(Server, Input);
+  return !Found.empty() && (Bucket.empty() || Found == Bucket);
+}
+
+std::string DeltaDebugger::bucket(ForkServer &Server,
+                                  const std::string &Input) {
+  // Restart a server that died once, then give up on the input.
+  for (int Attempt = 0; Attempt < 2; ++Attempt) {
+    int Status;
+    std::string Crash;
+    if (Server.run(Input, TimeoutMs, Status, Crash)) {
+      ++Executions;
+      if (WIFSIGNALED(Status) ? WTERMSIG(Status) == SIGKILL
+                              : WEXITSTATUS(Status) == 0)
+        return std::string();
+      return crashBucket(Crash, Status);
+    }
+    Server.stop();
+    if (!Server.start())
+      break;
+  }
+  return std::string();
+}
+
+size_t
+DeltaDebugger::firstCrash(size_t N,
+                          const std::function<std::string(size_t)> &Candidate) {
+  std::atomic<size_t> Next(0), First(N);
+  auto Work = [&](ForkServer *Server) {
+    // Candidates after a crashing one are never needed.
+    for (size_t I = Next++; I < N && I < First && Executions < Budget;
+         I = Next++) {
+      if (!crashes(*Server, Candidate(I)))
+        continue;
+      size_t Current = First;
+      while (I < Current && !First.compare_exchange_weak(Current, I)) {
+      }
+    }
+  };
+  size_t Workers = std::min<size_t>(Servers.size(), N);
+  std::vector<std::thread> Threads;
+  for (size_t I = 1; I < Workers; ++I)
+    Threads.emplace_back(Work, Servers[I].get());
+  Work(Servers[0].get());
+  for (auto &Thread : Threads)
+    Thread.join();
+  return First;
+}
+
+std::string DeltaDebugger::minimize(const std::string &Input) {
+  std::string Current = Input;
+  size_t N = 2;
+  while (Current.size() >= N && Executions < Budget) {
+    size_t Len = Current.size(), Chunk = Len / N;
+    size_t Chunks = (Len + Chunk - 1) / Chunk;
+    // Candidate 2 * i is chunk i, 2 * i + 1 its complement.
+    auto Candidate = [&](size_t I) {
+      size_t Start = I / 2 * Chunk, End = std::min(Start + Chunk, Len);
+      if (I % 2 == 0)
+        return Current.substr(Start, End - Start);
+      return Current.substr(0, Start) + Current.substr(End);
+    };
+    size_t First = firstCrash(2 * Chunks, Candidate);
+    if (First == 2 * Chunks) {
+      N *= 2;
+      continue;
+    }
+    Current = Candidate(First);
+    N = First % 2 == 0 ? 2 : N - 1;
+  }
+  if (Executions >= Budget)
+    return Current;
+  return crashes(std::string()) ? std::string() : Current;
+}
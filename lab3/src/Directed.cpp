@@ -0,0 +1,65 @@
+#include "Directed.h"
+
+#include <cmath>
+
+/**
+ * Number of mutations per selection for an input with average distance.
+ */
+static const double BASE_ENERGY = 16;
+
+/**
+ * The annealing factor ranges over [1 / MAX_FACTOR, MAX_FACTOR] (AFLGo).
+ */
+static const double MAX_FACTOR = 32;
+
+/**
+ * Extra energy for inputs reaching a division flagged by the DivZero analysis.
+ */
+static const double ALARM_BOOST = 4;
+
+DirectedScheduler::DirectedScheduler(double TimeToExploit)
+    : TimeToExploit(TimeToExploit), Start(time(NULL)) {}
+
+void DirectedScheduler::add(const std::string &Input, double Distance,
+                            bool Alarmed) {
+  Queue.push_back({Input, Distance, Alarmed});
+  if (Distance < 0)
+    return;
+  if (MinDistance < 0 || Distance < MinDistance)
+    MinDistance = Distance;
+  if (Distance > MaxDistance)
+    MaxDistance = Distance;
+}
+
+unsigned DirectedScheduler::energy(const Entry &E) const {
+  // Inputs that never came near a division count as the farthest ones.
+  double Normalized = 1;
+  if (E.Distance >= 0 && MaxDistance > MinDistance)
+    Normalized = (E.Distance - MinDistance) / (MaxDistance - MinDistance);
+  else if (E.Distance >= 0)
+    Normalized = 0.5;
+
+  double Elapsed = difftime(time(NULL), Start);
+  double Temperature = pow(20.0, -Elapsed / TimeToExploit);
+  double P = (1 - Normalized) * (1 - Temperature) + 0.5 * Temperature;
+  double Factor = pow(2.0, 2.0 * log2(MAX_FACTOR) * (P - 0.5));
+
+  double Energy = BASE_ENERGY * Factor;
+  if (E.Alarmed)
+    Energy *= ALARM_BOOST;
+  return Energy < 1 ? 1 : (unsigned)Energy;
+}
+
+std::string DirectedScheduler::next() {
+  if (Queue.empty())
+    return "";
+  if (!Started) {
+    Started = true;
+    Remaining = energy(Queue[Current]);
+  } else if (Remaining == 0) {
+    Current = (Current + 1) % Queue.size();
+    Remaining = energy(Queue[Current]);
+  }
+  --Remaining;
+  return Queue[Current].Input;
+}
@@ -0,0 +1,243 @@
+#include "Distance.h"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+
+#include <fstream>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <vector>
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * Weight of one call-graph hop relative to one CFG edge (AFLGo uses 10).
+ */
+static const unsigned CALL_DISTANCE_FACTOR = 10;
+
+bool isDivision(const Instruction &Inst) {
+  return Inst.getOpcode() == Instruction::SDiv ||
+         Inst.getOpcode() == Instruction::UDiv;
+}
+
+static const Function *getCallee(const Instruction &Inst) {
+  if (auto *Call = dyn_cast<CallInst>(&Inst))
+    return Call->getCalledFunction();
+  if (auto *Invoke = dyn_cast<InvokeInst>(&Inst))
+    return Invoke->getCalledFunction();
+  return nullptr;
+}
+
+static bool isTarget(const Instruction &Inst,
+                     const DenseSet<const Instruction *> *Targets) {
+  return isDivision(Inst) && (!Targets || Targets->count(&Inst));
+}
+
+/**
+ * @brief Compute the call-graph distance of every function to the nearest
+ * function containing a division.
+ */
+static std::map<const Function *, unsigned>
+computeFunctionDistances(Module &M,
+                         const DenseSet<const Instruction *> *Targets) {
+  std::map<const Function *, unsigned> FunDistance;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &Inst : BB) {
+        if (isTarget(Inst, Targets))
+          FunDistance[&F] = 0;
+      }
+    }
+  }
+
+  // Relax call edges until nothing changes, the call graph is tiny compared
+  // to the instruction count so a Bellman-Ford style loop is good enough.
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (auto &F : M) {
+      for (auto &BB : F) {
+        for (auto &Inst : BB) {
+          auto It = FunDistance.find(getCallee(Inst));
+          if (It == FunDistance.end())
+            continue;
+          unsigned Candidate = It->second + 1;
+          auto Old = FunDistance.find(&F);
+          if (Old == FunDistance.end() || Old->second > Candidate) {
+            FunDistance[&F] = Candidate;
+            Changed = true;
+          }
+        }
+      }
+    }
+  }
+  return FunDistance;
+}
+
+void computeDivDistances(Module &M,
+                         DenseMap<const BasicBlock *, unsigned> &Distance,
+                         const DenseSet<const Instruction *> *Targets) {
+  auto FunDistance = computeFunctionDistances(M, Targets);
+
+  using Entry = std::pair<unsigned, const BasicBlock *>;
+  for (auto &F : M) {
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> Queue;
+
+    // Seed the search with blocks that divide or call towards a division.
+    for (auto &BB : F) {
+      bool Found = false;
+      unsigned Base = 0;
+      for (auto &Inst : BB) {
+        unsigned Candidate;
+        if (isTarget(Inst, Targets)) {
+          Candidate = 0;
+        } else {
+          auto It = FunDistance.find(getCallee(Inst));
+          if (It == FunDistance.end())
+            continue;
+          Candidate = CALL_DISTANCE_FACTOR * (It->second + 1);
+        }
+        if (!Found || Candidate < Base)
+          Base = Candidate;
+        Found = true;
+      }
+      if (Found) {
+        Distance[&BB] = Base;
+        Queue.push({Base, &BB});
+      }
+    }
+
+    // Dijkstra over the reversed CFG with unit edge weights.
+    while (!Queue.empty()) {
+      auto Top = Queue.top();
+      Queue.pop();
+      if (Top.first > Distance[Top.second])
+        continue;
+      for (auto *Pred : predecessors(Top.second)) {
+        auto It = Distance.find(Pred);
+        if (It == Distance.end() || It->second > Top.first + 1) {
+          Distance[Pred] = Top.first + 1;
+          Queue.push({Top.first + 1, Pred});
+        }
+      }
+    }
+  }
+}
+
+static void getBlockLocation(const BasicBlock &BB, int &Line, int &Col) {
+  Line = Col = 0;
+  for (auto &Inst : BB) {
+    if (const auto &DebugLoc = Inst.getDebugLoc()) {
+      Line = DebugLoc.getLine();
+      Col = DebugLoc.getCol();
+      return;
+    }
+  }
+}
+
+void writeSiteTable(Module &M,
+                    const DenseMap<const BasicBlock *, unsigned> &Distance,
+                    const std::string &Path) {
+  std::ofstream Table(Path);
+  if (!Table) {
+    errs() << "Cannot write site table " << Path << "\n";
+    return;
+  }
+  Table << "# kind id line col distance\n";
+
+  int BlockId = 0, DivId = 0;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      int Line, Col;
+      auto It = Distance.find(&BB);
+      if (It != Distance.end()) {
+        getBlockLocation(BB, Line, Col);
+        Table << "block " << BlockId << " " << Line << " " << Col << " "
+              << It->second << "\n";
+      }
+      ++BlockId;
+
+      for (auto &Inst : BB) {
+        if (!isDivision(Inst))
+          continue;
+        Line = Col = 0;
+        if (const auto &DebugLoc = Inst.getDebugLoc()) {
+          Line = DebugLoc.getLine();
+          Col = DebugLoc.getCol();
+        }
+        Table << "div " << DivId++ << " " << Line << " " << Col << " 0\n";
+      }
+    }
+  }
+}
+
+bool readDivAlarms(Module &M, const std::string &Path,
+                   DenseSet<const Instruction *> &Safe,
+                   DenseSet<const Instruction *> &Alarmed) {
+  std::ifstream Alarms(Path);
+  if (!Alarms)
+    return false;
+
+  struct DivAlarm {
+    int SrcLine, SrcCol;
+    std::string Domain;
+  };
+  std::map<unsigned, DivAlarm> Sites;
+  std::string Line;
+  while (std::getline(Alarms, Line)) {
+    std::istringstream Fields(Line);
+    unsigned Id;
+    DivAlarm Alarm;
+    if (Line.empty() || Line[0] == '#' ||
+        !(Fields >> Id >> Alarm.SrcLine >> Alarm.SrcCol >> Alarm.Domain))
+      continue;
+    Sites[Id] = Alarm;
+  }
+
+  // The ids only match if the alarms were computed on this module: every
+  // site must be at the location of its division, else none is used.
+  DenseSet<const Instruction *> NewSafe, NewAlarmed;
+  unsigned Id = 0;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &Inst : BB) {
+        if (!isDivision(Inst))
+          continue;
+        auto It = Sites.find(Id++);
+        if (It == Sites.end())
+          continue;
+        int SrcLine = 0, SrcCol = 0;
+        if (const auto &DebugLoc = Inst.getDebugLoc()) {
+          SrcLine = DebugLoc.getLine();
+          SrcCol = DebugLoc.getCol();
+        }
+        if (It->second.SrcLine != SrcLine || It->second.SrcCol != SrcCol) {
+          errs() << "Division alarms " << Path << " do not match the module"
+                 << " (site " << It->first << " at " << It->second.SrcLine
+                 << ":" << It->second.SrcCol << ", division at " << SrcLine
+                 << ":" << SrcCol << "), ignoring them\n";
+          return true;
+        }
+        if (It->second.Domain == "NonZero")
+          NewSafe.insert(&Inst);
+        else if (It->second.Domain == "Zero" ||
+                 It->second.Domain == "MaybeZero")
+          NewAlarmed.insert(&Inst);
+      }
+    }
+  }
+  if (!Sites.empty() && Sites.rbegin()->first >= Id) {
+    errs() << "Division alarms " << Path << " do not match the module ("
+           << Sites.size() << " sites, " << Id
+           << " divisions), ignoring them\n";
+    return true;
+  }
+  Safe.insert(NewSafe.begin(), NewSafe.end());
+  Alarmed.insert(NewAlarmed.begin(), NewAlarmed.end());
+  return true;
+}
+
+} // namespace instrument
@@ -6,9 +6,12 @@
  * implementation, you don't have to modify it.
  */
 
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <signal.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -19,6 +22,11 @@
 #include <cstring>
 #include <string>
 
+#include "CrashMinimizer.h"
+#include "Directed.h"
+#include "Lineage.h"
+#include "Random.h"
+#include "Sync.h"
 #include "Utils.h"
 
 #define ARG_EXIST_CHECK(Name, Arg)                                             \
@@ -50,11 +58,13 @@ typedef std::string MutationFn(std::string);
  * @param Mutation     mutation function used for this run.
  * @param Input        parent input used for generating input for this run.
  * @param MutatedInput input string for this run.
+ * @param From         how MutatedInput was derived from Input, for replay.
  */
 struct RunInfo {
   bool Passed;
   MutationFn *Mutation;
   std::string Input, MutatedInput;
+  Lineage From;
 };
 
 /************************************************/
@@ -91,6 +101,61 @@ int StrategyState = -1; //var that describe the input index
 int StrategyIndex = -1; //store last good input index
 int InputCounter = 0;
 int MutationCounter = 0;
+/**
+ * @brief Power schedule for directed fuzzing, only set when FUZZ_DIRECTED is
+ * in the environment and the target was instrumented with -directed.
+ */
+DirectedScheduler *Scheduler = nullptr;
+// Default time to exploitation of the annealing schedule, see FUZZ_TX.
+const double DEFAULT_TIME_TO_EXPLOIT = 300;
+// Coverage entries of divisions the static DivZero analysis flagged.
+std::set<std::string> AlarmSites;
+// Inputs whose coverage reaches one of the AlarmSites.
+std::vector<std::string> AlarmInputs;
+/**
+ * @brief Corpus exchange with other fuzzer instances, only set when
+ * FUZZ_SYNC_DIR is in the environment.
+ */
+CorpusSync *Sync = nullptr;
+// Default seconds between two imports from other instances.
+const int DEFAULT_SYNC_INTERVAL = 10;
+/**
+ * @brief Random number generator of this worker, all random decisions must
+ * go through it so that a run can be replayed from its seed.
+ */
+thread_local Xoshiro256 Rng;
+// Lineage of the queue entries and saved inputs, see --replay.
+LineageLog Lineages;
+/**
+ * @brief Set by SIGTERM (e.g. the timeout of test.sh) and SIGINT: the
+ * fuzzer stops after the current run and flushes its logs. A second signal
+ * kills it.
+ */
+volatile sig_atomic_t Stopping = 0;
+
+void requestStop(int Sig) {
+  Stopping = 1;
+  signal(Sig, SIG_DFL);
+}
+/**
+ * @brief Background minimization of new crash buckets, unless
+ * FUZZ_MINIMIZE_BUDGET is 0 or the target has no fork server.
+ */
+CrashMinimizer *Minimizer = nullptr;
+// Default runs of the target per minimized crash.
+const uint64_t DEFAULT_MINIMIZE_BUDGET = 1000;
+
+/**
+ * @brief Does the coverage of a run reach a division flagged by the static
+ * DivZero analysis?
+ */
+bool reachesAlarm(std::vector<std::string> &CoverageData) {
+  for (auto &Site : CoverageData) {
+    if (AlarmSites.count(Site))
+      return true;
+  }
+  return false;
+}
 /************************************************/
 /*    Implement your select input algorithm     */
 /************************************************/
@@ -107,25 +172,30 @@ int MutationCounter = 0;
  * @return Pointer to a string.
  */
 std::string selectInput(RunInfo Info) {
+  if (Scheduler)
+    return Scheduler->next();
+  // Inputs reaching a statically flagged division get half of the picks.
+  if (!AlarmInputs.empty() && Rng.below(2) == 0)
+    return AlarmInputs[Rng.below(AlarmInputs.size())];
   int length = SeedInputs.size();
-  int Index = rand() % length;
+  int Index = Rng.below(length);
   if(InputCounter==0){
-    int luck = rand() % 3;
+    int luck = Rng.below(3);
     if(luck ==0) return SeedInputs[length-1];
   }
   if(InputCounter>10){
-    int luck = rand() % 3;
+    int luck = Rng.below(3);
     if(luck == 0 && Candidates.size()>1) 
-    return Candidates[rand() %Candidates.size()];
+    return Candidates[Rng.below(Candidates.size())];
   }
   
   if(StrategyState!=-1 && StrategyIndex!=-1){
     while(Index == StrategyState){
-      Index = rand() % length;
+      Index = Rng.below(length);
     }
   }
   StrategyIndex = Index;
-  int LetGodDecide =rand() %5;
+  int LetGodDecide =Rng.below(5);
   if(LetGodDecide==0) return SeedInputs[Index];
   if(LetGodDecide==1) return BestInputSoFar;
   
@@ -160,8 +230,8 @@ std::string mutationB(std::string Original) {
   if (Original.length() <= 0)
     return Original;
 
-  int Index = rand() % Original.length();
-  int randomASCII = rand() % 128;
+  int Index = Rng.below(Original.length());
+  int randomASCII = Rng.below(128);
   char c = '\0' + randomASCII;
   return Original.insert(Index, 1, c);
 }
@@ -182,9 +252,9 @@ std::string mutationB(std::string Original) {
 std::string mutationC(std::string Original){
   if (Original.length() <= 0)
     return Original;
-  int randomASCII = rand() % 128;
+  int randomASCII = Rng.below(128);
   char c = '\0' + randomASCII;
-  int randomIndex = rand() % Original.length();
+  int randomIndex = Rng.below(Original.length());
   Original[randomIndex] = c;
   return Original;
 }
@@ -235,7 +305,7 @@ std::string mutationG(std::string Original){
 std::string mutationH(std::string Original){
   if (Original.length() <= 1)
     return mutationC(Original);
-  int randomIndex = rand() % (Original.length()-1);
+  int randomIndex = Rng.below(Original.length()-1);
   char c = Original[randomIndex];
   Original[randomIndex] = Original[randomIndex+1];
   Original[randomIndex+1]=c; 
@@ -250,7 +320,7 @@ std::string mutationH(std::string Original){
 std::string mutationI(std::string Original){
   if (Original.length() <= 1)
     return mutationC(Original);
-  int randomIndex = rand() % (Original.length());
+  int randomIndex = Rng.below(Original.length());
   Original.erase(randomIndex,1);
   return Original;
 }
@@ -277,9 +347,9 @@ std::string mutationJ(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutationN(std::string Original){
-  int randomIndex  = rand() % 300+1;
+  int randomIndex  = Rng.below(300)+1;
  for(int i =0; i<randomIndex;i++){
-    int randomASCII = rand() % 128;
+    int randomASCII = Rng.below(128);
     char c = '\0' + randomASCII;
     Original.push_back(c);
  }
@@ -296,7 +366,7 @@ std::string mutation1(std::string Original){
   if (Original.length() <= 0)
     return Original;
  for(int i =0; i<Original.length();i++){
-    int randomASCII = rand() % 128;
+    int randomASCII = Rng.below(128);
     char c = '\0' + randomASCII;
     if(Original[i]!='\n')
     Original[i] = c;
@@ -310,9 +380,9 @@ std::string mutation1(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation2(std::string Original){
- int times = rand() % 5 +2;
+ int times = Rng.below(5) +2;
  for(int i =0; i<times; i++){
-  int randIndex = rand() % Original.length();
+  int randIndex = Rng.below(Original.length());
 
     Original=Original.substr(0,randIndex)+"\n"+Original.substr(randIndex, Original.length());
   
@@ -326,9 +396,9 @@ std::string mutation2(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation3(std::string Original){
-  int randomIndex  = rand() % Original.length();
+  int randomIndex  = Rng.below(Original.length());
  for(int i =0; i<randomIndex;i++){
-    int randomASCII = rand() % 128;
+    int randomASCII = Rng.below(128);
     char c = '\0' + randomASCII;
     Original[i]=c;
  }
@@ -341,9 +411,9 @@ std::string mutation3(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation4(std::string Original){
-  int randomIndex  = rand() % Original.length();
+  int randomIndex  = Rng.below(Original.length());
  for(int i =0; i<randomIndex;i++){
-    int randomASCII = rand() % 128;
+    int randomASCII = Rng.below(128);
     char c = '\0' + randomASCII;
     if(Original[i]!='\n' && Original[i]!='\0') Original[i]=c;
     
@@ -357,7 +427,7 @@ std::string mutation4(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation5(std::string Original){ 
-  int randomASCII = rand() % 128;
+  int randomASCII = Rng.below(128);
   char c = '\0' + randomASCII;
  for(int i =0; i<Original.length();i++){
    
@@ -374,7 +444,7 @@ std::string mutation5(std::string Original){
 */
 std::string mutation6(std::string Original){ 
   if(Original.length()>128) return Original;
-  int startIdx = rand() % 128;
+  int startIdx = Rng.below(128);
   for(int i=0; i<Original.length();i++){
     Original[i]='\0'+(i+startIdx)%128;
   }
@@ -387,7 +457,7 @@ std::string mutation6(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation7(std::string Original){ 
-  int randomASCII = rand() % 128;
+  int randomASCII = Rng.below(128);
   char c = '\0' + randomASCII;
  for(int i =0; i<Original.length();i++){
    Original[i]=c;}
@@ -401,12 +471,12 @@ std::string mutation7(std::string Original){
 */
 std::string mutation8(std::string Original){ 
   if(Original.length()<=1) return Original;
-  int randomASCII = rand() % 128;
+  int randomASCII = Rng.below(128);
   char c = '\0' + randomASCII;
-  int times = rand() % 5;
+  int times = Rng.below(5);
   while(times>=0){
-    int startIdx = rand() % Original.length();
-    int length = rand() % Original.length();
+    int startIdx = Rng.below(Original.length());
+    int length = Rng.below(Original.length());
     while(length<Original.length()){
       Original[length]=c;
       length++;
@@ -425,11 +495,11 @@ std::string mutation8(std::string Original){
 std::string mutation9(std::string Original){ 
   if(Original.length()<=1) return Original;
   
-  int times = rand() % Original.length();
+  int times = Rng.below(Original.length());
   while(times>=0){
-    int randomASCII = rand() % 128;
+    int randomASCII = Rng.below(128);
     char c = '\0' + randomASCII;
-    int idx = rand() % Original.length();
+    int idx = Rng.below(Original.length());
     Original[idx]=c;
     times--;
   }
@@ -452,7 +522,7 @@ std::string mutation10(std::string Original){
 * @return std::string mutated string.
 */
 std::string mutation11(std::string Original){ 
-  random_shuffle(Original.begin(),Original.end());
+  std::shuffle(Original.begin(), Original.end(), Rng);
   return Original+"\n";
 }
 
@@ -474,7 +544,7 @@ std::string mutation11(std::string Original){
 //   if (Original.length() <= 2)
 //     return mutationC(Original);
 //   int len = MutationFnsWithoutRepeat.size();
-//   int idx = rand() %len;
+//   int idx = Rng.below(len);
 //   Original=MutationFnsWithoutRepeat[idx](Original);
 //   Original=MutationFnsWithoutRepeat[idx](Original);
 //   return Original;
@@ -500,15 +570,15 @@ std::string mutation11(std::string Original){
  */
 std::vector<MutationFn *> MutationFns = {mutationA, mutationB,mutationC,mutationD,mutationE,mutationF,mutationG,mutationH,mutationI,mutationJ,mutation1,mutationN,mutation2,mutation3,mutation4,mutation5,mutation6,mutation7,mutation8,mutation9,mutation10,mutation11};
 MutationFn *selectMutationFn(RunInfo &Info) {
-  int Strat = rand() % MutationFns.size();
+  int Strat = Rng.below(MutationFns.size());
   //  if(MutationCounter==0){
-  //   int meantToBe = rand() % 2;
+  //   int meantToBe = Rng.below(2);
   //   if(meantToBe==1){return MutationFns[MutationFns.size()-1];}
   // }
   
   if(MutationState!=-1 && MutationIndex!=-1){
     while(MutationFns[Strat] == MutationFns[MutationState]){
-      Strat = rand() % MutationFns.size();
+      Strat = Rng.below(MutationFns.size());
     }
   }
   MutationIndex = Strat;
@@ -546,7 +616,15 @@ void feedBack(std::string &Target, RunInfo &Info) {
    */
   CoverageState.assign(RawCoverageData.begin(),
                        RawCoverageData.end()); // No extra processing
-  if(CoverageState.size()>PrevCoverageState.size()){
+  bool NewCoverage = CoverageState.size() > PrevCoverageState.size();
+  bool Alarmed = reachesAlarm(RawCoverageData);
+  // Did MutatedInput make it into a pool selectInput picks from?
+  bool Kept = NewCoverage || !Info.Passed;
+  if (Alarmed && (NewCoverage || AlarmInputs.empty())) {
+    AlarmInputs.push_back(Info.MutatedInput);
+    Kept = true;
+  }
+  if(NewCoverage){
     Candidates.push_back(Info.MutatedInput);
     if(CoverageState.size()>MaxCoverage){
       MaxCoverage=CoverageState.size();
@@ -562,7 +640,7 @@ void feedBack(std::string &Target, RunInfo &Info) {
   }
   else{
     if(Info.Passed){
-    int LetGodDecide = rand()%3;
+    int LetGodDecide = Rng.below(3);
     MutationCounter++;
     MutationState =MutationIndex;
     //SeedInputs.push_back(Info.MutatedInput);
@@ -574,16 +652,46 @@ void feedBack(std::string &Target, RunInfo &Info) {
     BestInputSoFar = Info.Input;
   }
 
+  // Share inputs that cover something new to this instance.
+  if (Sync && Info.Passed && Sync->observe(RawCoverageData))
+    Sync->publish(Info.MutatedInput, RawCoverageData);
+
+  // Directed mode: keep inputs that found new coverage or got closer to a
+  // division than anything before.
+  if (Scheduler) {
+    double Distance = -1;
+    readDistanceFile(Target, Distance);
+    bool Closer = Distance >= 0 && (Scheduler->minDistance() < 0 ||
+                                    Distance < Scheduler->minDistance());
+    if (NewCoverage || Closer) {
+      Scheduler->add(Info.MutatedInput, Distance, Alarmed);
+      Kept = true;
+    }
+  }
+
+  if (Kept)
+    Lineages.add(Info.MutatedInput, Info.From);
 }
 
 int Freq = 1;
 int Count = 0;
 int PassCount = 0;
 
-bool test(std::string &Target, std::string &Input, std::string &OutDir) {
+/**
+ * @brief Run Target on Input and store Input to OutDir.
+ *
+ * @param From how Input was produced, recorded for the stored input.
+ * @return true if Target did not crash.
+ */
+bool test(std::string &Target, std::string &Input, std::string &OutDir,
+          const Lineage &From) {
   // Clean up old coverage file before running
   std::string CoveragePath = Target + ".cov";
   std::remove(CoveragePath.c_str());
+  std::string DistancePath = Target + ".dist";
+  std::remove(DistancePath.c_str());
+  std::string CrashPath = Target + ".crash";
+  std::remove(CrashPath.c_str());
 
   ++Count;
   int ReturnCode = runTarget(Target, Input);
@@ -596,14 +704,55 @@ bool test(std::string &Target, std::string &Input, std::string &OutDir) {
           failureCount);
   if (ReturnCode == 0) {
     if (PassCount++ % Freq == 0)
-      storePassingInput(Input, OutDir);
+      Lineages.recordSaved(storePassingInput(Input, OutDir), From);
     return true;
   } else {
-    storeCrashingInput(Input, OutDir);
+    Lineages.recordSaved(storeCrashingInput(Input, OutDir), From);
+    if (Minimizer)
+      Minimizer->add(readCrashBucket(Target, ReturnCode), Input);
     return false;
   }
 }
 
+/**
+ * @brief Import the inputs other fuzzer instances found, keeping the ones
+ * that cover something new to this instance.
+ *
+ * @param Target Target (instrumented) program binary.
+ * @param OutDir Directory to store fuzzing results.
+ */
+void syncCorpus(std::string &Target, std::string &OutDir) {
+  std::vector<std::string> Imported;
+  std::map<std::string, double> Distances;
+  std::map<std::string, Lineage> Origins;
+  int Runs = Sync->pull(
+      [&](const std::string &Input, std::vector<std::string> &Coverage) {
+        std::string Copy = Input;
+        double Distance = -1;
+        // Imported inputs are roots of the lineage, keep a copy since the
+        // other instance's queue may be gone by the time we replay.
+        Lineage &From = Origins[Input];
+        From.Origin = storeImportedInput(Input, OutDir);
+        test(Target, Copy, OutDir, From);
+        readCoverageFile(Target, Coverage);
+        if (Scheduler && readDistanceFile(Target, Distance))
+          Distances[Input] = Distance;
+      },
+      Imported);
+
+  for (auto &Input : Imported) {
+    Lineages.add(Input, Origins[Input]);
+    Candidates.push_back(Input);
+    if (Scheduler) {
+      auto It = Distances.find(Input);
+      Scheduler->add(Input, It == Distances.end() ? -1 : It->second);
+    }
+  }
+  if (Runs > 0)
+    fprintf(stderr, "\nSynced %d inputs, kept %zu\n\n", Runs,
+            Imported.size());
+}
+
 /**
  * @brief Fuzz the Target program and store the results to OutDir
  *
@@ -612,22 +761,120 @@ bool test(std::string &Target, std::string &Input, std::string &OutDir) {
  */
 void fuzz(std::string Target, std::string OutDir) {
   struct RunInfo Info;
-  while (true) {
+  while (!Stopping) {
+    if (Sync && Sync->due())
+      syncCorpus(Target, OutDir);
     std::string Input = selectInput(Info);
     Info = RunInfo();
     Info.Input = Input;
     Info.Mutation = selectMutationFn(Info);
+    Info.From.Parent = Lineages.find(Info.Input);
+    Info.From.Op = MutationIndex;
+    Info.From.State = Rng.state();
     Info.MutatedInput = Info.Mutation(Info.Input);
-    Info.Passed = test(Target, Info.MutatedInput, OutDir);
+    Info.Passed = test(Target, Info.MutatedInput, OutDir, Info.From);
     feedBack(Target, Info);
   }
 }
 
+/**
+ * @brief Regenerate an input stored by a previous run from the lineage log
+ * in OutDir, printing how it was derived to stderr and the input itself to
+ * stdout.
+ *
+ * @param OutDir Output directory of the previous run.
+ * @param SavedPath Path of the stored input, e.g. OutDir/failure/input0.
+ * @return int exit status, 0 if the regenerated input matches the stored one.
+ */
+int replay(std::string &OutDir, std::string SavedPath) {
+  std::map<long, Lineage> Entries;
+  std::map<std::string, Lineage> Saved;
+  if (!LineageLog::load(OutDir + "/lineage.txt", Entries, Saved)) {
+    fprintf(stderr, "Cannot read %s/lineage.txt\n", OutDir.c_str());
+    return 1;
+  }
+  std::string Name = SavedPath;
+  if (Name.compare(0, OutDir.size() + 1, OutDir + "/") == 0)
+    Name = Name.substr(OutDir.size() + 1);
+  auto It = Saved.find(Name);
+  if (It == Saved.end()) {
+    fprintf(stderr, "No lineage recorded for %s\n", Name.c_str());
+    return 1;
+  }
+
+  // Walk up to the root, then apply the mutations top down.
+  std::vector<std::pair<long, Lineage>> Chain = {{-1, It->second}};
+  while (!Chain.back().second.isRoot()) {
+    long Parent = Chain.back().second.Parent;
+    auto Entry = Entries.find(Parent);
+    if (Entry == Entries.end()) {
+      fprintf(stderr, "Queue entry %ld is missing from the lineage\n", Parent);
+      return 1;
+    }
+    Chain.push_back(*Entry);
+  }
+
+  std::string Input;
+  for (auto Step = Chain.rbegin(); Step != Chain.rend(); ++Step) {
+    const Lineage &From = Step->second;
+    std::string Entry =
+        Step->first < 0 ? Name : "entry " + std::to_string(Step->first);
+    if (From.isRoot()) {
+      std::string Origin = From.Origin;
+      if (!Origin.empty() && Origin[0] != '/')
+        Origin = OutDir + "/" + Origin;
+      Input = Origin.empty() ? "" : readOneFile(Origin);
+      fprintf(stderr, "%s: read %s\n", Entry.c_str(),
+              From.Origin.empty() ? "(empty input)" : From.Origin.c_str());
+      continue;
+    }
+    if (From.Op < 0 || From.Op >= (int)MutationFns.size()) {
+      fprintf(stderr, "%s: unknown mutation %d\n", Entry.c_str(), From.Op);
+      return 1;
+    }
+    Rng.setState(From.State);
+    Input = MutationFns[From.Op](Input);
+    fprintf(stderr, "%s: mutation %d of entry %ld\n", Entry.c_str(), From.Op,
+            From.Parent);
+  }
+
+  fwrite(Input.data(), 1, Input.size(), stdout);
+  std::string Stored = readOneFile(SavedPath = OutDir + "/" + Name);
+  if (Stored != Input) {
+    fprintf(stderr, "Regenerated input differs from %s\n", SavedPath.c_str());
+    return 1;
+  }
+  return 0;
+}
+
 /**
  * Usage:
  * ./fuzzer [target] [seed input dir] [output dir] [frequency] [random seed]
+ * ./fuzzer --replay [output dir] [stored input]
+ *
+ * Environment:
+ *   FUZZ_DIRECTED  directed fuzzing towards divisions, the target must be
+ *                  instrumented with -directed.
+ *   FUZZ_TX        time to exploitation in seconds for FUZZ_DIRECTED.
+ *
+ *   FUZZ_SYNC_DIR  share the corpus with other instances through this
+ *                  (shared) directory.
+ *   FUZZ_SYNC_ID   name of this instance in FUZZ_SYNC_DIR, reuse it to
+ *                  resume a session (default: <hostname>-<pid>).
+ *   FUZZ_SYNC_INTERVAL  seconds between two imports.
+ *
+ *   FUZZ_MINIMIZE_BUDGET  runs of the target allowed to minimize the first
+ *                  crash of every bucket into
+ *                  [output dir]/failure/minimized/<bucket>, 0 to disable.
+ *
+ * If [target].alarms exists (DivZero -div-alarms), inputs reaching the
+ * flagged divisions are favored.
  */
 int main(int argc, char **argv) {
+  if (argc == 4 && std::string(argv[1]) == "--replay") {
+    ARG_EXIST_CHECK(OutDir, argv[2]);
+    return replay(OutDir, argv[3]);
+  }
   if (argc < 4) {
     printf("usage %s [target] [seed input dir] [output dir] [frequency "
            "(optional)] [seed (optional arg)]\n",
@@ -644,15 +891,77 @@ int main(int argc, char **argv) {
 
   int RandomSeed = argc > 5 ? strtol(argv[5], NULL, 10) : (int)time(NULL);
 
-  srand(RandomSeed);
+  Rng.seed(RandomSeed);
   storeSeed(OutDir, RandomSeed);
   initialize(OutDir);
 
-  if (readSeedInputs(SeedInputs, SeedInputDir)) {
+  std::vector<std::string> SeedPaths;
+  if (readSeedInputs(SeedInputs, SeedInputDir, &SeedPaths)) {
     fprintf(stderr, "Cannot read seed input directory\n");
     return 1;
   }
+  if (!Lineages.open(OutDir + "/lineage.txt")) {
+    fprintf(stderr, "Cannot write lineage to %s\n", OutDir.c_str());
+    return 1;
+  }
+  // The empty input is picked until something better shows up.
+  Lineages.add("", Lineage());
+  std::vector<Lineage> SeedLineages(SeedInputs.size());
+  for (size_t I = 0; I < SeedInputs.size(); ++I) {
+    char Resolved[PATH_MAX];
+    SeedLineages[I].Origin =
+        realpath(SeedPaths[I].c_str(), Resolved) ? Resolved : SeedPaths[I];
+    Lineages.add(SeedInputs[I], SeedLineages[I]);
+  }
+  if (const char *SyncDir = getenv("FUZZ_SYNC_DIR")) {
+    char Host[64] = "fuzzer";
+    gethostname(Host, sizeof(Host) - 1);
+    const char *SyncId = getenv("FUZZ_SYNC_ID");
+    const char *Interval = getenv("FUZZ_SYNC_INTERVAL");
+    Sync = new CorpusSync(
+        SyncDir,
+        SyncId ? SyncId : std::string(Host) + "-" + std::to_string(getpid()),
+        Interval ? atoi(Interval) : DEFAULT_SYNC_INTERVAL);
+    if (!Sync->init()) {
+      fprintf(stderr, "Cannot use sync directory %s\n", SyncDir);
+      return 1;
+    }
+  }
+  const char *MinimizeBudget = getenv("FUZZ_MINIMIZE_BUDGET");
+  uint64_t Budget = MinimizeBudget ? strtoull(MinimizeBudget, NULL, 10)
+                                   : DEFAULT_MINIMIZE_BUDGET;
+  if (Budget > 0) {
+    // A fork server that died must not kill the fuzzer.
+    signal(SIGPIPE, SIG_IGN);
+    Minimizer = new CrashMinimizer(Target, OutDir, Budget);
+    if (!Minimizer->start()) {
+      fprintf(stderr, "%s has no fork server, crashes are not minimized\n",
+              Target.c_str());
+      delete Minimizer;
+      Minimizer = nullptr;
+    }
+  }
+  if (readAlarmFile(Target, AlarmSites))
+    fprintf(stderr, "Loaded %zu division alarms\n", AlarmSites.size());
+  if (getenv("FUZZ_DIRECTED")) {
+    const char *TimeToExploit = getenv("FUZZ_TX");
+    Scheduler = new DirectedScheduler(
+        TimeToExploit ? strtod(TimeToExploit, NULL) : DEFAULT_TIME_TO_EXPLOIT);
+    // Run every seed once to learn its distance.
+    for (size_t I = 0; I < SeedInputs.size(); ++I) {
+      std::string &Seed = SeedInputs[I];
+      double Distance = -1;
+      std::vector<std::string> Coverage;
+      test(Target, Seed, OutDir, SeedLineages[I]);
+      readDistanceFile(Target, Distance);
+      readCoverageFile(Target, Coverage);
+      Scheduler->add(Seed, Distance, reachesAlarm(Coverage));
+    }
+  }
   fprintf(stderr, "Fuzzing %s...\n\n", Target.c_str());
+  signal(SIGTERM, requestStop);
+  signal(SIGINT, requestStop);
   fuzz(Target, OutDir);
+  Lineages.flush();
   return 0;
 }
\ No newline at end of file
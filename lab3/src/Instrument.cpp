@@ -1,4 +1,15 @@
 #include "Instrument.h"
+#include "Distance.h"
+#include "NonZero.h"
+
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
 
 using namespace llvm;
 
@@ -6,65 +17,389 @@ namespace instrument {
 
 static const char *SANITIZE_FUNCTION_NAME = "__sanitize__";
 static const char *COVERAGE_FUNCTION_NAME = "__coverage__";
+static const char *DISTANCE_FUNCTION_NAME = "__distance__";
+static const char *COVERAGE_MAP_FUNCTION_NAME = "__coverage_map__";
+static const char *INIT_DONE_FUNCTION_NAME = "__fuzz_init_done";
+static const char *DEFERRED_VARIABLE_NAME = "__fuzz_deferred_init";
 
-void instrumentCoverage(Module *M, Instruction &I, int Line, int Col) {
-  auto &Context = M->getContext();
-  Type *Int32Type = Type::getInt32Ty(Context);
+/* Library functions reading the input, see placeInitDone. */
+static const char *INPUT_FUNCTION_NAMES[] = {
+    "getchar", "getc", "fgetc", "_IO_getc", "fgets", "gets", "fread", "read",
+    "getline", "getdelim", "scanf", "fscanf", "__isoc99_scanf",
+    "__isoc99_fscanf"};
+
+static cl::opt<bool>
+    Directed("directed",
+             cl::desc("Report the distance to the nearest division at every "
+                      "basic block (directed fuzzing)"));
+
+static cl::opt<std::string>
+    SiteTable("site-table",
+              cl::desc("Path of the site table written in directed mode "
+                       "(default: <module>.sites)"),
+              cl::value_desc("filename"));
+
+static cl::opt<std::string> DivAlarms(
+    "div-alarms",
+    cl::desc("Division sites exported by the DivZero analysis: skip "
+             "__sanitize__ at NonZero divisions and, in directed mode, only "
+             "target the alarmed ones"),
+    cl::value_desc("filename"));
+
+static cl::opt<bool> ElideSanitize(
+    "elide-sanitize",
+    cl::desc("Skip __sanitize__ at divisions whose divisor is proven non-zero "
+             "within the function (default: true)"),
+    cl::init(true));
+
+static cl::opt<bool> CoverageMapMode(
+    "coverage-map",
+    cl::desc("Record coverage in a map with one byte per (line, col) "
+             "location of the module instead of calling __coverage__"));
 
-  auto *LineVal = llvm::ConstantInt::get(Int32Type, Line);
-  auto *ColVal = llvm::ConstantInt::get(Int32Type, Col);
-  std::vector<Value *> Args = {LineVal, ColVal};
+static cl::opt<bool> DeferInit(
+    "defer-init",
+    cl::desc("Start the fork server just before main first reads its input, "
+             "unless the program calls __fuzz_init_done itself"));
 
-  auto *Fun = M->getFunction(COVERAGE_FUNCTION_NAME);
-  CallInst::Create(Fun, Args, "", &I);
+/**
+ * @brief Get the default site table path for M: test1.ll -> test1.sites
+ */
+static std::string getSiteTablePath(Module &M) {
+  if (!SiteTable.empty())
+    return SiteTable;
+  std::string Path = M.getModuleIdentifier();
+  auto Dot = Path.find_last_of('.');
+  if (Dot != std::string::npos && Path.find('/', Dot) == std::string::npos)
+    Path = Path.substr(0, Dot);
+  return Path + ".sites";
 }
 
-void instrumentSanitize(Module *M, Instruction &I, int Line, int Col) {
-  LLVMContext &Context = M->getContext();
-  Type *Int32Type = Type::getInt32Ty(Context);
+/**
+ * @brief Does a call to F read the input? Unknown callees might.
+ *
+ * @param ReadsInput Defined functions known to read the input.
+ */
+static bool callReadsInput(const Function *F,
+                           const DenseSet<const Function *> &ReadsInput) {
+  if (!F)
+    return true;
+  if (!F->isDeclaration())
+    return ReadsInput.count(F);
+  for (const char *Name : INPUT_FUNCTION_NAMES) {
+    if (F->getName() == Name)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Call __fuzz_init_done in main before every call that may read the
+ * input, directly or through the functions it calls.
+ *
+ * @return false if main is not in M or never reads the input.
+ */
+static bool placeInitDone(Module &M) {
+  Function *Main = M.getFunction("main");
+  if (!Main || Main->isDeclaration())
+    return false;
 
-  auto *Divisor = I.getOperand(1);
-  auto *LineVal = llvm::ConstantInt::get(Int32Type, Line);
-  auto *ColVal = llvm::ConstantInt::get(Int32Type, Col);
-  std::vector<Value *> Args = {Divisor, LineVal, ColVal};
+  // Functions reading the input, up to a fixed point over the call graph.
+  DenseSet<const Function *> ReadsInput;
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (auto &F : M) {
+      if (F.isDeclaration() || ReadsInput.count(&F))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *Call = dyn_cast<CallInst>(&I);
+        if (Call && !isa<IntrinsicInst>(Call) &&
+            callReadsInput(Call->getCalledFunction(), ReadsInput)) {
+          ReadsInput.insert(&F);
+          Changed = true;
+          break;
+        }
+      }
+    }
+  }
+  if (!ReadsInput.count(Main))
+    return false;
 
-  auto *Fun = M->getFunction(SANITIZE_FUNCTION_NAME);
-  CallInst::Create(Fun, Args, "", &I);
+  M.getOrInsertFunction(INIT_DONE_FUNCTION_NAME,
+                        Type::getVoidTy(M.getContext()));
+  Function *InitDone = M.getFunction(INIT_DONE_FUNCTION_NAME);
+  std::vector<CallInst *> Reads;
+  for (auto &I : instructions(Main)) {
+    auto *Call = dyn_cast<CallInst>(&I);
+    if (Call && !isa<IntrinsicInst>(Call) &&
+        callReadsInput(Call->getCalledFunction(), ReadsInput))
+      Reads.push_back(Call);
+  }
+  for (auto *Call : Reads)
+    CallInst::Create(InitDone, "", Call);
+  return true;
 }
 
-bool Instrument::runOnFunction(Function &F) {
-  LLVMContext &Context = F.getContext();
-  Module *M = F.getParent();
+/**
+ * @brief Tell the runtime to wait for __fuzz_init_done before starting the
+ * fork server, if the program calls it (see ForkServer.h).
+ */
+static void deferForkServer(Module &M) {
+  Function *InitDone = M.getFunction(INIT_DONE_FUNCTION_NAME);
+  bool Called = InitDone && !InitDone->use_empty();
+  if (!Called && DeferInit)
+    Called = placeInitDone(M);
+  if (!Called || M.getNamedGlobal(DEFERRED_VARIABLE_NAME))
+    return;
+  Type *Int32Type = Type::getInt32Ty(M.getContext());
+  new GlobalVariable(M, Int32Type, true, GlobalValue::WeakAnyLinkage,
+                     ConstantInt::get(Int32Type, 1), DEFERRED_VARIABLE_NAME);
+}
+
+static uint64_t locationKey(unsigned Line, unsigned Col) {
+  return (uint64_t)Line << 32 | Col;
+}
+
+Instrumenter::Instrumenter(Module &M) : M(M), Builder(M.getContext()) {
+  Type *VoidType = Builder.getVoidTy();
+  Type *Int32Type = Builder.getInt32Ty();
+
+  M.getOrInsertFunction(COVERAGE_FUNCTION_NAME, VoidType, Int32Type,
+                        Int32Type);
+  M.getOrInsertFunction(SANITIZE_FUNCTION_NAME, VoidType, Int32Type, Int32Type,
+                        Int32Type);
+  CoverageHook = M.getFunction(COVERAGE_FUNCTION_NAME);
+  SanitizeHook = M.getFunction(SANITIZE_FUNCTION_NAME);
+
+  deferForkServer(M);
+  Selected.load(M);
+  if (!DivAlarms.empty() &&
+      !readDivAlarms(M, DivAlarms, SafeDivisions, AlarmedDivisions))
+    errs() << "Cannot read division alarms " << DivAlarms << "\n";
+  assignLocationIds();
+
+  if (!Directed)
+    return;
+  M.getOrInsertFunction(DISTANCE_FUNCTION_NAME, VoidType, Int32Type);
+  DistanceHook = M.getFunction(DISTANCE_FUNCTION_NAME);
+  computeDivDistances(M, BlockDistance,
+                      DivAlarms.empty() ? nullptr : &AlarmedDivisions);
+  writeSiteTable(M, BlockDistance, getSiteTablePath(M));
+}
+
+void Instrumenter::assignLocationIds() {
+  // Line and column of every id, and the source files of every location.
+  std::vector<uint32_t> Locations;
+  DenseMap<uint64_t, SmallVector<StringRef, 1>> Files;
+  for (auto &F : M) {
+    if (F.isDeclaration() || !Selected.shouldInstrument(F))
+      continue;
+    for (auto &BB : F) {
+      if (Selected.isHot(BB))
+        continue;
+      for (auto &I : BB) {
+        const DebugLoc &Loc = I.getDebugLoc();
+        if (isa<PHINode>(I) || !Loc)
+          continue;
+        uint64_t Key = locationKey(Loc.getLine(), Loc.getCol());
+        if (LocationIds.insert({Key, (unsigned)LocationIds.size()}).second) {
+          Locations.push_back(Loc.getLine());
+          Locations.push_back(Loc.getCol());
+        }
+        auto &Names = Files[Key];
+        StringRef File = Loc.get()->getFilename();
+        if (std::find(Names.begin(), Names.end(), File) == Names.end())
+          Names.push_back(File);
+      }
+    }
+  }
+  for (auto &Entry : Files) {
+    NumSites += Entry.second.size();
+    if (Entry.second.size() > 1)
+      NumSharedSites += Entry.second.size();
+  }
+
+  if (!CoverageMapMode || LocationIds.empty())
+    return;
+  LLVMContext &Context = M.getContext();
+  auto *MapType = ArrayType::get(Type::getInt8Ty(Context), LocationIds.size());
+  CoverageMap = new GlobalVariable(M, MapType, false,
+                                   GlobalValue::InternalLinkage,
+                                   ConstantAggregateZero::get(MapType),
+                                   "__coverage_map");
+  auto *LocationsInit = ConstantDataArray::get(Context, Locations);
+  auto *LocationsTable = new GlobalVariable(
+      M, LocationsInit->getType(), true, GlobalValue::PrivateLinkage,
+      LocationsInit, "__coverage_locations");
 
+  // Register the map with the runtime before main runs.
   Type *VoidType = Type::getVoidTy(Context);
   Type *Int32Type = Type::getInt32Ty(Context);
+  M.getOrInsertFunction(COVERAGE_MAP_FUNCTION_NAME, VoidType,
+                        Type::getInt8PtrTy(Context),
+                        Type::getInt32PtrTy(Context), Int32Type);
+  auto *Init = Function::Create(FunctionType::get(VoidType, false),
+                                GlobalValue::InternalLinkage, "coverage.init",
+                                &M);
+  IRBuilder<> InitBuilder(BasicBlock::Create(Context, "entry", Init));
+  Value *Args[] = {
+      InitBuilder.CreateConstInBoundsGEP2_32(MapType, CoverageMap, 0, 0),
+      InitBuilder.CreateConstInBoundsGEP2_32(LocationsInit->getType(),
+                                             LocationsTable, 0, 0),
+      InitBuilder.getInt32(LocationIds.size())};
+  InitBuilder.CreateCall(M.getFunction(COVERAGE_MAP_FUNCTION_NAME), Args);
+  InitBuilder.CreateRetVoid();
+  appendToGlobalCtors(M, Init, 0);
+}
 
-  M->getOrInsertFunction(COVERAGE_FUNCTION_NAME, VoidType, Int32Type,
-                         Int32Type);
-  M->getOrInsertFunction(SANITIZE_FUNCTION_NAME, VoidType, Int32Type, Int32Type,
-                         Int32Type);
+bool Instrumenter::instrumentFunction(Function &F) {
+  if (F.isDeclaration())
+    return false;
 
-  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
-    if (I->getOpcode() == Instruction::PHI) {
-      continue;
+  // Collect the instructions to instrument before adding any call.
+  bool Wanted = Selected.shouldInstrument(F);
+  HasDT = false;
+  Points.clear();
+  Distances.clear();
+  for (auto &BB : F) {
+    bool Coverage = Wanted && !Selected.isHot(BB);
+    if (DistanceHook && Coverage) {
+      auto It = BlockDistance.find(&BB);
+      if (It != BlockDistance.end())
+        Distances.push_back({&BB, It->second});
     }
-    const auto DebugLoc = I->getDebugLoc();
-    if (!DebugLoc) {
-      continue;
+    for (auto &I : BB) {
+      if (I.getOpcode() == Instruction::PHI)
+        continue;
+      const DebugLoc &Loc = I.getDebugLoc();
+      if (!Loc)
+        continue;
+      bool Sanitize = isDivision(I) && needsSanitize(I, F);
+      if (Sanitize || Coverage)
+        Points.push_back({&I, (int)Loc.getLine(), (int)Loc.getCol(), Sanitize,
+                          Coverage});
+    }
+  }
+
+  // The calls carry no debug location, like CallInst::Create.
+  for (auto &D : Distances) {
+    Builder.SetInsertPoint(&*D.first->getFirstInsertionPt());
+    Builder.SetCurrentDebugLocation(DebugLoc());
+    Value *Args[] = {Builder.getInt32(D.second)};
+    Builder.CreateCall(DistanceHook, Args);
+  }
+
+  for (auto &P : Points) {
+    Builder.SetInsertPoint(P.Inst);
+    Builder.SetCurrentDebugLocation(DebugLoc());
+    Value *Line = Builder.getInt32(P.Line);
+    Value *Col = Builder.getInt32(P.Col);
+    if (P.Sanitize) {
+      Value *Args[] = {P.Inst->getOperand(1), Line, Col};
+      Builder.CreateCall(SanitizeHook, Args);
     }
-    int Line = DebugLoc.getLine();
-    int Col = DebugLoc.getCol();
-    if (I->getOpcode() == Instruction::SDiv ||
-        I->getOpcode() == Instruction::UDiv) {
-      instrumentSanitize(M, *I, Line, Col);
+    if (P.Coverage && CoverageMap) {
+      unsigned Id = LocationIds.lookup(locationKey(P.Line, P.Col));
+      Builder.CreateStore(Builder.getInt8(1),
+                          Builder.CreateConstInBoundsGEP2_32(
+                              CoverageMap->getValueType(), CoverageMap, 0, Id));
+    } else if (P.Coverage) {
+      Value *Args[] = {Line, Col};
+      Builder.CreateCall(CoverageHook, Args);
     }
-    instrumentCoverage(M, *I, Line, Col);
   }
   return true;
 }
 
+bool Instrumenter::needsSanitize(const Instruction &Div, Function &F) {
+  ++NumDivisions;
+  if (SafeDivisions.count(&Div)) {
+    ++NumElided;
+    return false;
+  }
+  if (!ElideSanitize)
+    return true;
+  if (!HasDT) {
+    DT.recalculate(F);
+    HasDT = true;
+  }
+  if (!isNonZeroDivision(Div, DT))
+    return true;
+  ++NumElided;
+  return false;
+}
+
+void Instrumenter::report() const {
+  if (NumDivisions)
+    errs() << "Elided " << NumElided << " of " << NumDivisions
+           << " __sanitize__ checks\n";
+  if (!NumSites)
+    return;
+  errs() << "Coverage: " << LocationIds.size() << " ids for " << NumSites
+         << " sites, " << NumSharedSites
+         << " sites share their id with another file ("
+         << format("%.1f", 100.0 * NumSharedSites / NumSites) << "%)";
+  if (CoverageMap)
+    errs() << ", map of " << LocationIds.size() << " bytes";
+  errs() << "\n";
+}
+
+bool Instrumenter::instrumentModule() {
+  bool Changed = false;
+  for (auto &F : M)
+    Changed |= instrumentFunction(F);
+  return Changed;
+}
+
+bool Instrument::doInitialization(Module &M) {
+  Impl.reset(new Instrumenter(M));
+  return true;
+}
+
+bool Instrument::runOnFunction(Function &F) {
+  return Impl->instrumentFunction(F);
+}
+
+bool Instrument::doFinalization(Module &M) {
+  Impl->report();
+  Impl.reset();
+  return false;
+}
+
+bool InstrumentModule::runOnModule(Module &M) {
+  Instrumenter Impl(M);
+  bool Changed = Impl.instrumentModule();
+  Impl.report();
+  return Changed;
+}
+
+PreservedAnalyses InstrumentPass::run(Module &M, ModuleAnalysisManager &MAM) {
+  Instrumenter Impl(M);
+  bool Changed = Impl.instrumentModule();
+  Impl.report();
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
 char Instrument::ID = 1;
 static RegisterPass<Instrument>
     X("Instrument", "Instrumentations for Dynamic Analysis", false, false);
 
+char InstrumentModule::ID = 2;
+static RegisterPass<InstrumentModule>
+    Y("InstrumentModule", "Instrumentations for Dynamic Analysis (module pass)",
+      false, false);
+
 } // namespace instrument
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "Instrument", "v0.1", [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "instrument")
+                    return false;
+                  MPM.addPass(instrument::InstrumentPass());
+                  return true;
+                });
+          }};
+}
@@ -0,0 +1,93 @@
+#include "Lineage.h"
+
+#include <sstream>
+
+bool LineageLog::open(const std::string &Path) {
+  Log.open(Path, std::ios::out | std::ios::trunc);
+  Log << "# entry <id> root <path>\n"
+      << "# entry <id> mutant <parent> <op> <s0> <s1> <s2> <s3>\n"
+      << "# saved <path> root <path>\n"
+      << "# saved <path> mutant <parent> <op> <s0> <s1> <s2> <s3>\n";
+  return (bool)Log;
+}
+
+void LineageLog::write(const Lineage &From) {
+  if (From.isRoot()) {
+    Log << "root " << From.Origin << "\n";
+    return;
+  }
+  Log << "mutant " << From.Parent << " " << From.Op;
+  for (auto Word : From.State)
+    Log << " " << Word;
+  Log << "\n";
+}
+
+long LineageLog::add(const std::string &Input, const Lineage &From) {
+  auto It = Ids.find(Input);
+  if (It != Ids.end())
+    return It->second;
+  long Id = Ids.size();
+  Ids[Input] = Id;
+  Log << "entry " << Id << " ";
+  write(From);
+  return Id;
+}
+
+long LineageLog::find(const std::string &Input) const {
+  auto It = Ids.find(Input);
+  return It == Ids.end() ? -1 : It->second;
+}
+
+void LineageLog::recordSaved(const std::string &Path, const Lineage &From) {
+  Log << "saved " << Path << " ";
+  write(From);
+  // Saved inputs are what a crash report points to, keep the log close to
+  // the output directory even if the fuzzer gets killed, without a write
+  // per input.
+  if (time(NULL) != LastFlush)
+    flush();
+}
+
+void LineageLog::flush() {
+  Log.flush();
+  LastFlush = time(NULL);
+}
+
+static bool parse(std::istringstream &Fields, Lineage &From) {
+  std::string Type;
+  if (!(Fields >> Type))
+    return false;
+  if (Type == "root") {
+    // An empty origin is the empty input.
+    std::getline(Fields >> std::ws, From.Origin);
+    return true;
+  }
+  if (Type != "mutant" || !(Fields >> From.Parent >> From.Op))
+    return false;
+  for (auto &Word : From.State) {
+    if (!(Fields >> Word))
+      return false;
+  }
+  return true;
+}
+
+bool LineageLog::load(const std::string &Path,
+                      std::map<long, Lineage> &Entries,
+                      std::map<std::string, Lineage> &Saved) {
+  std::ifstream In(Path);
+  if (!In)
+    return false;
+  std::string Line;
+  while (std::getline(In, Line)) {
+    std::istringstream Fields(Line);
+    std::string Kind, Name;
+    Lineage From;
+    if (!(Fields >> Kind >> Name) || !parse(Fields, From))
+      continue;
+    if (Kind == "entry")
+      Entries[std::stol(Name)] = From;
+    else if (Kind == "saved")
+      Saved[Name] = From;
+  }
+  return true;
+}
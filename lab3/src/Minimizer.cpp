@@ -0,0 +1,91 @@
+/**
+ * minimizer: delta debugging of a crashing input, with the same result as
+ * lab4's delta-debugger but on fork servers and all cores (see Delta.h).
+ *
+ * Usage:
+ *   minimizer [-j jobs] [-t timeout-ms] target crashing-input
+ *
+ * The target must be linked with this lab's runtime. The minimized input,
+ * which crashes at the same place as the original one, is written to
+ * <crashing-input>.delta.
+ */
+
+#include "Delta.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const int DEFAULT_TIMEOUT_MS = 1000;
+
+void usage(const char *Argv0) {
+  fprintf(stderr,
+          "usage: %s [-j jobs] [-t timeout-ms] target crashing-input\n",
+          Argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned Jobs = std::max(1u, std::thread::hardware_concurrency());
+  int TimeoutMs = DEFAULT_TIMEOUT_MS;
+  int Opt;
+  while ((Opt = getopt(argc, argv, "j:t:")) != -1) {
+    if (Opt == 'j') {
+      Jobs = std::max(1, atoi(optarg));
+    } else if (Opt == 't') {
+      TimeoutMs = atoi(optarg);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string Target = argv[optind], InputPath = argv[optind + 1];
+  if (access(Target.c_str(), X_OK)) {
+    fprintf(stderr, "%s not found\n", Target.c_str());
+    return 1;
+  }
+  if (access(InputPath.c_str(), R_OK)) {
+    fprintf(stderr, "%s not found\n", InputPath.c_str());
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  DeltaDebugger Delta(Target, Jobs, TimeoutMs);
+  if (!Delta.start()) {
+    fprintf(stderr, "%s did not start a fork server, is it linked with the "
+                    "lab3 runtime?\n",
+            Target.c_str());
+    return 1;
+  }
+  std::string Input = readOneFile(InputPath);
+  std::string Bucket = Delta.bucket(Input);
+  if (Bucket.empty()) {
+    fprintf(stderr, "Sanity check failed: the program does not crash with "
+                    "the initial input\n");
+    return 1;
+  }
+  // The minimized input must still hit the same bug.
+  Delta.setBucket(Bucket);
+
+  std::string Result = Delta.minimize(Input);
+  printf("Original Input Size: %zu\nMinimized Input Size: %zu\n",
+         Input.size(), Result.size());
+  fprintf(stderr, "%llu executions\n",
+          (unsigned long long)Delta.executions());
+  std::ofstream Out(InputPath + ".delta", std::ios::binary);
+  Out << Result;
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "NonZero.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * @brief The local V is a load of, if any: an alloca only used as the
+ * address of loads and stores.
+ */
+static const AllocaInst *getLocal(const Value *V) {
+  auto *Load = dyn_cast<LoadInst>(V);
+  if (!Load)
+    return nullptr;
+  auto *Alloca = dyn_cast<AllocaInst>(Load->getPointerOperand());
+  if (!Alloca)
+    return nullptr;
+  for (auto *User : Alloca->users()) {
+    if (isa<LoadInst>(User))
+      continue;
+    auto *Store = dyn_cast<StoreInst>(User);
+    if (!Store || Store->getValueOperand() == Alloca)
+      return nullptr;
+  }
+  return Alloca;
+}
+
+static bool isStoreTo(const Instruction &Inst, const AllocaInst *Local) {
+  auto *Store = dyn_cast<StoreInst>(&Inst);
+  return Store && Store->getPointerOperand() == Local;
+}
+
+/**
+ * @brief Can a store to Local run after From and before To? From must
+ * dominate To, so that walking back from To always ends at From.
+ */
+static bool storedBetween(const AllocaInst *Local, const Instruction *From,
+                          const Instruction *To) {
+  const BasicBlock *FromBB = From->getParent();
+  const BasicBlock *ToBB = To->getParent();
+  if (FromBB == ToBB) {
+    for (auto It = ++From->getIterator(); It != FromBB->end(); ++It) {
+      if (&*It == To)
+        return false;
+      if (isStoreTo(*It, Local))
+        return true;
+    }
+  }
+  // To comes first in its block, or in another block.
+  for (auto It = ToBB->begin(); &*It != To; ++It) {
+    if (isStoreTo(*It, Local))
+      return true;
+  }
+
+  SmallPtrSet<const BasicBlock *, 16> Visited;
+  SmallVector<const BasicBlock *, 16> Worklist(pred_begin(ToBB),
+                                               pred_end(ToBB));
+  while (!Worklist.empty()) {
+    const BasicBlock *BB = Worklist.pop_back_val();
+    if (!Visited.insert(BB).second)
+      continue;
+    auto It = BB == FromBB ? ++From->getIterator() : BB->begin();
+    for (; It != BB->end(); ++It) {
+      if (isStoreTo(*It, Local))
+        return true;
+    }
+    if (BB != FromBB)
+      Worklist.append(pred_begin(BB), pred_end(BB));
+  }
+  return false;
+}
+
+/**
+ * @brief Is V the same value as Other? Loads of a local are the same if
+ * Other dominates V and nothing stores to the local in between.
+ */
+static bool sameValue(const Value *V, const Value *Other,
+                      const DominatorTree &DT) {
+  if (V == Other)
+    return true;
+  const AllocaInst *Local = getLocal(V);
+  if (!Local || getLocal(Other) != Local)
+    return false;
+  auto *OtherLoad = cast<Instruction>(Other);
+  auto *Load = cast<Instruction>(V);
+  return DT.dominates(OtherLoad, Load) &&
+         !storedBetween(Local, OtherLoad, Load);
+}
+
+/**
+ * @brief Is V, used by Div, compared by a dominating branch whose edge to
+ * Div excludes zero?
+ */
+static bool checkedNonZero(const Value *V, const Instruction &Div,
+                           const DominatorTree &DT) {
+  auto *Node = DT.getNode(Div.getParent());
+  for (; Node && Node->getIDom(); Node = Node->getIDom()) {
+    const BasicBlock *BB = Node->getIDom()->getBlock();
+    auto *Branch = dyn_cast<BranchInst>(BB->getTerminator());
+    if (!Branch || !Branch->isConditional())
+      continue;
+    auto *Cmp = dyn_cast<ICmpInst>(Branch->getCondition());
+    if (!Cmp)
+      continue;
+    ICmpInst::Predicate Pred = Cmp->getPredicate();
+    const Value *Checked = Cmp->getOperand(0);
+    auto *Bound = dyn_cast<ConstantInt>(Cmp->getOperand(1));
+    if (!Bound) {
+      Checked = Cmp->getOperand(1);
+      Bound = dyn_cast<ConstantInt>(Cmp->getOperand(0));
+      Pred = ICmpInst::getSwappedPredicate(Pred);
+    }
+    if (!Bound || Bound->getType() != V->getType())
+      continue;
+
+    for (unsigned Taken = 0; Taken < 2; ++Taken) {
+      const BasicBlock *Succ = Branch->getSuccessor(Taken);
+      if (Succ == Branch->getSuccessor(1 - Taken) ||
+          !DT.dominates(BasicBlockEdge(BB, Succ), Div.getParent()))
+        continue;
+      // Successor 0 is taken when the comparison holds.
+      ConstantRange Region =
+          ConstantRange::makeExactICmpRegion(Pred, Bound->getValue());
+      if (Taken)
+        Region = Region.inverse();
+      if (!Region.contains(APInt(Bound->getBitWidth(), 0)) &&
+          sameValue(V, Checked, DT))
+        return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief The last store to Local before Use on every path to Use among the
+ * instructions dominating it, if any.
+ */
+static const StoreInst *dominatingStore(const AllocaInst *Local,
+                                        const Instruction *Use,
+                                        const DominatorTree &DT) {
+  for (auto *Node = DT.getNode(Use->getParent()); Node;
+       Node = Node->getIDom()) {
+    const BasicBlock *BB = Node->getBlock();
+    auto It = BB == Use->getParent() ? Use->getIterator() : BB->end();
+    while (It != BB->begin()) {
+      --It;
+      if (isStoreTo(*It, Local))
+        return cast<StoreInst>(&*It);
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Is V a load of a local that holds a non-zero value: either every
+ * store to the local is non-zero, or the last dominating store is and no
+ * other store can run before V?
+ */
+static bool storedNonZero(const Value *V, const DominatorTree &DT,
+                          const DataLayout &DL) {
+  const AllocaInst *Local = getLocal(V);
+  if (!Local)
+    return false;
+  auto *Load = cast<Instruction>(V);
+  const StoreInst *Last = dominatingStore(Local, Load, DT);
+  if (!Last)
+    return false;
+  if (isKnownNonZero(Last->getValueOperand(), DL) &&
+      !storedBetween(Local, Last, Load))
+    return true;
+  for (auto *User : Local->users()) {
+    auto *Store = dyn_cast<StoreInst>(User);
+    if (Store && !isKnownNonZero(Store->getValueOperand(), DL))
+      return false;
+  }
+  return true;
+}
+
+bool isNonZeroDivision(const Instruction &Div, const DominatorTree &DT) {
+  const Value *Divisor = Div.getOperand(1);
+  const DataLayout &DL = Div.getModule()->getDataLayout();
+  return isKnownNonZero(Divisor, DL) || storedNonZero(Divisor, DT, DL) ||
+         checkedNonZero(Divisor, Div, DT);
+}
+
+} // namespace instrument
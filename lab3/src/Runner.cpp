@@ -0,0 +1,170 @@
+#include "Runner.h"
+#include "ForkServer.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+const int HELLO_TIMEOUT_MS = 10000;
+
+bool writeAll(int Fd, const void *Buf, size_t Len) {
+  auto *Ptr = static_cast<const char *>(Buf);
+  while (Len > 0) {
+    ssize_t Ret = write(Fd, Ptr, Len);
+    if (Ret < 0 && errno == EINTR)
+      continue;
+    if (Ret <= 0)
+      return false;
+    Ptr += Ret;
+    Len -= Ret;
+  }
+  return true;
+}
+
+/**
+ * Read exactly 4 bytes from Fd, waiting at most TimeoutMs (forever if
+ * negative).
+ *
+ * @return 1 on success, 0 on timeout, -1 if the pipe broke.
+ */
+int readInt(int Fd, int &Value, int TimeoutMs) {
+  struct pollfd P = {Fd, POLLIN, 0};
+  int Ret;
+  do {
+    Ret = poll(&P, 1, TimeoutMs);
+  } while (Ret < 0 && errno == EINTR);
+  if (Ret == 0)
+    return 0;
+  ssize_t Len;
+  do {
+    Len = read(Fd, &Value, sizeof(Value));
+  } while (Len < 0 && errno == EINTR);
+  return Len == sizeof(Value) ? 1 : -1;
+}
+
+/**
+ * Anonymous temporary file, inherited by the target as stdin or as the
+ * crash record fd.
+ */
+int makeTempFile() {
+  char Path[] = "/tmp/fuzz-input.XXXXXX";
+  int Fd = mkostemp(Path, O_CLOEXEC);
+  if (Fd != -1)
+    unlink(Path);
+  return Fd;
+}
+
+} // namespace
+
+ForkServer::ForkServer(const std::string &Target) : Target(Target) {
+  // The environment is built up front: only async-signal-safe calls are
+  // allowed between fork and exec when other threads are running.
+  for (char **E = environ; *E; ++E)
+    EnvStrings.push_back(*E);
+  EnvStrings.push_back(std::string(FUZZ_FORKSRV_ENV) + "=1");
+  for (auto &E : EnvStrings)
+    Env.push_back(const_cast<char *>(E.c_str()));
+  Env.push_back(nullptr);
+}
+
+ForkServer::~ForkServer() {
+  stop();
+  if (InputFd != -1)
+    close(InputFd);
+  if (CrashFd != -1)
+    close(CrashFd);
+}
+
+bool ForkServer::start() {
+  // The stdin of the target, and where its children record their crash.
+  if (InputFd == -1)
+    InputFd = makeTempFile();
+  if (CrashFd == -1)
+    CrashFd = makeTempFile();
+  int Ctl[2], Status[2];
+  if (InputFd == -1 || CrashFd == -1 || pipe2(Ctl, O_CLOEXEC))
+    return false;
+  if (pipe2(Status, O_CLOEXEC)) {
+    close(Ctl[0]);
+    close(Ctl[1]);
+    return false;
+  }
+
+  Pid = fork();
+  if (Pid == 0) {
+    int Null = open("/dev/null", O_RDWR);
+    dup2(InputFd, 0);
+    dup2(Null, 1);
+    dup2(Null, 2);
+    dup2(CrashFd, FUZZ_CRASH_FD);
+    dup2(Ctl[0], FUZZ_FORKSRV_FD);
+    dup2(Status[1], FUZZ_FORKSRV_FD + 1);
+    char *Argv[] = {const_cast<char *>(Target.c_str()), nullptr};
+    execve(Target.c_str(), Argv, Env.data());
+    _exit(127);
+  }
+  close(Ctl[0]);
+  close(Status[1]);
+  CtlFd = Ctl[1];
+  StatusFd = Status[0];
+  if (Pid < 0) {
+    stop();
+    return false;
+  }
+
+  int Hello;
+  if (readInt(StatusFd, Hello, HELLO_TIMEOUT_MS) != 1 ||
+      Hello != FUZZ_FORKSRV_HELLO) {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void ForkServer::stop() {
+  if (CtlFd != -1)
+    close(CtlFd);
+  if (StatusFd != -1)
+    close(StatusFd);
+  CtlFd = StatusFd = -1;
+  if (Pid > 0) {
+    kill(Pid, SIGKILL);
+    waitpid(Pid, nullptr, 0);
+  }
+  Pid = -1;
+}
+
+bool ForkServer::run(const std::string &Input, int TimeoutMs, int &WaitStatus,
+                     std::string &Crash) {
+  if (ftruncate(InputFd, 0) ||
+      pwrite(InputFd, Input.data(), Input.size(), 0) != (ssize_t)Input.size())
+    return false;
+  lseek(InputFd, 0, SEEK_SET);
+  if (ftruncate(CrashFd, 0))
+    return false;
+  lseek(CrashFd, 0, SEEK_SET);
+
+  int Cmd = 0, Child;
+  if (!writeAll(CtlFd, &Cmd, sizeof(Cmd)) ||
+      readInt(StatusFd, Child, -1) != 1)
+    return false;
+  int Ret = readInt(StatusFd, WaitStatus, TimeoutMs);
+  if (Ret == 0) {
+    kill(Child, SIGKILL);
+    Ret = readInt(StatusFd, WaitStatus, -1);
+  }
+  if (Ret != 1)
+    return false;
+  // A crash record is one short line.
+  char Buf[64];
+  ssize_t Len = pread(CrashFd, Buf, sizeof(Buf), 0);
+  Crash.assign(Buf, Len > 0 ? Len : 0);
+  return true;
+}
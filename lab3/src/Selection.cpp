@@ -0,0 +1,145 @@
+#include "Selection.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+using namespace llvm;
+
+namespace instrument {
+
+static cl::opt<std::string> AllowList(
+    "instrument-allowlist",
+    cl::desc("Only instrument the functions matching a glob pattern of this "
+             "file (src:<glob> matches source files)"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string> DenyList(
+    "instrument-denylist",
+    cl::desc("Do not instrument the functions matching a glob pattern of "
+             "this file (src:<glob> matches source files)"),
+    cl::value_desc("filename"));
+
+static cl::list<std::string> Profiles(
+    "instrument-profile",
+    cl::desc("Coverage file of a run instrumented by lab2's "
+             "DynamicAnalysisPass, skip the blocks hotter than "
+             "-instrument-hot-threshold (can be repeated)"),
+    cl::value_desc("filename"));
+
+static cl::opt<unsigned> HotThreshold(
+    "instrument-hot-threshold",
+    cl::desc("Executions per profiled run above which a block is not "
+             "instrumented"),
+    cl::init(1000));
+
+static uint64_t locationKey(unsigned Line, unsigned Col) {
+  return (uint64_t)Line << 32 | Col;
+}
+
+bool Selection::PatternList::match(const Function &F) const {
+  for (auto &Pattern : Functions) {
+    if (Pattern.match(F.getName()))
+      return true;
+  }
+  if (Sources.empty())
+    return false;
+  const DISubprogram *SP = F.getSubprogram();
+  if (!SP)
+    return false;
+  for (auto &Pattern : Sources) {
+    if (Pattern.match(SP->getFilename()))
+      return true;
+  }
+  return false;
+}
+
+bool Selection::readPatterns(const std::string &Path, PatternList &List) {
+  std::ifstream In(Path);
+  if (!In)
+    return false;
+  std::string Line;
+  while (std::getline(In, Line)) {
+    StringRef Text = StringRef(Line).trim();
+    if (Text.empty() || Text.startswith("#"))
+      continue;
+    bool Source = Text.consume_front("src:");
+    auto Pattern = GlobPattern::create(Saver.save(Text));
+    if (!Pattern) {
+      errs() << Path << ": " << toString(Pattern.takeError()) << "\n";
+      continue;
+    }
+    (Source ? List.Sources : List.Functions).push_back(std::move(*Pattern));
+  }
+  return true;
+}
+
+bool Selection::readProfile(const std::string &Path) {
+  std::ifstream In(Path);
+  if (!In)
+    return false;
+  std::string Line;
+  while (std::getline(In, Line)) {
+    unsigned SrcLine, SrcCol;
+    if (sscanf(Line.c_str(), "%u, %u", &SrcLine, &SrcCol) == 2)
+      ++Counts[locationKey(SrcLine, SrcCol)];
+  }
+  ++Runs;
+  return true;
+}
+
+void Selection::load(const Module &M) {
+  Allow = PatternList();
+  Deny = PatternList();
+  Counts.clear();
+  Sharing.clear();
+  Runs = 0;
+  if (!AllowList.empty() && !readPatterns(AllowList, Allow))
+    errs() << "Cannot read allowlist " << AllowList << "\n";
+  if (!DenyList.empty() && !readPatterns(DenyList, Deny))
+    errs() << "Cannot read denylist " << DenyList << "\n";
+  for (auto &Path : Profiles) {
+    if (!readProfile(Path))
+      errs() << "Cannot read profile " << Path << "\n";
+  }
+  if (Runs == 0)
+    return;
+  // lab2 logs every instruction with a location, so a location logs once
+  // per execution of each of its instructions.
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &Inst : BB) {
+        if (const DebugLoc &Loc = Inst.getDebugLoc())
+          ++Sharing[locationKey(Loc.getLine(), Loc.getCol())];
+      }
+    }
+  }
+}
+
+bool Selection::shouldInstrument(const Function &F) const {
+  if (!AllowList.empty() && !Allow.match(F))
+    return false;
+  return !Deny.match(F);
+}
+
+bool Selection::isHot(const BasicBlock &BB) const {
+  if (Runs == 0)
+    return false;
+  // Every location of BB ran at least as often as BB, counting each
+  // execution of the location once however many instructions share it.
+  uint64_t Min = UINT64_MAX;
+  for (auto &Inst : BB) {
+    const DebugLoc &Loc = Inst.getDebugLoc();
+    if (!Loc || Loc.getLine() == 0)
+      continue;
+    uint64_t Key = locationKey(Loc.getLine(), Loc.getCol());
+    Min = std::min(Min, Counts.lookup(Key) / std::max(1u, Sharing.lookup(Key)));
+  }
+  return Min != UINT64_MAX && Min > (uint64_t)HotThreshold * Runs;
+}
+
+} // namespace instrument
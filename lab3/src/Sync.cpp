@@ -0,0 +1,173 @@
+#include "Sync.h"
+#include "Utils.h"
+
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+
+/**
+ * @brief FNV-1a hash of the set of covered locations of a run, used to
+ * recognize entries with a known coverage without running them.
+ */
+static unsigned long long signature(const std::vector<std::string> &Coverage) {
+  std::set<std::string> Unique(Coverage.begin(), Coverage.end());
+  unsigned long long Hash = 14695981039346656037ULL;
+  for (auto &Site : Unique) {
+    for (unsigned char C : Site) {
+      Hash ^= C;
+      Hash *= 1099511628211ULL;
+    }
+    Hash ^= '\n';
+    Hash *= 1099511628211ULL;
+  }
+  return Hash;
+}
+
+static bool exists(const std::string &Path) {
+  struct stat Buffer;
+  return stat(Path.c_str(), &Buffer) == 0;
+}
+
+static bool readSignature(const std::string &MetaPath,
+                          unsigned long long &Signature) {
+  std::ifstream Meta(MetaPath);
+  std::string Key;
+  while (Meta >> Key) {
+    if (Key == "signature")
+      return (bool)(Meta >> std::hex >> Signature);
+    std::getline(Meta, Key);
+  }
+  return false;
+}
+
+CorpusSync::CorpusSync(const std::string &SyncDir, const std::string &Id,
+                       int Interval)
+    : SyncDir(SyncDir), Id(Id), Interval(Interval), LastSync(0) {}
+
+std::string CorpusSync::queueDir(const std::string &Instance) const {
+  return SyncDir + "/" + Instance + "/queue";
+}
+
+std::string CorpusSync::entryPath(const std::string &Instance,
+                                  unsigned N) const {
+  char Name[32];
+  snprintf(Name, sizeof(Name), "/id:%06u", N);
+  return queueDir(Instance) + Name;
+}
+
+bool CorpusSync::init() {
+  mkdir(SyncDir.c_str(), 0755);
+  mkdir((SyncDir + "/" + Id).c_str(), 0755);
+  mkdir(queueDir(Id).c_str(), 0755);
+  mkdir((SyncDir + "/" + Id + "/.synced").c_str(), 0755);
+  if (!exists(queueDir(Id)))
+    return false;
+
+  // Resume publishing after the entries of a previous session.
+  unsigned long long Signature;
+  while (exists(entryPath(Id, NextEntry))) {
+    if (readSignature(entryPath(Id, NextEntry) + ".meta", Signature))
+      Signatures.insert(Signature);
+    ++NextEntry;
+  }
+
+  std::string CursorDir = SyncDir + "/" + Id + "/.synced";
+  DIR *Directory = opendir(CursorDir.c_str());
+  if (Directory == NULL)
+    return false;
+  while (struct dirent *Ent = readdir(Directory)) {
+    if (Ent->d_name[0] == '.')
+      continue;
+    std::ifstream Cursor(CursorDir + "/" + Ent->d_name);
+    unsigned N;
+    if (Cursor >> N)
+      Cursors[Ent->d_name] = N;
+  }
+  closedir(Directory);
+  return true;
+}
+
+bool CorpusSync::observe(const std::vector<std::string> &Coverage) {
+  bool New = false;
+  for (auto &Site : Coverage)
+    New |= Covered.insert(Site).second;
+  return New;
+}
+
+void CorpusSync::publish(const std::string &Input,
+                         const std::vector<std::string> &Coverage) {
+  std::string Path = entryPath(Id, NextEntry);
+  std::string Tmp = queueDir(Id) + "/.tmp";
+  unsigned long long Signature = signature(Coverage);
+
+  std::ofstream Meta(Tmp);
+  Meta << "signature " << std::hex << Signature << std::dec << "\n"
+       << "coverage " << Coverage.size() << "\n"
+       << "time " << time(NULL) << "\n";
+  Meta.close();
+  std::rename(Tmp.c_str(), (Path + ".meta").c_str());
+
+  std::ofstream Entry(Tmp, std::ios::binary);
+  Entry << Input;
+  Entry.close();
+  std::rename(Tmp.c_str(), Path.c_str());
+
+  Signatures.insert(Signature);
+  ++NextEntry;
+}
+
+bool CorpusSync::due() const {
+  return difftime(time(NULL), LastSync) >= Interval;
+}
+
+void CorpusSync::saveCursor(const std::string &Instance, unsigned N) {
+  std::string CursorDir = SyncDir + "/" + Id + "/.synced/";
+  std::string Tmp = CursorDir + "." + Instance + ".tmp";
+  std::ofstream Cursor(Tmp);
+  Cursor << N << "\n";
+  Cursor.close();
+  std::rename(Tmp.c_str(), (CursorDir + Instance).c_str());
+}
+
+int CorpusSync::pull(RunFn Run, std::vector<std::string> &Imported) {
+  LastSync = time(NULL);
+  DIR *Directory = opendir(SyncDir.c_str());
+  if (Directory == NULL)
+    return 0;
+
+  std::vector<std::string> Instances;
+  while (struct dirent *Ent = readdir(Directory)) {
+    std::string Name = Ent->d_name;
+    if (Name[0] != '.' && Name != Id && exists(queueDir(Name)))
+      Instances.push_back(Name);
+  }
+  closedir(Directory);
+
+  int Runs = 0;
+  for (auto &Instance : Instances) {
+    unsigned &Cursor = Cursors[Instance];
+    unsigned Start = Cursor;
+    for (; exists(entryPath(Instance, Cursor)); ++Cursor) {
+      std::string Path = entryPath(Instance, Cursor);
+      unsigned long long Signature = 0;
+      bool HasSignature = readSignature(Path + ".meta", Signature);
+      if (HasSignature && Signatures.count(Signature))
+        continue;
+
+      std::string Input = readOneFile(Path);
+      std::vector<std::string> Coverage;
+      Run(Input, Coverage);
+      ++Runs;
+      if (HasSignature)
+        Signatures.insert(Signature);
+      if (observe(Coverage)) {
+        Signatures.insert(signature(Coverage));
+        Imported.push_back(Input);
+      }
+    }
+    if (Cursor != Start)
+      saveCursor(Instance, Cursor);
+  }
+  return Runs;
+}
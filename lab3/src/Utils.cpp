@@ -1,14 +1,19 @@
 #include <Utils.h>
 
+#include <sys/wait.h>
+
 int successCount = 0;
 int failureCount = 0;
+int importCount = 0;
 
 void initialize(std::string &OutDir) {
   int Status;
   std::string SuccessDir = OutDir + "/success";
   std::string FailureDir = OutDir + "/failure";
+  std::string ImportedDir = OutDir + "/imported";
   mkdir(SuccessDir.c_str(), 0755);
   mkdir(FailureDir.c_str(), 0755);
+  mkdir(ImportedDir.c_str(), 0755);
 }
 
 std::string readOneFile(std::string &Path) {
@@ -19,22 +24,28 @@ std::string readOneFile(std::string &Path) {
 }
 
 int readSeedInputs(std::vector<std::string> &SeedInputs,
-                   std::string &SeedInputDir) {
+                   std::string &SeedInputDir,
+                   std::vector<std::string> *SeedPaths) {
   DIR *Directory;
   struct dirent *Ent;
+  std::set<std::string> Paths;
   if ((Directory = opendir(SeedInputDir.c_str())) != NULL) {
     while ((Ent = readdir(Directory)) != NULL) {
       if (!(Ent->d_type == DT_REG))
         continue;
-      std::string Path = SeedInputDir + "/" + std::string(Ent->d_name);
-      std::string Line = readOneFile(Path);
-      SeedInputs.push_back(Line);
+      Paths.insert(SeedInputDir + "/" + std::string(Ent->d_name));
     }
     closedir(Directory);
-    return 0;
   } else {
     return 1;
   }
+  for (auto Path : Paths) {
+    std::string Line = readOneFile(Path);
+    SeedInputs.push_back(Line);
+    if (SeedPaths)
+      SeedPaths->push_back(Path);
+  }
+  return 0;
 }
 
 void readCoverageFile(std::string &Target,
@@ -47,6 +58,58 @@ void readCoverageFile(std::string &Target,
   }
 }
 
+bool readDistanceFile(std::string &Target, double &Distance) {
+  std::string DistancePath = Target + ".dist";
+  std::ifstream InFile(DistancePath);
+  long long Sum = 0, Count = 0;
+  if (!(InFile >> Sum >> Count) || Count == 0)
+    return false;
+  Distance = (double)Sum / Count;
+  return true;
+}
+
+std::string readCrashBucket(std::string &Target, int ReturnCode) {
+  std::ifstream InFile(Target + ".crash");
+  std::string Record((std::istreambuf_iterator<char>(InFile)),
+                     std::istreambuf_iterator<char>());
+  return crashBucket(Record, ReturnCode);
+}
+
+std::string crashBucket(const std::string &Record, int ReturnCode) {
+  std::istringstream InFile(Record);
+  std::string Kind;
+  int First, Second;
+  if (InFile >> Kind >> First) {
+    if (Kind == "div" && InFile >> Second)
+      return "div-" + std::to_string(First) + "-" + std::to_string(Second);
+    if (Kind == "signal")
+      return "signal-" + std::to_string(First);
+  }
+  if (WIFSIGNALED(ReturnCode))
+    return "signal-" + std::to_string(WTERMSIG(ReturnCode));
+  return "exit-" + std::to_string(WEXITSTATUS(ReturnCode));
+}
+
+bool readAlarmFile(std::string &Target, std::set<std::string> &AlarmSites) {
+  std::string AlarmPath = Target + ".alarms";
+  std::ifstream InFile(AlarmPath);
+  if (!InFile)
+    return false;
+  std::string Line;
+  while (std::getline(InFile, Line)) {
+    std::istringstream Fields(Line);
+    int Id, SrcLine, SrcCol;
+    std::string Domain;
+    if (Line.empty() || Line[0] == '#' ||
+        !(Fields >> Id >> SrcLine >> SrcCol >> Domain))
+      continue;
+    if (Domain == "Zero" || Domain == "MaybeZero")
+      AlarmSites.insert(std::to_string(SrcLine) + ", " +
+                        std::to_string(SrcCol));
+  }
+  return true;
+}
+
 void storeSeed(std::string &OutDir, int randomSeed) {
   std::string Path = OutDir + "/randomSeed.txt";
   std::fstream File(Path, std::fstream::out | std::ios_base::trunc);
@@ -54,18 +117,28 @@ void storeSeed(std::string &OutDir, int randomSeed) {
   File.close();
 }
 
-void storePassingInput(std::string &Input, std::string &OutDir) {
-  std::string Path = OutDir + "/success/input" + std::to_string(successCount++);
-  std::ofstream OutFile(Path);
+std::string storePassingInput(std::string &Input, std::string &OutDir) {
+  std::string Name = "success/input" + std::to_string(successCount++);
+  std::ofstream OutFile(OutDir + "/" + Name);
+  OutFile << Input;
+  OutFile.close();
+  return Name;
+}
+
+std::string storeCrashingInput(std::string &Input, std::string &OutDir) {
+  std::string Name = "failure/input" + std::to_string(failureCount++);
+  std::ofstream OutFile(OutDir + "/" + Name);
   OutFile << Input;
   OutFile.close();
+  return Name;
 }
 
-void storeCrashingInput(std::string &Input, std::string &OutDir) {
-  std::string Path = OutDir + "/failure/input" + std::to_string(failureCount++);
-  std::ofstream OutFile(Path);
+std::string storeImportedInput(const std::string &Input, std::string &OutDir) {
+  std::string Name = "imported/input" + std::to_string(importCount++);
+  std::ofstream OutFile(OutDir + "/" + Name);
   OutFile << Input;
   OutFile.close();
+  return Name;
 }
 
 int runTarget(std::string &Target, std::string &Input) {
@@ -0,0 +1,249 @@
+#! /usr/bin/env python3
+"""
+Fuzzer throughput benchmark.
+
+Instruments the lab3 and lab4 test programs, fuzzes each of them for a fixed
+number of executions with fixed random seeds, and reports execs/sec,
+time-to-first-crash and coverage over time as JSON. Every program is also
+fuzzed with the reference fuzzer (lab4/lib/fuzzer) on the same binary so
+the numbers can be compared.
+
+usage: bench.py [--build-dir DIR] [--execs N] [--seeds S,S,...] [--output FILE]
+
+The compiler and the LLVM optimizer can be overridden through the CLANG and
+OPT environment variables.
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+import threading
+import time
+
+from pathlib import Path
+from typing import Dict, List, Optional, Set
+
+TEST_DIR = Path(__file__).resolve().parent
+LAB3_DIR = TEST_DIR.parent
+REPO_DIR = LAB3_DIR.parent
+
+# Program directories to benchmark, each with the seed inputs to start from.
+SUITES = {
+    "lab3": LAB3_DIR / "test",
+    "lab4": REPO_DIR / "lab4" / "test",
+}
+
+REFERENCE_FUZZER = REPO_DIR / "lab4" / "lib" / "fuzzer"
+
+# Progress line the fuzzers print to stderr after every execution.
+PROGRESS = re.compile(rb"Tried (\d+) inputs, (\d+) crashes found")
+
+
+def instrument(source: Path, work_dir: Path, build_dir: Path) -> Path:
+    """
+    Compile and instrument a test program the same way lab3/test/Makefile
+    does.
+
+    :param source: C source of the program.
+    :param work_dir: directory to put the binary in.
+    :param build_dir: lab3 build directory with the pass and the runtime.
+    :return: path of the instrumented binary.
+    """
+    clang = shlex.split(os.environ.get("CLANG", "clang"))
+    opt = shlex.split(os.environ.get("OPT", "opt"))
+    binary = work_dir / source.stem
+    ll = binary.with_suffix(".ll")
+    instrumented = binary.with_suffix(".instrumented.ll")
+    commands = [
+        clang + ["-emit-llvm", "-S", "-fno-discard-value-names", "-c", "-g",
+                 "-o", str(ll), str(source)],
+        opt + ["-load", str(build_dir / "InstrumentPass.so"), "-Instrument",
+               "-S", str(ll), "-o", str(instrumented)],
+        clang + ["-o", str(binary), f"-L{build_dir}",
+                 f"-Wl,-rpath,{build_dir}", "-lruntime", "-lm",
+                 str(instrumented)],
+    ]
+    for command in commands:
+        subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+    return binary
+
+
+def read_coverage(target: Path) -> Set[bytes]:
+    """
+    :return: the coverage entries the last run of target wrote.
+    """
+    try:
+        with open(f"{target}.cov", "rb") as fp:
+            return set(fp.read().splitlines())
+    except FileNotFoundError:
+        return set()
+
+
+def coverage_over_time(target: Path, out_dir: Path,
+                       start: float) -> List[List[float]]:
+    """
+    Replay the inputs a fuzzer stored, in the order it stored them, and
+    record when the cumulative coverage grew.
+
+    :param target: instrumented program.
+    :param out_dir: output directory of the fuzzer (run with frequency 1).
+    :param start: wall clock time the fuzzer was started at.
+    :return: list of [seconds since start, covered locations].
+    """
+    inputs = [p for d in ("success", "failure") for p in (out_dir / d).glob("input*")]
+    inputs.sort(key=lambda p: (p.stat().st_mtime, p.parent.name,
+                               int(p.name[len("input"):])))
+    covered: Set[bytes] = set()
+    timeline = []
+    for path in inputs:
+        Path(f"{target}.cov").unlink(missing_ok=True)
+        with open(path, "rb") as fp:
+            subprocess.run([str(target)], stdin=fp, stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+        new = read_coverage(target) - covered
+        if new:
+            covered |= new
+            timeline.append([round(path.stat().st_mtime - start, 3),
+                             len(covered)])
+    return timeline
+
+
+def fuzz(fuzzer: Path, target: Path, seed_dir: Path, out_dir: Path, seed: int,
+         execs: int, timeout: float) -> Dict:
+    """
+    Run fuzzer on target until it has tried execs inputs or timeout seconds
+    have passed.
+
+    :return: the measurements of this run.
+    """
+    shutil.rmtree(out_dir, ignore_errors=True)
+    out_dir.mkdir(parents=True)
+    start = time.time()
+    clock = time.monotonic()
+    process = subprocess.Popen(
+        [str(fuzzer), str(target), str(seed_dir), str(out_dir), "1", str(seed)],
+        stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    # A hanging target stops the progress lines, do not wait on them forever.
+    watchdog = threading.Timer(timeout, process.kill)
+    watchdog.start()
+
+    tried, crashes = 0, 0
+    first_crash: Optional[float] = None
+    for line in process.stderr:
+        progress = PROGRESS.search(line)
+        if not progress:
+            continue
+        tried, crashes = int(progress.group(1)), int(progress.group(2))
+        if crashes and first_crash is None:
+            first_crash = round(time.monotonic() - clock, 3)
+        if tried >= execs or time.monotonic() - clock > timeout:
+            break
+    elapsed = time.monotonic() - clock
+    watchdog.cancel()
+    process.kill()
+    process.wait()
+
+    timeline = coverage_over_time(target, out_dir, start)
+    return {
+        "execs": tried,
+        "seconds": round(elapsed, 3),
+        "execs_per_sec": round(tried / elapsed, 1) if elapsed else 0,
+        "crashes": crashes,
+        "time_to_first_crash": first_crash,
+        "coverage": timeline,
+        "final_coverage": timeline[-1][1] if timeline else 0,
+    }
+
+
+def summarize(results: List[Dict], fuzzer: str) -> Dict:
+    runs = [r for r in results if r["fuzzer"] == fuzzer]
+    crash_times = [r["time_to_first_crash"] for r in runs
+                   if r["time_to_first_crash"] is not None]
+    return {
+        "runs": len(runs),
+        "median_execs_per_sec": round(statistics.median(
+            r["execs_per_sec"] for r in runs), 1) if runs else 0,
+        "crashing_runs": len(crash_times),
+        "median_time_to_first_crash": statistics.median(crash_times)
+        if crash_times else None,
+        "total_final_coverage": sum(r["final_coverage"] for r in runs),
+    }
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--build-dir", type=Path, default=LAB3_DIR / "build",
+                        help="lab3 build directory (default: lab3/build)")
+    parser.add_argument("--execs", type=int, default=2000,
+                        help="executions per run (default: 2000)")
+    parser.add_argument("--timeout", type=float, default=120,
+                        help="seconds before a run is cut short (default: 120)")
+    parser.add_argument("--seeds", default="42,1,7",
+                        help="random seeds, one run per seed (default: 42,1,7)")
+    parser.add_argument("--programs", default="",
+                        help="only run these programs, e.g. easy1,test2")
+    parser.add_argument("--no-reference", action="store_true",
+                        help="do not run the reference fuzzer")
+    parser.add_argument("--output", type=Path,
+                        help="JSON report (default: <build dir>/fuzzer-bench.json)")
+    args = parser.parse_args()
+
+    build_dir = args.build_dir.resolve()
+    fuzzers = {"lab3": build_dir / "fuzzer"}
+    if not args.no_reference:
+        fuzzers["reference"] = REFERENCE_FUZZER
+    for path in list(fuzzers.values()) + [build_dir / "InstrumentPass.so"]:
+        if not path.exists():
+            print(f"{path} not found", file=sys.stderr)
+            return 1
+
+    seeds = [int(s) for s in args.seeds.split(",")]
+    only = set(filter(None, args.programs.split(",")))
+    work_dir = build_dir / "bench"
+    shutil.rmtree(work_dir, ignore_errors=True)
+
+    results = []
+    for suite, test_dir in SUITES.items():
+        suite_dir = work_dir / suite
+        suite_dir.mkdir(parents=True)
+        for source in sorted(test_dir.glob("*.c")):
+            if only and source.stem not in only:
+                continue
+            target = instrument(source, suite_dir, build_dir)
+            for name, fuzzer in fuzzers.items():
+                for seed in seeds:
+                    print(f"{suite}/{source.stem}: {name} fuzzer, seed {seed}",
+                          file=sys.stderr)
+                    out_dir = suite_dir / f"out_{source.stem}_{name}_{seed}"
+                    result = fuzz(fuzzer, target, test_dir / "fuzz_input",
+                                  out_dir, seed, args.execs, args.timeout)
+                    results.append({"program": f"{suite}/{source.stem}",
+                                    "fuzzer": name, "seed": seed, **result})
+
+    report = {
+        "config": {"execs": args.execs, "timeout": args.timeout,
+                   "seeds": seeds},
+        "summary": {name: summarize(results, name) for name in fuzzers},
+        "results": results,
+    }
+    if "reference" in fuzzers:
+        ours = report["summary"]["lab3"]["median_execs_per_sec"]
+        theirs = report["summary"]["reference"]["median_execs_per_sec"]
+        report["summary"]["speedup"] = round(ours / theirs, 3) if theirs else None
+
+    output = args.output or build_dir / "fuzzer-bench.json"
+    with open(output, "w") as fp:
+        json.dump(report, fp, indent=2)
+    print(json.dumps(report["summary"], indent=2))
+    print(f"Report written to {output}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,100 @@
+#! /usr/bin/env python3
+"""
+Test of the __sanitize__ elision of the Instrument pass (include/NonZero.h).
+
+Instruments every test program the way the test Makefile does and checks
+each division marked in its source: a line ending in "// elided" must have
+no __sanitize__ call left, a line ending in "// sanitized" must keep one.
+
+usage: nonzero.py [--build-dir DIR] [program ...]
+
+The programs default to the nonzero*.c test programs. The compiler and the
+LLVM optimizer can be overridden through the CLANG and OPT environment
+variables.
+"""
+
+import argparse
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+from pathlib import Path
+from typing import Dict, List, Set
+
+TEST_DIR = Path(__file__).resolve().parent
+LAB3_DIR = TEST_DIR.parent
+
+MARKER = re.compile(r"//\s*(elided|sanitized)\s*$")
+SANITIZE_CALL = re.compile(r"call void @__sanitize__\([^,]+, i32 (\d+), i32 \d+\)")
+
+
+def run_tool(command: List[str]) -> None:
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+
+
+def instrument(source: Path, work_dir: Path, build_dir: Path) -> Path:
+    """
+    Compile source and instrument it the way the test Makefile does.
+
+    :return: the instrumented IR.
+    """
+    clang = shlex.split(os.environ.get("CLANG", "clang"))
+    opt = shlex.split(os.environ.get("OPT", "opt"))
+    ll = work_dir / f"{source.stem}.ll"
+    instrumented = work_dir / f"{source.stem}.instrumented.ll"
+    run_tool(clang + ["-emit-llvm", "-S", "-fno-discard-value-names",
+                      "-Xclang", "-disable-O0-optnone", "-c", "-o", str(ll),
+                      str(source), "-g"])
+    run_tool(opt + ["-load", str(build_dir / "InstrumentPass.so"),
+                    "-Instrument", "-S", str(ll), "-o", str(instrumented)])
+    return instrumented
+
+
+def read_markers(source: Path) -> Dict[int, str]:
+    """
+    :return: the expected outcome of every marked line, by line number.
+    """
+    markers = dict()
+    for number, line in enumerate(source.read_text().splitlines(), 1):
+        match = MARKER.search(line)
+        if match:
+            markers[number] = match.group(1)
+    return markers
+
+
+def sanitized_lines(instrumented: Path) -> Set[int]:
+    return {int(match.group(1))
+            for match in SANITIZE_CALL.finditer(instrumented.read_text())}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--build-dir", type=Path, default=LAB3_DIR / "build",
+                        help="lab3 build directory (default: lab3/build)")
+    parser.add_argument("programs", nargs="*",
+                        help="test programs, without .c (default: nonzero*)")
+    args = parser.parse_args()
+    programs = args.programs or sorted(
+        source.stem for source in TEST_DIR.glob("nonzero*.c"))
+
+    failed = 0
+    with tempfile.TemporaryDirectory() as work_dir:
+        for program in programs:
+            source = TEST_DIR / f"{program}.c"
+            sanitized = sanitized_lines(
+                instrument(source, Path(work_dir), args.build_dir.resolve()))
+            for line, expected in sorted(read_markers(source).items()):
+                actual = "sanitized" if line in sanitized else "elided"
+                ok = actual == expected
+                failed += not ok
+                print(f"{f'{program}.c:{line}':>16} {expected:>9}"
+                      f"{'' if ok else f'  FAILED, {actual}'}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,17 @@
+/*
+ * Divisions by constants, which never need __sanitize__. Every division is
+ * marked with whether the Instrument pass keeps its check, see nonzero.py.
+ */
+#include <stdio.h>
+#include <string.h>
+
+int main() {
+  char input[65536];
+  fgets(input, sizeof(input), stdin);
+  int n = strlen(input);
+  int z = n / 7;          // elided
+  z += (unsigned)n / 3u;  // elided
+  z += 100 / n;           // sanitized
+  printf("%d\n", z);
+  return 0;
+}
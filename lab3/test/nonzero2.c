@@ -0,0 +1,29 @@
+/*
+ * Divisions guarded by a comparison of the divisor, see nonzero.py.
+ */
+#include <stdio.h>
+#include <string.h>
+
+int main() {
+  char input[65536];
+  fgets(input, sizeof(input), stdin);
+  int n = strlen(input);
+  int b = input[0] - 'a';
+  int z = 0;
+  if (b != 0) {
+    z = n / b;      // elided
+  }
+  if (b > 0) {
+    z += n / b;     // elided
+  }
+  if (b == 0) {
+    z += 1;
+  } else {
+    z += n / b;     // elided
+  }
+  if (n % 3 == 0) {
+    z += n / b;     // sanitized
+  }
+  printf("%d\n", z);
+  return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Divisions right after a non-zero store to the divisor, see nonzero.py.
+ */
+#include <stdio.h>
+#include <string.h>
+
+int main() {
+  char input[65536];
+  fgets(input, sizeof(input), stdin);
+  int n = strlen(input);
+  int d = 4;
+  int z = n / d;    // elided
+  d = n % 2;
+  z += n / d;       // sanitized
+  d = 3;
+  z += n / d;       // elided
+  printf("%d\n", z);
+  return 0;
+}
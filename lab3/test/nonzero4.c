@@ -0,0 +1,24 @@
+/*
+ * Divisors stored non-zero, then maybe overwritten with zero by a store or
+ * a call before the division: the checks stay, see nonzero.py.
+ */
+#include <stdio.h>
+#include <string.h>
+
+void reset(int *d, int n) { *d = n % 5; }
+
+int main() {
+  char input[65536];
+  fgets(input, sizeof(input), stdin);
+  int n = strlen(input);
+  int d = 4;
+  if (n % 2 == 0) {
+    d = n % 3;
+  }
+  int z = n / d;    // sanitized
+  int e = 4;
+  reset(&e, n);
+  z += n / e;       // sanitized
+  printf("%d\n", z);
+  return 0;
+}
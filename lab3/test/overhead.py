@@ -0,0 +1,304 @@
+#! /usr/bin/env python3
+"""
+Instrumentation overhead benchmark.
+
+Builds the test programs of lab2, lab3 and lab5 uninstrumented and with
+each instrumentation mode of their lab, runs every build on the inputs of
+the program's fuzz_input directory under perf-run (a perf_event_open cycle
+counter), and reports as JSON the slowdown of every mode against the
+uninstrumented build and the bytes its runtime wrote to the log files.
+
+usage: overhead.py [--build-dir DIR] [--lab2-build DIR] [--lab5-build DIR]
+                   [--repeat N] [--programs P,P,...] [--output FILE]
+
+The modes are, per lab:
+  lab2  calls (DynamicAnalysisPass), binary-trace (BINOPS_FORMAT=binary)
+  lab3  calls (Instrument), map (-coverage-map), profile (Instrument without
+        the blocks that are hot in a lab2 profile of the same inputs, see
+        include/Selection.h)
+  lab5  calls (CBIInstrument), counters (-cbi-counters), sampling
+        (-cbi-counters -cbi-sampling)
+
+Programs without a fuzz_input directory (lab2) run on an empty input. The
+compiler and the LLVM optimizer can be overridden through the CLANG and OPT
+environment variables.
+"""
+
+import argparse
+import json
+import math
+import os
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+
+from pathlib import Path
+from typing import Dict, List, Optional
+
+TEST_DIR = Path(__file__).resolve().parent
+LAB3_DIR = TEST_DIR.parent
+REPO_DIR = LAB3_DIR.parent
+
+# Modes of every lab: name -> (pass plugin, pass flag, extra flags,
+# environment of the runs). The "profile" flags are filled in per program.
+MODES = {
+    "lab2": {
+        "calls": ("DynamicAnalysisPass.so", "-DynamicAnalysisPass", [], {}),
+        "binary-trace": ("DynamicAnalysisPass.so", "-DynamicAnalysisPass", [],
+                         {"BINOPS_FORMAT": "binary"}),
+    },
+    "lab3": {
+        "calls": ("InstrumentPass.so", "-Instrument", [], {}),
+        "map": ("InstrumentPass.so", "-Instrument", ["-coverage-map"], {}),
+        "profile": ("InstrumentPass.so", "-Instrument", [], {}),
+    },
+    "lab5": {
+        "calls": ("CBIInstrumentPass.so", "-CBIInstrument", [], {}),
+        "counters": ("CBIInstrumentPass.so", "-CBIInstrument",
+                     ["-cbi-counters"], {}),
+        "sampling": ("CBIInstrumentPass.so", "-CBIInstrument",
+                     ["-cbi-counters", "-cbi-sampling"], {}),
+    },
+}
+
+
+def run_tool(command: List[str]) -> None:
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+
+
+def compile_ll(source: Path, ll_dir: Path) -> Path:
+    """
+    Compile a test program to LLVM IR the way the test Makefiles do.
+    """
+    clang = shlex.split(os.environ.get("CLANG", "clang"))
+    ll = ll_dir / f"{source.stem}.ll"
+    run_tool(clang + ["-emit-llvm", "-S", "-fno-discard-value-names", "-c",
+                      "-g", "-o", str(ll), str(source)])
+    return ll
+
+
+def build(ll: Path, binary: Path, build_dir: Optional[Path],
+          plugin: Optional[str] = None, flags: List[str] = ()) -> Path:
+    """
+    Instrument ll with a pass of build_dir (uninstrumented if plugin is
+    None) and link it with the runtime of build_dir.
+
+    :return: path of the binary, alone in its directory so that the log
+    files its runtime writes are easy to find.
+    """
+    clang = shlex.split(os.environ.get("CLANG", "clang"))
+    opt = shlex.split(os.environ.get("OPT", "opt"))
+    binary.parent.mkdir(parents=True, exist_ok=True)
+    source = ll
+    link = ["-lm"]
+    if plugin:
+        source = ll.with_name(f"{binary.parent.name}.{ll.name}")
+        run_tool(opt + ["-load", str(build_dir / plugin)] + list(flags) +
+                 ["-S", str(ll), "-o", str(source)])
+        link = [f"-L{build_dir}", f"-Wl,-rpath,{build_dir}", "-lruntime",
+                "-lm"]
+    run_tool(clang + ["-o", str(binary), str(source)] + link)
+    return binary
+
+
+def clean_logs(binary: Path) -> None:
+    for path in binary.parent.iterdir():
+        if path != binary:
+            path.unlink()
+
+
+def log_bytes(binary: Path) -> int:
+    return sum(p.stat().st_size for p in binary.parent.iterdir()
+               if p != binary)
+
+
+def measure(perf_run: Path, binary: Path, inputs: List[Path], repeat: int,
+            env: Dict[str, str]) -> Dict:
+    """
+    Run binary repeat times on every input.
+
+    :return: the summed median count of every input, the event counted,
+    the exit statuses and the bytes of log files written by the last
+    repetition of every input.
+    """
+    total, written, event = 0, 0, None
+    statuses = []
+    for path in inputs:
+        counts = []
+        for _ in range(repeat):
+            clean_logs(binary)
+            result = subprocess.run(
+                [str(perf_run), str(path), str(binary)], check=True,
+                stdout=subprocess.PIPE, env={**os.environ, **env}, text=True)
+            event, count, status = result.stdout.split()
+            counts.append(int(count))
+        total += statistics.median(counts)
+        written += log_bytes(binary)
+        statuses.append(int(status))
+    clean_logs(binary)
+    return {"event": event, "count": total, "statuses": statuses,
+            "runtime_bytes": written}
+
+
+def lab2_profile(ll: Path, work_dir: Path, lab2_build: Path,
+                 inputs: List[Path]) -> List[str]:
+    """
+    Profile ll on inputs with lab2's DynamicAnalysisPass, one coverage file
+    per input.
+
+    :return: the -instrument-profile flags, empty if the pass fails on ll.
+    """
+    binary = work_dir / "lab2-profile" / ll.stem
+    plugin, pass_flag, _, _ = MODES["lab2"]["calls"]
+    try:
+        build(ll, binary, lab2_build, plugin, [pass_flag])
+    except subprocess.CalledProcessError:
+        return []
+    flags = []
+    for index, path in enumerate(inputs):
+        clean_logs(binary)
+        with open(path, "rb") as fp:
+            subprocess.run([str(binary)], stdin=fp, stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+        cov = binary.with_name(f"{binary.name}.cov")
+        if cov.exists():
+            profile = work_dir / f"{ll.stem}.{index}.profile"
+            shutil.move(str(cov), profile)
+            flags.append(f"-instrument-profile={profile}")
+    clean_logs(binary)
+    return flags
+
+
+def geomean(values: List[float]) -> Optional[float]:
+    values = [v for v in values if v > 0]
+    if not values:
+        return None
+    return round(math.exp(sum(map(math.log, values)) / len(values)), 3)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--build-dir", type=Path, default=LAB3_DIR / "build",
+                        help="lab3 build directory, with perf-run "
+                             "(default: lab3/build)")
+    parser.add_argument("--lab2-build", type=Path,
+                        default=REPO_DIR / "lab2" / "build",
+                        help="lab2 build directory (default: lab2/build)")
+    parser.add_argument("--lab5-build", type=Path,
+                        default=REPO_DIR / "lab5" / "build",
+                        help="lab5 build directory (default: lab5/build)")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="runs per input, the median is kept (default: 5)")
+    parser.add_argument("--programs", default="",
+                        help="only run these programs, e.g. simple5,easy1")
+    parser.add_argument("--output", type=Path,
+                        help="JSON report (default: "
+                             "<build dir>/instrument-bench.json)")
+    args = parser.parse_args()
+
+    build_dir = args.build_dir.resolve()
+    builds = {"lab2": args.lab2_build.resolve(), "lab3": build_dir,
+              "lab5": args.lab5_build.resolve()}
+    perf_run = build_dir / "perf-run"
+    if not perf_run.exists():
+        print(f"{perf_run} not found", file=sys.stderr)
+        return 1
+    only = set(filter(None, args.programs.split(",")))
+    work_dir = build_dir / "instrument-bench"
+    shutil.rmtree(work_dir, ignore_errors=True)
+
+    results = []
+    for suite, modes in MODES.items():
+        suite_build = builds[suite]
+        plugins = {plugin for plugin, _, _, _ in modes.values()}
+        if not all((suite_build / p).exists() for p in plugins):
+            print(f"{suite}: no passes in {suite_build}, skipped",
+                  file=sys.stderr)
+            continue
+        test_dir = REPO_DIR / suite / "test"
+        corpus = test_dir / "fuzz_input"
+        suite_dir = work_dir / suite
+        (suite_dir / "ll").mkdir(parents=True)
+        inputs = sorted(p for p in corpus.iterdir() if p.is_file()) \
+            if corpus.is_dir() else []
+        if not inputs:
+            empty = suite_dir / "empty-input"
+            empty.touch()
+            inputs = [empty]
+
+        for source in sorted(test_dir.glob("*.c")):
+            if only and source.stem not in only:
+                continue
+            print(f"{suite}/{source.stem}", file=sys.stderr)
+            ll = compile_ll(source, suite_dir / "ll")
+            plain = build(ll, suite_dir / "plain" / source.stem, None)
+            baseline = measure(perf_run, plain, inputs, args.repeat, {})
+            results.append({"program": f"{suite}/{source.stem}",
+                            "mode": "plain", "slowdown": 1.0, **baseline})
+
+            for mode, (plugin, pass_flag, flags, env) in modes.items():
+                flags = [pass_flag] + flags
+                if suite == "lab5":
+                    sites = suite_dir / "ll" / f"{mode}.{source.stem}.sites"
+                    flags.append(f"-cbi-site-table={sites}")
+                if mode == "profile":
+                    profile = lab2_profile(ll, suite_dir, builds["lab2"],
+                                           inputs) \
+                        if (builds["lab2"] / "DynamicAnalysisPass.so").exists() \
+                        else []
+                    if not profile:
+                        print(f"{suite}/{source.stem}: no lab2 profile, "
+                              f"{mode} skipped", file=sys.stderr)
+                        continue
+                    flags += profile
+                try:
+                    binary = build(ll, suite_dir / mode / source.stem,
+                                   suite_build, plugin, flags)
+                except subprocess.CalledProcessError:
+                    print(f"{suite}/{source.stem}: {mode} build failed",
+                          file=sys.stderr)
+                    continue
+                result = measure(perf_run, binary, inputs, args.repeat, env)
+                result["slowdown"] = round(
+                    result["count"] / baseline["count"], 3) \
+                    if baseline["count"] else None
+                # The plain build dies of SIGFPE where __sanitize__ exits.
+                result["same_outcomes"] = \
+                    [s != 0 for s in result["statuses"]] == \
+                    [s != 0 for s in baseline["statuses"]]
+                results.append({"program": f"{suite}/{source.stem}",
+                                "mode": mode, **result})
+
+    summary = {}
+    for suite, modes in MODES.items():
+        for mode in modes:
+            runs = [r for r in results if r["mode"] == mode and
+                    r["program"].startswith(suite + "/")]
+            if not runs:
+                continue
+            summary[f"{suite}/{mode}"] = {
+                "programs": len(runs),
+                "geomean_slowdown": geomean([r["slowdown"] for r in runs
+                                             if r["slowdown"]]),
+                "runtime_bytes": sum(r["runtime_bytes"] for r in runs),
+            }
+
+    report = {
+        "config": {"repeat": args.repeat,
+                   "event": results[0]["event"] if results else None},
+        "summary": summary,
+        "results": results,
+    }
+    output = args.output or build_dir / "instrument-bench.json"
+    with open(output, "w") as fp:
+        json.dump(report, fp, indent=2)
+    print(json.dumps(report["summary"], indent=2))
+    print(f"Report written to {output}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
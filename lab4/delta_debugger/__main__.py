@@ -5,8 +5,8 @@ import sys
 from sys import argv
 from pathlib import Path
 
-from delta_debugger import run_target
-from delta_debugger.delta import delta_debug
+from delta_debugger.cache import OutcomeCache
+from delta_debugger.delta import delta_debug, hierarchical_delta_debug
 
 
 def exist_check(file):
@@ -17,10 +17,23 @@ def exist_check(file):
 
 
 def main() -> int:
-    if len(argv) < 3:
-        print(f"usage: {argv[0]} [target] [crashing input file]")
+    args = argv[1:]
+    cache_file = None
+    hierarchical = False
+    while args and args[0].startswith("--"):
+        if args[0] == "--hierarchical":
+            hierarchical, args = True, args[1:]
+        elif args[0] == "--cache" and len(args) > 1:
+            cache_file, args = Path(args[1]), args[2:]
+        else:
+            break
+    if len(args) < 2:
+        print(
+            f"usage: {argv[0]} [--hierarchical] [--cache cache file] "
+            "[target] [crashing input file]"
+        )
         return 1
-    target, input_file = argv[1], argv[2]
+    target, input_file = args[0], args[1]
     if not Path(target).exists():
         print(f"{target} not found", sys.stderr)
         return 1
@@ -28,22 +41,25 @@ def main() -> int:
         print(f"{input_file} not found", sys.stderr)
         return 1
 
+    cache = OutcomeCache(target, cache_file)
     with open(input_file, "rb") as fp:
         input = fp.read()
-        if not run_target(target=target, input=input):
+        if not cache.run(input):
             print(
                 "Sanity check failed: the program does not crash with the initial input",
                 file=sys.stderr,
             )
             return 1
 
-    delta_debugging_result = delta_debug(target=target, input=input)
+    minimize = hierarchical_delta_debug if hierarchical else delta_debug
+    delta_debugging_result = minimize(target=target, input=input, cache=cache)
 
     print(
         f"Original Input Size: {len(input)}",
         f"Minimized Input Size: {len(delta_debugging_result)}",
         sep="\n",
     )
+    print(f"Target runs: {cache.runs}, cached: {cache.hits}", file=sys.stderr)
     with open(f"{input_file}.delta", "wb") as fp:
         fp.write(delta_debugging_result)
     return 0
@@ -51,6 +67,6 @@ def main() -> int:
 
 if __name__ == "__main__":
     """
-    usage: delta-debug [target] [crashing input file]
+    usage: delta-debug [--hierarchical] [--cache cache file] [target] [crashing input file]
     """
     sys.exit(main(*sys.argv[1:]))
@@ -0,0 +1,67 @@
+import hashlib
+
+from contextlib import suppress
+from pathlib import Path
+from typing import Dict, Optional, Union
+
+from delta_debugger import run_target
+
+
+def digest(data: bytes) -> str:
+    """
+    :return: the SHA-256 of data, in hex.
+    """
+    return hashlib.sha256(data).hexdigest()
+
+
+class OutcomeCache:
+    """
+    Return codes of the target on every input it already ran, keyed by the
+    SHA-256 of the input, so that no input is ever run twice.
+
+    With a cache file, new outcomes are also appended to it, one
+    "<target digest> <input digest> <return code>" line each, and the
+    outcomes recorded by earlier sessions for the same target binary are
+    loaded from it. Rebuilding the target changes its digest, which starts
+    a fresh cache.
+
+    :param target: The target program to run.
+    :param path: The optional cache file.
+    """
+
+    def __init__(self, target: str, path: Optional[Path] = None):
+        self.target = target
+        self.target_digest = digest(Path(target).read_bytes())
+        self.outcomes: Dict[str, int] = dict()
+        self.runs = 0
+        self.hits = 0
+        self.file = None
+        if path is not None:
+            with suppress(FileNotFoundError), open(path) as fp:
+                for line in fp:
+                    fields = line.split()
+                    if len(fields) == 3 and fields[0] == self.target_digest:
+                        self.outcomes[fields[1]] = int(fields[2])
+            self.file = open(path, "a")
+
+    def run(self, input: Union[str, bytes]) -> int:
+        """
+        Run the target program with input on its stdin, unless it already did.
+
+        :param input: The input to pass to the target program.
+        :return: The return code of the target program.
+        """
+        if isinstance(input, str):
+            input = input.encode()
+        key = digest(input)
+        if key in self.outcomes:
+            self.hits += 1
+            return self.outcomes[key]
+
+        return_code = run_target(target=self.target, input=input)
+        self.runs += 1
+        self.outcomes[key] = return_code
+        if self.file is not None:
+            self.file.write(f"{self.target_digest} {key} {return_code}\n")
+            self.file.flush()
+        return return_code
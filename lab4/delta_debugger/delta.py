@@ -1,12 +1,15 @@
 import math
+import re
 
-from typing import Tuple
+from typing import Callable, List, Optional, Sequence, Tuple
 
-from delta_debugger import run_target
+from delta_debugger.cache import OutcomeCache
 
 EMPTY_STRING = b"" #global var to store the final input
 
-def delta_debug(target: str, input: bytes) -> bytes:
+def delta_debug(
+    target: str, input: bytes, cache: Optional[OutcomeCache] = None
+) -> bytes:
     global EMPTY_STRING #define global
     """
     Delta-Debugging algorithm
@@ -19,19 +22,24 @@ def delta_debug(target: str, input: bytes) -> bytes:
 
     :param target: target program
     :param input: crashing input to be minimized
+    :param cache: outcomes of the inputs already run, a fresh in-memory
+        cache if None
     :return: 1-minimal crashing input.
     """
     
+    if cache is None:
+        cache = OutcomeCache(target)
     EMPTY_STRING = input #initialize the global final result
-    helper(target,input,2) #call the helper function to find the one minimal
+    helper(cache,input,2) #call the helper function to find the one minimal
     return EMPTY_STRING
 
 #helper function that runs the actual minimization algorithm
-def helper(target, input:bytes, n:int ):
+#every run goes through the cache, candidates repeat across recursion levels
+def helper(cache:OutcomeCache, input:bytes, n:int ):
     global EMPTY_STRING #declare the global var
     length = len(input) #get the length of the input
     if(length<n): #base case for where the algorithm stops
-        if(run_target(target,b"")!=0): #we do want to cover the empty string case before we return
+        if(cache.run(b"")!=0): #we do want to cover the empty string case before we return
             EMPTY_STRING=b""
         return 
     x:int = 0
@@ -44,24 +52,115 @@ def helper(target, input:bytes, n:int ):
         x=x+int(length/n)
         delta=input[start:x]
         dabla=input[0:start]+input[x:length]
-        passed=run_target(target,delta)
+        passed=cache.run(delta)
         if(passed!=0): #failed good
             if(len(EMPTY_STRING)>len(delta)):
                 EMPTY_STRING=delta #meaning we find a shorter input causes a failure
             #case 1
-            helper(target,delta,2)
+            helper(cache,delta,2)
             return #reduce the redundant runs, no need to run other branches
         else:        
-            passed=run_target(target,dabla)
+            passed=cache.run(dabla)
             if(passed!=0):
                 if(len(EMPTY_STRING)>len(dabla)): 
                     EMPTY_STRING=dabla #meaning we find a shorter input causes a failure
                 #case 2
-                helper(target,dabla,n-1)
+                helper(cache,dabla,n-1)
                 return #reduce the redundant runs, no need to run other branches
     #case 3
     if(passed==0):
-        helper(target,input,n*2)  
+        helper(cache,input,n*2)  
     
     
-    
\ No newline at end of file
+    
+
+
+"""
+Hierarchical delta debugging: minimize the units of a coarse granularity
+first (lines), then of finer ones (tokens), down to bytes. Deleting a whole
+line costs one probe where byte-level ddmin needs to find every one of its
+bytes, and the last level is bytes, so the result is still 1-minimal.
+"""
+
+"""Type Alias for a splitter: cuts an input in units that join back to it"""
+Splitter = Callable[[bytes], List[bytes]]
+
+TOKEN_PATTERN = re.compile(rb"\s+|\w+|[^\w\s]")
+
+
+def split_lines(input: bytes) -> List[bytes]:
+    """
+    :return: the lines of input, with their line breaks.
+    """
+    return input.splitlines(keepends=True)
+
+
+def split_tokens(input: bytes) -> List[bytes]:
+    """
+    :return: the words, runs of white space and single other bytes of input.
+    """
+    return TOKEN_PATTERN.findall(input)
+
+
+def split_bytes(input: bytes) -> List[bytes]:
+    """
+    :return: the bytes of input.
+    """
+    return [input[i : i + 1] for i in range(len(input))]
+
+
+DEFAULT_SPLITTERS: List[Splitter] = [split_lines, split_tokens, split_bytes]
+
+
+def ddmin(cache: OutcomeCache, units: List[bytes]) -> List[bytes]:
+    """
+    ddmin over units instead of bytes: the first crashing chunk restarts with
+    n = 2, the first crashing complement with n - 1 chunks, and n doubles
+    when nothing crashes, until there are fewer units than chunks.
+
+    :param cache: outcomes of the inputs already run
+    :param units: units of a crashing input
+    :return: a subsequence of units that still crashes, 1-minimal w.r.t.
+        removing a single unit.
+    """
+    n = 2
+    while len(units) >= n:
+        chunk = len(units) // n
+        for start in range(0, len(units), chunk):
+            delta = units[start : start + chunk]
+            if cache.run(b"".join(delta)) != 0:
+                units, n = delta, 2
+                break
+            complement = units[:start] + units[start + chunk :]
+            if cache.run(b"".join(complement)) != 0:
+                units, n = complement, max(n - 1, 2)
+                break
+        else:
+            n *= 2
+    return units
+
+
+def hierarchical_delta_debug(
+    target: str,
+    input: bytes,
+    cache: Optional[OutcomeCache] = None,
+    splitters: Sequence[Splitter] = DEFAULT_SPLITTERS,
+) -> bytes:
+    """
+    Delta-Debugging at every granularity of splitters, coarsest first.
+
+    :param target: target program
+    :param input: crashing input to be minimized
+    :param cache: outcomes of the inputs already run, a fresh in-memory
+        cache if None
+    :param splitters: the granularities, the last one should be split_bytes
+        for a 1-minimal result.
+    :return: minimized crashing input.
+    """
+    if cache is None:
+        cache = OutcomeCache(target)
+    if cache.run(b"") != 0:
+        return b""
+    for split in splitters:
+        input = b"".join(ddmin(cache, split(input)))
+    return input
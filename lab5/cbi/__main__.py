@@ -7,20 +7,21 @@ from dataclasses import asdict
 from pathlib import Path
 
 from cbi.cbi import cbi
-from cbi.utils import get_logs
+from cbi.utils import get_logs, read_collected_logs
 
 
 def main() -> int:
     """
-    Usage: cbi [target] [fuzzer-output-dir]
+    Usage: cbi [target] [fuzzer-output-dir] [cbi-collect-output]
     """
     if len(sys.argv) < 3:
         print(
-            f"Usage: cbi [target] [fuzzer-output-dir]",
+            f"Usage: cbi [target] [fuzzer-output-dir] [cbi-collect-output]",
             file=sys.stderr,
         )
         return 1
-    target, fuzz_output_dir = sys.argv[1:]
+    target, fuzz_output_dir = sys.argv[1:3]
+    runs_file = sys.argv[3] if len(sys.argv) > 3 else None
 
     if not Path(target).exists():
         print(f"{target} not found", file=sys.stderr)
@@ -29,8 +30,15 @@ def main() -> int:
         print(f"{fuzz_output_dir} not found", file=sys.stderr)
         return 1
 
-    # Generate the cbi logs
-    success_logs, failure_logs = get_logs(target=target, fuzz_dir=Path(fuzz_output_dir))
+    # Generate the cbi logs, unless cbi-collect already did
+    try:
+        if runs_file:
+            success_logs, failure_logs = read_collected_logs(target, Path(runs_file))
+        else:
+            success_logs, failure_logs = get_logs(target=target, fuzz_dir=Path(fuzz_output_dir))
+    except ValueError as error:
+        print(error, file=sys.stderr)
+        return 1
     # Analyze the cbi logs and generate the report
     report = cbi(success_logs=success_logs, failure_logs=failure_logs)
     # Visualize the report
@@ -43,6 +51,6 @@ def main() -> int:
 
 if __name__ == "__main__":
     """
-    Usage: cbi [target] [fuzzer-output-dir]
+    Usage: cbi [target] [fuzzer-output-dir] [cbi-collect-output]
     """
     sys.exit(main())
@@ -1,6 +1,7 @@
 #! /usr/bin/env python3
 
 import json
+import struct
 
 from contextlib import suppress
 from typing import Dict, List, Tuple, Union
@@ -39,6 +40,126 @@ def run_target(target: str, input: Union[str, bytes]) -> int:
 
 
 CBI_EXTENSION = ".cbi.jsonl"
+# Per-site counters of targets instrumented with -cbi-counters.
+CBI_COUNTERS_EXTENSION = ".cbi.bin"
+CBI_SITES_EXTENSION = ".cbi.sites"
+
+# See include/CBICounters.h.
+CBI_COUNTER_HEADER = struct.Struct("=8sHHI")
+CBI_COUNTER_MAGIC = b"CBICNT\0\0"
+CBI_COUNTER_VERSION = 1
+CBI_SITE_COUNTERS = struct.Struct("=3I")
+
+# See include/CBIRuns.h, written by cbi-collect.
+CBI_RUNS_HEADER = struct.Struct("=8sHHI")
+CBI_RUNS_MAGIC = b"CBIRUNS\0"
+CBI_RUNS_VERSION = 1
+CBI_RUN_FAILURE = 1
+
+Site = Tuple[str, int, int]
+
+
+# Site kinds the CBILog format can represent.
+CBI_LOG_KINDS = ("branch", "return")
+
+
+def read_site_table(target: str) -> Dict[int, Site]:
+    """
+    Read the site table written by CBIInstrument -cbi-counters.
+
+    Only branch and return sites are supported: scalar-pair and float sites
+    have no predicate of their own in a CBILog, and several pairs of the same
+    store would collapse into one predicate. cbi-score reports them.
+
+    :param target: The target program.
+    :return: (kind, line, column) of every site id.
+    """
+    sites: Dict[int, Site] = dict()
+    with open(f"{target}{CBI_SITES_EXTENSION}") as fp:
+        for line in fp:
+            if line.startswith("#"):
+                continue
+            kind, site_id, site_line, column = line.split()[:4]
+            if kind not in CBI_LOG_KINDS:
+                raise ValueError(
+                    f"{target} has {kind} sites, which only cbi-score "
+                    "reports: instrument it with the branch and return "
+                    "schemes only, or run cbi-collect and cbi-score"
+                )
+            sites[int(site_id)] = (kind, int(site_line), int(column))
+    return sites
+
+
+def read_counter_log(path: Path, sites: Dict[int, Site]) -> CBILog:
+    """
+    Turn the counters of a run into the CBILog the run would have written
+    without -cbi-counters, with one entry per observed outcome.
+
+    :param path: The .cbi.bin file of a single run.
+    :param sites: The site table of the target.
+    :return: The CBILog of the run.
+    """
+    data = path.read_bytes()
+    log: CBILog = list()
+    offset = 0
+    while offset < len(data):
+        magic, version, site_size, num_sites = CBI_COUNTER_HEADER.unpack_from(
+            data, offset
+        )
+        assert (
+            magic == CBI_COUNTER_MAGIC
+            and version == CBI_COUNTER_VERSION
+            and site_size == CBI_SITE_COUNTERS.size
+        ), f"{path} is not a version {CBI_COUNTER_VERSION} counter record"
+        offset += CBI_COUNTER_HEADER.size
+        for site_id in range(num_sites):
+            counts = CBI_SITE_COUNTERS.unpack_from(data, offset)
+            offset += CBI_SITE_COUNTERS.size
+            log.extend(site_log(sites, site_id, counts))
+    return log
+
+
+def site_log(sites: Dict[int, Site], site_id: int, counters: List[int]) -> CBILog:
+    """
+    :return: the CBILog entries of the outcomes of site_id with a non-zero
+        counter, in the counter order of CBICounters.h.
+    """
+    kind, line, column = sites[site_id]
+    values = [False, True] if kind == "branch" else [-1, 0, 1]
+    return [
+        CBILogEntry(kind=kind, line=line, column=column, value=value)
+        for value, count in zip(values, counters)
+        if count
+    ]
+
+
+def read_collected_logs(
+    target: str, runs_file: Path
+) -> Tuple[List[CBILog], List[CBILog]]:
+    """
+    Read the observations cbi-collect gathered for the target.
+
+    :param target: The target program, for its site table.
+    :param runs_file: The file written by cbi-collect.
+    :return: Two lists of CBILogs, for the successful and the failed runs.
+    """
+    sites = read_site_table(target)
+    data = runs_file.read_bytes()
+    magic, version, _, num_sites = CBI_RUNS_HEADER.unpack_from(data)
+    assert (
+        magic == CBI_RUNS_MAGIC and version == CBI_RUNS_VERSION
+    ), f"{runs_file} is not a version {CBI_RUNS_VERSION} cbi-collect file"
+
+    success_logs: List[CBILog] = list()
+    failure_logs: List[CBILog] = list()
+    for offset in range(CBI_RUNS_HEADER.size, len(data), num_sites + 1):
+        masks = data[offset + 1 : offset + 1 + num_sites]
+        log: CBILog = list()
+        for site_id, mask in enumerate(masks):
+            if mask:
+                log.extend(site_log(sites, site_id, [mask & (1 << i) for i in range(3)]))
+        (failure_logs if data[offset] == CBI_RUN_FAILURE else success_logs).append(log)
+    return success_logs, failure_logs
 
 
 def get_log_data_for_dir(
@@ -53,10 +174,15 @@ def get_log_data_for_dir(
     :return: A list of CBILogs, one for every file in input_dir.
     """
     log_file = Path(target).with_suffix(CBI_EXTENSION)
+    counters_file = Path(f"{target}{CBI_COUNTERS_EXTENSION}")
+    sites_file = Path(f"{target}{CBI_SITES_EXTENSION}")
+    sites = read_site_table(target) if sites_file.exists() else dict()
 
     # Clean up old file if necessary
     with suppress(FileNotFoundError):
         log_file.unlink()
+    with suppress(FileNotFoundError):
+        counters_file.unlink()
 
     progress_bar = tqdm(
         [
@@ -77,7 +203,11 @@ def get_log_data_for_dir(
                 return_code == expected_return_code
             ), f"return_code didn't match expected value: {expected_return_code}"
 
-        if not log_file.exists():
+        if counters_file.exists():
+            counters_save_location = file.with_suffix(CBI_COUNTERS_EXTENSION)
+            counters_file.rename(counters_save_location)
+            log_data.append(read_counter_log(counters_save_location, sites))
+        elif not log_file.exists():
             log_data.append([])
         else:
             # Move the log file to appropriate location.
@@ -0,0 +1,56 @@
+#ifndef CBI_COUNTERS_H
+#define CBI_COUNTERS_H
+
+/**
+ * Per-run CBI predicate counters, written by the runtime to <exe>.cbi.bin
+ * when the program was instrumented with -cbi-counters.
+ *
+ * CBIInstrument numbers the sites of the module densely and lists them in
+ * its site table (<module>.cbi.sites, "kind id line col" lines, followed by
+ * the names of the two locals for scalar-pair sites). At exit,
+ * the runtime appends one record per run: a CBICounterHeader followed by
+ * NumSites CBISiteCounters, indexed by site id, in the byte order of the
+ * machine. Counters saturate instead of wrapping.
+ */
+
+#include <stdint.h>
+
+#define CBI_COUNTER_MAGIC "CBICNT\0\0"
+#define CBI_COUNTER_VERSION 1
+
+/* Index of the counters of a branch site. */
+#define CBI_BRANCH_FALSE 0
+#define CBI_BRANCH_TRUE 1
+/* Index of the counters of a return site. */
+#define CBI_RETURN_NEGATIVE 0
+#define CBI_RETURN_ZERO 1
+#define CBI_RETURN_POSITIVE 2
+/* Index of the counters of a scalar-pair site (new value vs. other). */
+#define CBI_PAIR_LESS 0
+#define CBI_PAIR_EQUAL 1
+#define CBI_PAIR_GREATER 2
+/* Index of the counters of a float site, NaNs are not counted. */
+#define CBI_FLOAT_NEGATIVE 0
+#define CBI_FLOAT_ZERO 1
+#define CBI_FLOAT_POSITIVE 2
+
+typedef struct {
+  char Magic[8];
+  uint16_t Version;
+  uint16_t SiteSize;
+  uint32_t NumSites;
+} CBICounterHeader;
+
+typedef struct {
+  uint32_t Counts[3];
+} CBISiteCounters;
+
+#ifdef __cplusplus
+static_assert(sizeof(CBICounterHeader) == 16, "header must be 16 bytes");
+static_assert(sizeof(CBISiteCounters) == 12, "site must be 12 bytes");
+#else
+_Static_assert(sizeof(CBICounterHeader) == 16, "header must be 16 bytes");
+_Static_assert(sizeof(CBISiteCounters) == 12, "site must be 12 bytes");
+#endif
+
+#endif // CBI_COUNTERS_H
@@ -0,0 +1,27 @@
+#ifndef CBI_FORK_SERVER_H
+#define CBI_FORK_SERVER_H
+
+/**
+ * Fork server protocol between cbi-collect and the runtime.
+ *
+ * When CBI_FORKSRV is set, the runtime stops in its constructor, before
+ * main, and says hello (CBI_FORKSRV_HELLO) on the status pipe. Then, for
+ * every 4-byte command read from the control pipe, it forks a child that
+ * runs main, writes the child's pid, waits for it and writes its wait
+ * status. Closing the control pipe stops the server.
+ *
+ * The children read their input from the server's stdin, which the
+ * collector rewinds before every run, and write their counter record (see
+ * CBICounters.h) to CBI_RECORD_FD instead of <exe>.cbi.bin.
+ *
+ * lab3 has a fork of this protocol and of its runner, for the minimizer
+ * (lab3/include/ForkServer.h): a fix to either copy belongs in both.
+ */
+
+#define CBI_FORKSRV_ENV "CBI_FORKSRV"
+/* Control pipe, the status pipe is CBI_FORKSRV_FD + 1. */
+#define CBI_FORKSRV_FD 198
+#define CBI_RECORD_FD 197
+#define CBI_FORKSRV_HELLO 0x43424921
+
+#endif // CBI_FORK_SERVER_H
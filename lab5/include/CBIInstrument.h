@@ -1,19 +1,145 @@
+#include "Selection.h"
+
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 using namespace llvm;
 
 namespace instrument {
 
+/**
+ * Instrumentation schemes, branches and int returns unless -cbi-schemes is
+ * given. The other schemes are only counted, they need -cbi-counters.
+ */
+enum Scheme {
+  /* Conditional branches: false or true. */
+  BranchScheme,
+  /* Calls returning an int: negative, zero or positive. */
+  ReturnScheme,
+  /* Calls returning any other integer or a pointer, as an int64. */
+  WideReturnScheme,
+  /* Integer assignments to a local against every other in-scope local of
+   * the same type: less, equal or greater. */
+  ScalarPairScheme,
+  /* Floating point assignments to a local and calls returning a floating
+   * point value: negative, zero or positive. */
+  FloatScheme,
+};
+
+static const unsigned NumSchemes = FloatScheme + 1;
+
+/**
+ * @brief An instrumentation site: the instruction observed and its scheme.
+ * A scalar pair compares the value stored by Inst with the local Other, so
+ * a store is the site of one pair per other local.
+ */
+struct CBISite {
+  Instruction *Inst;
+  Scheme Kind;
+  AllocaInst *Other = nullptr;
+  /* "var other" names of a scalar pair, for the site table. */
+  std::string Names;
+  /* Is the value unsigned in the source? A scalar pair is unsigned if
+   * either local is, and compared as unsigned like C does. */
+  bool Unsigned = false;
+
+  CBISite(Instruction *Inst, Scheme Kind) : Inst(Inst), Kind(Kind) {}
+};
+
+/**
+ * @brief The CBI instrumentation of one module, shared by the passes below.
+ *
+ * The hooks are declared once, when the module is set up, and every
+ * function is instrumented in two steps: its sites are collected first,
+ * then the calls are inserted.
+ */
+class CBIInstrumenter {
+public:
+  /**
+   * @brief Declare the hooks in M and, with -cbi-counters, number the sites
+   * and write the site table.
+   */
+  explicit CBIInstrumenter(Module &M);
+
+  bool instrumentFunction(Function &F);
+
+  /**
+   * @brief Instrument every function defined in the module.
+   */
+  bool instrumentModule();
+
+private:
+  void instrumentSite(size_t I, Instruction *Copy, bool Sampled,
+                      unsigned FirstId);
+
+  Module &M;
+  Function *BranchHook, *ReturnHook;
+  Function *SampleBranchHook = nullptr, *SampleReturnHook = nullptr;
+  /* Counter hook of every scheme, [sampled][scheme]. */
+  Function *CounterHooks[2][NumSchemes] = {};
+  GlobalVariable *Countdown = nullptr;
+
+  /* Sites of the function being instrumented, reused across functions. */
+  std::vector<CBISite> Sites;
+
+  /**
+   * Id of the first site of every function of the module, assigned once per
+   * module when running with -cbi-counters. The sites of a function have
+   * consecutive ids, in the order they are collected.
+   */
+  DenseMap<const Function *, unsigned> FirstSiteIds;
+
+  /**
+   * Functions and blocks whose sites are instrumented, the others get no
+   * site id.
+   */
+  Selection Selected;
+};
+
+/**
+ * @brief Legacy function pass, opt -load CBIInstrumentPass.so
+ * -CBIInstrument
+ */
 struct CBIInstrument : public FunctionPass {
   static char ID;
 
+  std::unique_ptr<CBIInstrumenter> Impl;
+
   CBIInstrument() : FunctionPass(ID) {}
 
+  bool doInitialization(Module &M) override;
   bool runOnFunction(Function &F) override;
+  bool doFinalization(Module &M) override;
+};
+
+/**
+ * @brief Legacy module pass, opt -load CBIInstrumentPass.so
+ * -CBIInstrumentModule
+ */
+struct CBIInstrumentModule : public ModulePass {
+  static char ID;
+
+  CBIInstrumentModule() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+};
+
+/**
+ * @brief New pass manager pass, opt -load CBIInstrumentPass.so
+ * -load-pass-plugin CBIInstrumentPass.so -passes=cbi-instrument (-load
+ * registers the options).
+ */
+struct CBIInstrumentPass : public PassInfoMixin<CBIInstrumentPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
 };
 } // namespace instrument
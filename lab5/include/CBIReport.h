@@ -0,0 +1,202 @@
+#ifndef CBI_REPORT_H
+#define CBI_REPORT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cbi {
+
+/**
+ * @brief A set of runs, one bit per run.
+ */
+class Bitset {
+public:
+  explicit Bitset(size_t Size = 0) : Size(Size), Words((Size + 63) / 64) {}
+
+  size_t size() const { return Size; }
+  bool empty() const { return Words.empty(); }
+
+  void set(size_t I) { Words[I / 64] |= uint64_t(1) << (I % 64); }
+  bool test(size_t I) const { return Words[I / 64] >> (I % 64) & 1; }
+  /* Runs 64 * I to 64 * I + 63. */
+  void setWord(size_t I, uint64_t Word) { Words[I] = Word; }
+
+  /**
+   * @brief Add every run to the set.
+   */
+  void setAll();
+
+  uint64_t count() const;
+
+  /**
+   * @brief Number of runs in this set and in Other.
+   */
+  uint64_t countAnd(const Bitset &Other) const;
+
+  /**
+   * @brief Same as countAnd, but only looking at the words in Indices,
+   * which must cover every run of Other.
+   */
+  uint64_t countAnd(const Bitset &Other,
+                    const std::vector<size_t> &Indices) const;
+
+  /**
+   * @brief Indices of the words holding at least one run.
+   */
+  std::vector<size_t> nonZeroWords() const;
+
+  Bitset operator&(const Bitset &Other) const;
+  Bitset &operator-=(const Bitset &Other);
+
+private:
+  size_t Size;
+  std::vector<uint64_t> Words;
+};
+
+/**
+ * @brief A site of the site table written by CBIInstrument -cbi-counters.
+ */
+struct Site {
+  std::string Kind;
+  int Line = 0;
+  int Col = 0;
+  /* The local assigned and the one it is compared with, for scalar pairs. */
+  std::string Var, Other;
+};
+
+/**
+ * @brief Read the site table of a target, indexed by site id.
+ */
+bool readSiteTable(const std::string &Path, std::vector<Site> &Sites);
+
+/**
+ * @brief Number of predicates (counter outcomes, see CBICounters.h) of a
+ * site: 2 for branches, 3 for the other kinds.
+ */
+int numOutcomes(const Site &S);
+
+/**
+ * @brief Name of outcome Outcome of S, as in cbi/data_format.py for
+ * branches and returns. Scalar pairs name their locals, ScalarLess(x, y)
+ * is x < y.
+ */
+std::string predicateType(const Site &S, int Outcome);
+
+/**
+ * @brief The observations of many runs (a cbi-collect file) as bitsets.
+ *
+ * For every site, the runs that observed it, and for every predicate of the
+ * site, the runs that observed it true. Bitsets are only allocated for
+ * sites observed in some run.
+ */
+struct ObservationMatrix {
+  size_t NumRuns = 0;
+  size_t NumSites = 0;
+  Bitset Succeeded, Failed;
+  /* Indexed by site id. */
+  std::vector<Bitset> Observed;
+  /* Indexed by site id * 3 + outcome. */
+  std::vector<Bitset> True;
+
+  bool load(const std::string &Path);
+
+  const Bitset &trueIn(size_t SiteId, int Outcome) const {
+    return True[SiteId * 3 + Outcome];
+  }
+};
+
+/**
+ * @brief Counters and scores of a predicate, PredicateInfo of cbi.py.
+ */
+struct PredicateInfo {
+  size_t SiteId = 0;
+  int Outcome = 0;
+  uint64_t S = 0, F = 0, SObs = 0, FObs = 0;
+
+  double failure() const { return S + F ? double(F) / (S + F) : 0; }
+  double context() const {
+    return SObs + FObs ? double(FObs) / (SObs + FObs) : 0;
+  }
+  double increase() const { return failure() - context(); }
+};
+
+/**
+ * @brief Importance of a predicate, the harmonic mean of its Increase and
+ * of log(F) / log(NumF), the sensitivity of the CBI paper. 0 for
+ * predicates with no positive Increase.
+ */
+double importance(const PredicateInfo &Info, uint64_t NumF);
+
+/**
+ * @brief A predicate picked by eliminatePredicates.
+ */
+struct Predictor {
+  /* Counters of the predicate when it was picked. */
+  PredicateInfo Info;
+  double Importance = 0;
+  /* Failing runs it was true in, discarded after picking it. */
+  uint64_t Explained = 0;
+};
+
+/**
+ * @brief Iterative elimination of the CBI paper: pick the most important
+ * predicate, discard every run where it is true, re-score and repeat,
+ * until no predicate has a positive Increase or MaxPredictors are picked.
+ *
+ * Counters are updated with the discarded runs only, and only for the
+ * predicates of the sites observed in the words of runs discarded, found
+ * through an index from every word to the sites observed in it. Predicates sit in a max-heap
+ * that only the updated ones are pushed to again (stale entries are
+ * skipped when popped). NumF is the number of failing runs before any
+ * elimination, so the importance of a predicate only depends on its own
+ * counters.
+ */
+void eliminatePredicates(const ObservationMatrix &Matrix,
+                         const std::vector<Site> &Sites, size_t MaxPredictors,
+                         std::vector<Predictor> &Predictors);
+
+/**
+ * @brief Print the predictors picked by eliminatePredicates, best first.
+ */
+void printPredictors(std::ostream &Out, const std::vector<Site> &Sites,
+                     const std::vector<Predictor> &Predictors);
+
+/**
+ * @brief Print the (at most N) predicates of Infos with the highest
+ * importance, best first.
+ */
+void printTopPredicates(std::ostream &Out, const std::vector<Site> &Sites,
+                        const std::vector<PredicateInfo> &Infos,
+                        uint64_t NumF, size_t N);
+
+/**
+ * @brief Score every predicate of every observed site over the runs in
+ * Live, sorted as the Python report sorts them (line, column, type).
+ */
+void scorePredicates(const ObservationMatrix &Matrix,
+                     const std::vector<Site> &Sites, const Bitset &Live,
+                     std::vector<PredicateInfo> &Infos);
+
+/**
+ * @brief Sort Infos as the Python report sorts them (line, column, type).
+ */
+void sortPredicates(const std::vector<Site> &Sites,
+                    std::vector<PredicateInfo> &Infos);
+
+/**
+ * @brief Write Infos with the schema of <target>.report.json.
+ */
+void writeReportJson(std::ostream &Out, const std::vector<Site> &Sites,
+                     const std::vector<PredicateInfo> &Infos);
+
+/**
+ * @brief Print Infos like str(Report) in cbi/data_format.py.
+ */
+void printReport(std::ostream &Out, const std::vector<Site> &Sites,
+                 const std::vector<PredicateInfo> &Infos);
+
+} // namespace cbi
+
+#endif // CBI_REPORT_H
@@ -0,0 +1,62 @@
+#ifndef CBI_RUNNER_H
+#define CBI_RUNNER_H
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace cbi {
+
+/**
+ * @brief Is Name a fuzzer input (input*, without extension, as
+ * cbi/utils.py picks them)?
+ */
+bool isInputName(const std::string &Name);
+
+/**
+ * @brief Names of the inputs in Dir, sorted.
+ */
+std::vector<std::string> listInputs(const std::string &Dir);
+
+bool readFile(const std::string &Path, std::string &Data);
+
+/**
+ * @brief A fork server running in one instance of a target linked with the
+ * lab5 runtime (see CBIForkServer.h).
+ */
+class ForkServer {
+public:
+  explicit ForkServer(const std::string &Target);
+  ~ForkServer();
+
+  /**
+   * @brief Start the target and wait for its hello.
+   */
+  bool start();
+  void stop();
+
+  /**
+   * @brief Run the target on Input and read back the observations of the
+   * run: one mask per site, with bit i set if counter i of the site (see
+   * CBICounters.h) is not 0.
+   *
+   * @return false if the fork server died. Sites is left empty if the run
+   * wrote no record (killed by the timeout, or not instrumented).
+   */
+  bool run(const std::string &Input, int TimeoutMs, int &WaitStatus,
+           std::vector<uint8_t> &Sites);
+
+private:
+  void readRecord(std::vector<uint8_t> &Sites);
+
+  std::string Target;
+  std::vector<std::string> EnvStrings;
+  std::vector<char *> Env;
+  pid_t Pid = -1;
+  int CtlFd = -1, StatusFd = -1, InputFd = -1, RecordFd = -1;
+};
+
+} // namespace cbi
+
+#endif // CBI_RUNNER_H
@@ -0,0 +1,33 @@
+#ifndef CBI_RUNS_H
+#define CBI_RUNS_H
+
+/**
+ * Observations of many runs of a target, written by cbi-collect.
+ *
+ * A CBIRunsHeader is followed by one record per run: a byte holding the
+ * CBIRunOutcome, then NumSites bytes, one per site id of the site table.
+ * Bit i of a site byte is set if counter i of the site (see CBICounters.h)
+ * was non-zero, so a site was observed in the run iff its byte is not 0.
+ */
+
+#include <stdint.h>
+
+#define CBI_RUNS_MAGIC "CBIRUNS\0"
+#define CBI_RUNS_VERSION 1
+
+typedef enum { CBI_RUN_SUCCESS = 0, CBI_RUN_FAILURE = 1 } CBIRunOutcome;
+
+typedef struct {
+  char Magic[8];
+  uint16_t Version;
+  uint16_t Reserved;
+  uint32_t NumSites;
+} CBIRunsHeader;
+
+#ifdef __cplusplus
+static_assert(sizeof(CBIRunsHeader) == 16, "header must be 16 bytes");
+#else
+_Static_assert(sizeof(CBIRunsHeader) == 16, "header must be 16 bytes");
+#endif
+
+#endif // CBI_RUNS_H
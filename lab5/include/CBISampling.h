@@ -0,0 +1,46 @@
+#ifndef CBI_SAMPLING_H
+#define CBI_SAMPLING_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+
+#include <functional>
+#include <vector>
+
+using namespace llvm;
+
+namespace instrument {
+
+/**
+ * @brief Prepare F for sampled CBI instrumentation (Liblit et al.).
+ *
+ * The body of F is cloned into a fast path, where instrumentation sites only
+ * decrement the countdown, and a slow path, where every site is handed to
+ * InstrumentSite. At function entry, at every loop header and after every
+ * call to a function defined in the module (or an indirect call), whose
+ * sites move the countdown, a dispatch block picks the fast path when
+ * Countdown is larger than the most sites the code can cross before the
+ * next dispatch, so the countdown can only expire on the slow path. A call
+ * that is itself a site is instrumented on both paths, its value is only
+ * known once the callee ran.
+ *
+ * Values living across blocks are demoted to the stack first, so the two
+ * copies share them and control can switch paths at every dispatch.
+ *
+ * @param F Function to transform.
+ * @param Sites Instrumentation sites of F: conditional branches, and calls
+ * or stores whose value is recorded (the countdown is decremented after
+ * them). A site listed N times counts down N times.
+ * @param Countdown Thread-local i32 countdown to the next sample.
+ * @param InstrumentSite Called with the index in Sites of every site, in
+ * order, and its slow path copy; then with the site itself for calls.
+ * @return false if F cannot be cloned (exception handling, indirect
+ * branches), in which case F is left untouched.
+ */
+bool cloneForSampling(Function &F, const std::vector<Instruction *> &Sites,
+                      GlobalVariable *Countdown,
+                      std::function<void(size_t, Instruction *)> InstrumentSite);
+
+} // namespace instrument
+
+#endif // CBI_SAMPLING_H
@@ -1,26 +1,82 @@
+#include "CBICounters.h"
+#include "CBIForkServer.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 const int STR_MAX_SIZE = 1024;
 
-void get_logfile(char *buf, const int buf_size, const char *ext) {
-  char exe[STR_MAX_SIZE];
-  int ret = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+/* Path of the running executable, resolved once at load time. */
+static char exe_path[1024];
+
+static void resolve_exe_path(void) {
+  int ret = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
   if (ret == -1) {
     fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
     exit(1);
   }
-  exe[ret] = 0;
+  exe_path[ret] = 0;
+}
+
+void get_logfile(char *buf, const int buf_size, const char *ext) {
+  if (exe_path[0] == 0) {
+    resolve_exe_path();
+  }
+  snprintf(buf, buf_size, "%s%s", exe_path, ext);
+}
+
+/*
+ * Async-signal-safe helpers, the log files are also written from the crash
+ * handlers where stdio must not be used.
+ */
+static char *append_str(char *out, const char *str) {
+  while (*str) {
+    *out++ = *str++;
+  }
+  return out;
+}
 
-  int len = strlen(exe);
-  strncpy(buf, exe, len);
-  buf[len] = 0;
-  for (int i = 0; i <= strlen(ext); ++i) {
-    buf[buf_size - (i + 1)] = 0;
+static char *append_num(char *out, long long num) {
+  char digits[24];
+  int len = 0;
+  unsigned long long value =
+      num < 0 ? -(unsigned long long)num : (unsigned long long)num;
+  if (num < 0) {
+    *out++ = '-';
+  }
+  do {
+    digits[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (len) {
+    *out++ = digits[--len];
   }
-  strncat(buf, ext, strlen(ext));
+  return out;
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(fd, buf, len);
+    if (ret <= 0) {
+      return;
+    }
+    buf += ret;
+    len -= ret;
+  }
+}
+
+static int open_logfile(const char *ext, int flags) {
+  char logfile[sizeof(exe_path) + 16];
+  char *end = append_str(append_str(logfile, exe_path), ext);
+  *end = 0;
+  return open(logfile, O_WRONLY | O_CREAT | flags, 0644);
 }
 
 void __sanitize__(int divisor, int line, int col) {
@@ -30,32 +86,527 @@ void __sanitize__(int divisor, int line, int col) {
   }
 }
 
+#define CBI_BUFFER_SIZE 65536
+
+/*
+ * Every thread logs into its own thread_log, so the hooks never lock or
+ * share cache lines. The logs are heap allocated, to outlive their thread,
+ * and pushed on a lock-free list that the flush walks to merge them.
+ */
+typedef struct {
+  size_t capacity;
+  uint64_t slots[];
+} cov_index;
+
+typedef struct thread_log {
+  struct thread_log *next;
+  /*
+   * Locations covered by the thread, deduplicated in an open-addressing
+   * hash set and kept in first-hit order.
+   */
+  cov_index *index;
+  uint64_t *order;
+  size_t count;
+  /* Predicate events of the thread, as JSON lines not yet written. */
+  size_t cbi_len;
+  char cbi_buf[CBI_BUFFER_SIZE];
+  /* Outcome counters of every site (-cbi-counters), only written here. */
+  CBISiteCounters *counters;
+} thread_log;
+
+static thread_log *thread_logs = NULL;
+static __thread thread_log *local_log = NULL;
+
+/* Keys are (line + 1, col + 1) so that 0 marks an empty slot. */
+static uint64_t cov_key(int line, int col) {
+  return ((uint64_t)(uint32_t)(line + 1) << 32) | (uint32_t)(col + 1);
+}
+
+static size_t cov_slot(const cov_index *index, uint64_t key) {
+  uint64_t hash = key * 0x9e3779b97f4a7c15ULL;
+  size_t mask = index->capacity - 1;
+  size_t slot = (size_t)(hash >> 32) & mask;
+  while (index->slots[slot] != 0 && index->slots[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/*
+ * The old arrays are not freed, a flush running in another thread may still
+ * be reading them. The leak is bounded by the final size of the set.
+ */
+static void cov_grow(thread_log *log) {
+  size_t capacity = log->index ? log->index->capacity * 2 : 1024;
+  cov_index *index = calloc(1, sizeof(cov_index) + capacity * sizeof(uint64_t));
+  uint64_t *order = malloc(capacity / 2 * sizeof(uint64_t));
+  if (index == NULL || order == NULL) {
+    fprintf(stderr, "Error: Out of memory for coverage\n");
+    exit(1);
+  }
+  index->capacity = capacity;
+  for (size_t i = 0; i < log->count; ++i) {
+    order[i] = log->order[i];
+    index->slots[cov_slot(index, order[i])] = order[i];
+  }
+  __atomic_store_n(&log->order, order, __ATOMIC_RELEASE);
+  __atomic_store_n(&log->index, index, __ATOMIC_RELEASE);
+}
+
+static thread_log *get_thread_log(void) {
+  thread_log *log = local_log;
+  if (log != NULL) {
+    return log;
+  }
+  log = calloc(1, sizeof(thread_log));
+  if (log == NULL) {
+    fprintf(stderr, "Error: Out of memory for coverage\n");
+    exit(1);
+  }
+  cov_grow(log);
+  log->next = __atomic_load_n(&thread_logs, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&thread_logs, &log->next, log, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  local_log = log;
+  return log;
+}
+
 void __coverage__(int line, int col) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cov");
-  FILE *f = fopen(logfile, "a");
-  fprintf(f, "%d,%d\n", line, col);
-  fclose(f);
+  thread_log *log = get_thread_log();
+  uint64_t key = cov_key(line, col);
+  size_t slot = cov_slot(log->index, key);
+  if (log->index->slots[slot] == key) {
+    return;
+  }
+  if (log->count + 1 > log->index->capacity / 2) {
+    cov_grow(log);
+    slot = cov_slot(log->index, key);
+  }
+  log->index->slots[slot] = key;
+  log->order[log->count] = key;
+  __atomic_store_n(&log->count, log->count + 1, __ATOMIC_RELEASE);
+}
+
+/* Was key covered by one of the threads logged before last? */
+static int covered_before(const thread_log *first, const thread_log *last,
+                          uint64_t key) {
+  for (const thread_log *log = first; log != last; log = log->next) {
+    const cov_index *index = __atomic_load_n(&log->index, __ATOMIC_ACQUIRE);
+    if (index->slots[cov_slot(index, key)] == key) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void dump_coverage(void) {
+  thread_log *logs = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+  if (logs == NULL) {
+    return;
+  }
+  int fd = open_logfile(".cov", O_APPEND);
+  if (fd == -1) {
+    return;
+  }
+  char buf[4096];
+  char *end = buf;
+  for (thread_log *log = logs; log != NULL; log = log->next) {
+    size_t count = __atomic_load_n(&log->count, __ATOMIC_ACQUIRE);
+    const uint64_t *order = __atomic_load_n(&log->order, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < count; ++i) {
+      if (covered_before(logs, log, order[i])) {
+        continue;
+      }
+      if (end - buf > (long)sizeof(buf) - 64) {
+        write_all(fd, buf, end - buf);
+        end = buf;
+      }
+      end = append_num(end, (long long)(order[i] >> 32) - 1);
+      end = append_str(end, ",");
+      end = append_num(end, (long long)(order[i] & 0xffffffff) - 1);
+      *end++ = '\n';
+    }
+  }
+  write_all(fd, buf, end - buf);
+  close(fd);
+}
+
+/* <exe>.cbi.jsonl, opened by the first thread that flushes events. */
+static int cbi_fd = -1;
+
+static int get_cbi_fd(void) {
+  int fd = __atomic_load_n(&cbi_fd, __ATOMIC_ACQUIRE);
+  if (fd != -1) {
+    return fd;
+  }
+  int expected = -1;
+  fd = open_logfile(".cbi.jsonl", O_APPEND);
+  if (!__atomic_compare_exchange_n(&cbi_fd, &expected, fd, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    close(fd);
+    fd = expected;
+  }
+  return fd;
+}
+
+/*
+ * Lines are only ever written whole and with O_APPEND, so the events of
+ * different threads interleave line by line but never within a line.
+ *
+ * The buffer is appended to by its thread only, but flushed by whichever
+ * thread exits or crashes first. The flush takes the buffer by exchanging
+ * its length with CBI_FLUSHING and gives it back empty once written;
+ * log_cbi only publishes a line with a CAS on the length it copied after,
+ * so a line that lands while the buffer is taken is logged again instead of
+ * lost or written twice.
+ */
+#define CBI_FLUSHING ((size_t)-1)
+
+static void flush_cbi(thread_log *log) {
+  size_t len =
+      __atomic_exchange_n(&log->cbi_len, CBI_FLUSHING, __ATOMIC_ACQ_REL);
+  if (len == CBI_FLUSHING) {
+    /* Flushed by another thread, or by this one in a crash handler. */
+    return;
+  }
+  if (len > 0) {
+    write_all(get_cbi_fd(), log->cbi_buf, len);
+  }
+  __atomic_store_n(&log->cbi_len, 0, __ATOMIC_RELEASE);
+}
+
+static void log_cbi(const char *line, int len) {
+  thread_log *log = get_thread_log();
+  for (;;) {
+    size_t used;
+    while ((used = __atomic_load_n(&log->cbi_len, __ATOMIC_ACQUIRE)) ==
+           CBI_FLUSHING) {
+    }
+    if (used + len > sizeof(log->cbi_buf)) {
+      flush_cbi(log);
+      continue;
+    }
+    memcpy(log->cbi_buf + used, line, len);
+    if (__atomic_compare_exchange_n(&log->cbi_len, &used, used + len, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
 }
 
 void __cbi_branch__(int line, int col, int cond) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cbi.jsonl");
-  FILE *f = fopen(logfile, "a");
-  fprintf(
-      f,
+  char buf[128];
+  int len = snprintf(
+      buf, sizeof(buf),
       "{\"kind\": \"branch\", \"line\": %d, \"column\": %d, \"value\": %s}\n",
       line, col, cond ? "true" : "false");
-  fclose(f);
+  log_cbi(buf, len);
 }
 
 void __cbi_return__(int line, int col, int rv) {
-  char logfile[STR_MAX_SIZE];
-  get_logfile(logfile, sizeof(logfile), ".cbi.jsonl");
-  FILE *f = fopen(logfile, "a");
-  fprintf(
-      f,
+  char buf[128];
+  int len = snprintf(
+      buf, sizeof(buf),
       "{\"kind\": \"return\", \"line\": %d, \"column\": %d, \"value\": %d}\n",
       line, col, rv);
-  fclose(f);
+  log_cbi(buf, len);
+}
+
+/*
+ * Sampled CBI (-cbi-sampling): every site decrements the thread's
+ * countdown, and the predicate is only recorded when it reaches zero. The
+ * countdowns are drawn from a geometric distribution, so that every site
+ * execution is recorded with probability 1/CBI_SAMPLING_RATE. This only
+ * holds if no execution is skipped: instrumented code reads the countdown
+ * at function entry, loop headers and after calls, and only takes its fast
+ * path, that decrements without checking, when the countdown cannot expire
+ * before the next of these dispatches (see include/CBISampling.h).
+ */
+__thread int __cbi_countdown__ = 0;
+
+/* Mean distance between two samples, 100 unless CBI_SAMPLING_RATE is set. */
+static int cbi_sampling_rate = 100;
+/* Seed of the countdowns, CBI_SEED makes them reproducible. */
+static uint64_t cbi_seed = 0;
+
+static __thread uint64_t cbi_rng = 0;
+
+static void init_sampling(void) {
+  const char *rate = getenv("CBI_SAMPLING_RATE");
+  if (rate && atoi(rate) > 0) {
+    cbi_sampling_rate = atoi(rate);
+  }
+  const char *seed = getenv("CBI_SEED");
+  cbi_seed = seed ? strtoull(seed, NULL, 10) : (uint64_t)getpid() << 32;
+}
+
+/* splitmix64, seeded differently in every thread. */
+static uint64_t next_random(void) {
+  if (cbi_rng == 0) {
+    static uint64_t threads = 0;
+    cbi_rng = cbi_seed + __atomic_add_fetch(&threads, 1, __ATOMIC_RELAXED) *
+                             0x9e3779b97f4a7c15ULL;
+  }
+  uint64_t z = (cbi_rng += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Number of sites until the next sample, at least 1. */
+static int next_countdown(void) {
+  if (cbi_sampling_rate <= 1) {
+    return 1;
+  }
+  /* Uniform in (0, 1]. */
+  double u = ((next_random() >> 11) + 1) * 0x1.0p-53;
+  double countdown = floor(log(u) / log1p(-1.0 / cbi_sampling_rate)) + 1;
+  return countdown < INT32_MAX ? (int)countdown : INT32_MAX;
+}
+
+/* Does the site being executed get sampled? Resets the countdown if so. */
+static int take_sample(void) {
+  if (cbi_rng == 0) {
+    /* First site of the thread, its countdown was never drawn. */
+    __cbi_countdown__ = next_countdown();
+  }
+  if (--__cbi_countdown__ > 0) {
+    return 0;
+  }
+  __cbi_countdown__ = next_countdown();
+  return 1;
+}
+
+void __cbi_sample_branch__(int line, int col, int cond) {
+  if (take_sample()) {
+    __cbi_branch__(line, col, cond);
+  }
+}
+
+void __cbi_sample_return__(int line, int col, int rv) {
+  if (take_sample()) {
+    __cbi_return__(line, col, rv);
+  }
+}
+
+/*
+ * -cbi-counters: sites are numbered by CBIInstrument and every thread counts
+ * the outcomes of each site. At exit the counters of all threads are summed
+ * into one record appended to <exe>.cbi.bin, see CBICounters.h.
+ */
+static uint32_t cbi_num_sites = 0;
+/* Where the record goes, CBI_RECORD_FD under the fork server. */
+static int cbi_record_fd = -1;
+/* The record, allocated up front so the crash handlers do not allocate. */
+static CBICounterHeader *cbi_record = NULL;
+
+void __cbi_init_counters__(int num_sites) {
+  if (num_sites <= 0 || cbi_record != NULL) {
+    return;
+  }
+  cbi_record = calloc(1, sizeof(CBICounterHeader) +
+                             num_sites * sizeof(CBISiteCounters));
+  if (cbi_record == NULL) {
+    fprintf(stderr, "Error: Out of memory for CBI counters\n");
+    exit(1);
+  }
+  memcpy(cbi_record->Magic, CBI_COUNTER_MAGIC, sizeof(cbi_record->Magic));
+  cbi_record->Version = CBI_COUNTER_VERSION;
+  cbi_record->SiteSize = sizeof(CBISiteCounters);
+  cbi_record->NumSites = num_sites;
+  cbi_num_sites = num_sites;
+}
+
+static void count_outcome(int id, int outcome) {
+  thread_log *log = get_thread_log();
+  CBISiteCounters *counters = log->counters;
+  if (counters == NULL) {
+    counters = calloc(cbi_num_sites, sizeof(CBISiteCounters));
+    if (counters == NULL) {
+      fprintf(stderr, "Error: Out of memory for CBI counters\n");
+      exit(1);
+    }
+    __atomic_store_n(&log->counters, counters, __ATOMIC_RELEASE);
+  }
+  if ((uint32_t)id >= cbi_num_sites) {
+    return;
+  }
+  uint32_t *count = &counters[id].Counts[outcome];
+  if (*count != UINT32_MAX) {
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+  }
+}
+
+static int return_outcome(long long rv) {
+  return rv < 0 ? CBI_RETURN_NEGATIVE
+                : rv == 0 ? CBI_RETURN_ZERO : CBI_RETURN_POSITIVE;
+}
+
+void __cbi_branch_count__(int id, int cond) {
+  count_outcome(id, cond ? CBI_BRANCH_TRUE : CBI_BRANCH_FALSE);
+}
+
+void __cbi_return_count__(int id, int rv) {
+  count_outcome(id, return_outcome(rv));
+}
+
+void __cbi_return64_count__(int id, long long rv) {
+  count_outcome(id, return_outcome(rv));
+}
+
+void __cbi_pair_count__(int id, long long value, long long other) {
+  count_outcome(id, value < other
+                        ? CBI_PAIR_LESS
+                        : value == other ? CBI_PAIR_EQUAL : CBI_PAIR_GREATER);
+}
+
+void __cbi_float_count__(int id, double value) {
+  if (isnan(value)) {
+    return;
+  }
+  count_outcome(id, value < 0
+                        ? CBI_FLOAT_NEGATIVE
+                        : value == 0 ? CBI_FLOAT_ZERO : CBI_FLOAT_POSITIVE);
+}
+
+void __cbi_sample_branch_count__(int id, int cond) {
+  if (take_sample()) {
+    __cbi_branch_count__(id, cond);
+  }
+}
+
+void __cbi_sample_return_count__(int id, int rv) {
+  if (take_sample()) {
+    __cbi_return_count__(id, rv);
+  }
+}
+
+void __cbi_sample_return64_count__(int id, long long rv) {
+  if (take_sample()) {
+    __cbi_return64_count__(id, rv);
+  }
+}
+
+void __cbi_sample_pair_count__(int id, long long value, long long other) {
+  if (take_sample()) {
+    __cbi_pair_count__(id, value, other);
+  }
+}
+
+void __cbi_sample_float_count__(int id, double value) {
+  if (take_sample()) {
+    __cbi_float_count__(id, value);
+  }
+}
+
+static void dump_counters(void) {
+  if (cbi_record == NULL) {
+    return;
+  }
+  CBISiteCounters *total = (CBISiteCounters *)(cbi_record + 1);
+  for (thread_log *log = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+       log != NULL; log = log->next) {
+    const CBISiteCounters *counters =
+        __atomic_load_n(&log->counters, __ATOMIC_ACQUIRE);
+    if (counters == NULL) {
+      continue;
+    }
+    for (uint32_t id = 0; id < cbi_num_sites; ++id) {
+      for (int i = 0; i < 3; ++i) {
+        uint64_t sum = (uint64_t)total[id].Counts[i] +
+                       __atomic_load_n(&counters[id].Counts[i],
+                                       __ATOMIC_RELAXED);
+        total[id].Counts[i] = sum < UINT32_MAX ? (uint32_t)sum : UINT32_MAX;
+      }
+    }
+  }
+  int fd = cbi_record_fd != -1 ? cbi_record_fd
+                               : open_logfile(".cbi.bin", O_APPEND);
+  if (fd == -1) {
+    return;
+  }
+  /* A single write, so records of concurrent runs do not interleave. */
+  write_all(fd, (const char *)cbi_record,
+            sizeof(CBICounterHeader) +
+                cbi_num_sites * sizeof(CBISiteCounters));
+  if (fd != cbi_record_fd) {
+    close(fd);
+  }
+}
+
+static void dump_cbi(void) {
+  for (thread_log *log = __atomic_load_n(&thread_logs, __ATOMIC_ACQUIRE);
+       log != NULL; log = log->next) {
+    flush_cbi(log);
+  }
+  dump_counters();
+}
+
+static void dump_logs(void) {
+  /* Only the first thread to exit or crash writes the logs. */
+  static int dumped = 0;
+  if (__atomic_exchange_n(&dumped, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  /* cbi-collect only wants the counters, do not grow <exe>.cov per run. */
+  if (cbi_record_fd == -1) {
+    dump_coverage();
+  }
+  dump_cbi();
+}
+
+/* Flush the logs when the program crashes, then crash the same way. */
+static void crash_handler(int sig) {
+  dump_logs();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/*
+ * Serve cbi-collect, see CBIForkServer.h. Only returns in the children,
+ * which go on to run main.
+ */
+static void run_fork_server(void) {
+  const int ctl_fd = CBI_FORKSRV_FD, status_fd = CBI_FORKSRV_FD + 1;
+  int hello = CBI_FORKSRV_HELLO;
+  if (write(status_fd, &hello, sizeof(hello)) != sizeof(hello)) {
+    return;
+  }
+  for (;;) {
+    int cmd, status;
+    if (read(ctl_fd, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+      _exit(0);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      _exit(1);
+    }
+    if (pid == 0) {
+      close(ctl_fd);
+      close(status_fd);
+      /* Children sample differently unless CBI_SEED is set. */
+      init_sampling();
+      return;
+    }
+    if (write(status_fd, &pid, sizeof(pid)) != sizeof(pid) ||
+        waitpid(pid, &status, 0) < 0 ||
+        write(status_fd, &status, sizeof(status)) != sizeof(status)) {
+      _exit(0);
+    }
+  }
+}
+
+__attribute__((constructor)) static void init_runtime(void) {
+  resolve_exe_path();
+  init_sampling();
+  atexit(dump_logs);
+  const int signals[] = {SIGSEGV, SIGFPE, SIGABRT, SIGBUS, SIGILL};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+    signal(signals[i], crash_handler);
+  }
+  if (getenv(CBI_FORKSRV_ENV)) {
+    cbi_record_fd = CBI_RECORD_FD;
+    run_fork_server();
+  }
 }
@@ -0,0 +1,181 @@
+/*
+ * Stress test of the runtime with many threads hitting the hooks at once.
+ *
+ * The workload runs in a child process; once it has exited, the parent
+ * checks that <exe>.cov lists every covered location exactly once and that
+ * <exe>.cbi.jsonl holds every predicate event as an intact line, in order.
+ *
+ * With "exit", thread 0 calls exit() after its iterations while the others
+ * keep logging, so the logs are flushed under the feet of their threads.
+ * Every thread must then have logged a prefix of its events, thread 0 all of
+ * them.
+ *
+ * Usage: runtime-stress [threads] [iterations] [exit]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void __coverage__(int line, int col);
+void __cbi_branch__(int line, int col, int cond);
+void __cbi_return__(int line, int col, int rv);
+
+/* Locations every thread covers, then locations only thread t covers. */
+#define SHARED_SITES 64
+#define PRIVATE_SITES 256
+
+static int num_threads = 8;
+static int iterations = 20000;
+static int exit_early = 0;
+
+static void *worker(void *arg) {
+  int id = (int)(long)arg;
+  for (int i = 0; i < iterations || (exit_early && id != 0); ++i) {
+    __coverage__(1 + i % SHARED_SITES, 1);
+    __coverage__(1000 * (id + 1) + i % PRIVATE_SITES, 2);
+    __cbi_branch__(id + 1, i % 7, i & 1);
+    __cbi_return__(id + 1, i % 7, i - iterations / 2);
+  }
+  if (exit_early) {
+    exit(0);
+  }
+  return NULL;
+}
+
+static void run_workload(void) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  for (long i = 0; i < num_threads; ++i) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+static int check_coverage(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  int expected = SHARED_SITES + num_threads * PRIVATE_SITES;
+  char *seen = calloc(1000 * (num_threads + 1) + PRIVATE_SITES, 1);
+  int line, col, count = 0, errors = 0;
+  while (fscanf(f, "%d,%d\n", &line, &col) == 2) {
+    if (seen[line]++ && errors++ < 10) {
+      fprintf(stderr, "Location %d,%d logged twice\n", line, col);
+    }
+    ++count;
+  }
+  fclose(f);
+  if (exit_early) {
+    /* Only the locations of thread 0 are sure to be covered. */
+    for (int i = 0; i < SHARED_SITES + PRIVATE_SITES; ++i) {
+      int line = i < SHARED_SITES ? 1 + i : 1000 + i - SHARED_SITES;
+      if (!seen[line] && errors++ < 10) {
+        fprintf(stderr, "Location %d not logged\n", line);
+      }
+    }
+  } else if (count != expected) {
+    fprintf(stderr, "Expected %d locations, got %d\n", expected, count);
+    ++errors;
+  }
+  free(seen);
+  return errors;
+}
+
+static int check_cbi(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s not found\n", path);
+    return 1;
+  }
+  /* Events of every thread so far, its values count up from event 0. */
+  long long *branches = calloc(num_threads, sizeof(long long));
+  long long *returns = calloc(num_threads, sizeof(long long));
+  char buf[256];
+  int errors = 0;
+  while (fgets(buf, sizeof(buf), f)) {
+    char kind[16], value[16];
+    int line, col;
+    if (sscanf(buf,
+               "{\"kind\": \"%15[a-z]\", \"line\": %d, \"column\": %d, "
+               "\"value\": %15[^}]}\n",
+               kind, &line, &col, value) != 4 ||
+        line < 1 || line > num_threads) {
+      if (errors++ < 10) {
+        fprintf(stderr, "Torn event: %s", buf);
+      }
+      continue;
+    }
+    int ok;
+    if (strcmp(kind, "branch") == 0) {
+      long long i = branches[line - 1]++;
+      ok = strcmp(value, i & 1 ? "true" : "false") == 0;
+    } else {
+      long long i = returns[line - 1]++;
+      ok = atoll(value) == i - iterations / 2;
+    }
+    if (!ok && errors++ < 10) {
+      fprintf(stderr, "Unexpected event: %s", buf);
+    }
+  }
+  fclose(f);
+  for (int i = 0; i < num_threads; ++i) {
+    /* A thread cut by exit() may miss the return after its last branch. */
+    int complete = branches[i] == iterations && returns[i] == iterations;
+    long long pending = branches[i] - returns[i];
+    int prefix = pending == 0 || pending == 1;
+    if (exit_early && i != 0 ? !prefix : !complete) {
+      fprintf(stderr, "Thread %d logged %lld branches and %lld returns\n", i,
+              branches[i], returns[i]);
+      ++errors;
+    }
+  }
+  free(branches);
+  free(returns);
+  return errors;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    num_threads = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    iterations = atoi(argv[2]);
+  }
+  exit_early = argc > 3 && strcmp(argv[3], "exit") == 0;
+
+  char exe[1024], cov[1040], cbi[1040];
+  int len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len == -1) {
+    fprintf(stderr, "Error: Cannot find /proc/self/exe\n");
+    return 1;
+  }
+  exe[len] = 0;
+  snprintf(cov, sizeof(cov), "%s.cov", exe);
+  snprintf(cbi, sizeof(cbi), "%s.cbi.jsonl", exe);
+  unlink(cov);
+  unlink(cbi);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    run_workload();
+    exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "Workload did not exit cleanly\n");
+    return 1;
+  }
+
+  int errors = check_coverage(cov) + check_cbi(cbi);
+  printf("%d threads x %d iterations%s: %s\n", num_threads, iterations,
+         exit_early ? " (exit)" : "", errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * cbi-collect: run a target instrumented with -cbi-counters on every input
+ * of a fuzzer output directory and write the observations of all the runs
+ * to one file (see CBIRuns.h).
+ *
+ * Inputs are replayed in parallel, every worker driving its own fork server
+ * inside the target (see CBIForkServer.h), so a run costs a fork instead of
+ * a process start and the log files are never touched.
+ *
+ * Usage:
+ *   cbi-collect [-j jobs] [-t timeout-ms] target fuzz-dir [output]
+ *
+ * Inputs are fuzz-dir/success/input* (expected to exit with 0) and
+ * fuzz-dir/failure/input* (expected to exit with 1). The output defaults
+ * to <target>.cbi.runs.
+ */
+
+#include "CBIRunner.h"
+#include "CBIRuns.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const int DEFAULT_TIMEOUT_MS = 1000;
+
+struct Run {
+  std::string Path;
+  CBIRunOutcome Expected;
+  /* One observation mask per site, empty if the run left no record. */
+  std::vector<uint8_t> Sites;
+  bool Ran = false;
+  int Status = 0;
+};
+
+void listRuns(const std::string &Dir, CBIRunOutcome Expected,
+              std::vector<Run> &Runs) {
+  for (auto &Name : cbi::listInputs(Dir)) {
+    Run R;
+    R.Path = Dir + "/" + Name;
+    R.Expected = Expected;
+    Runs.push_back(R);
+  }
+}
+
+void usage(const char *Argv0) {
+  fprintf(stderr,
+          "usage: %s [-j jobs] [-t timeout-ms] target fuzz-dir [output]\n",
+          Argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned Jobs = std::max(1u, std::thread::hardware_concurrency());
+  int TimeoutMs = DEFAULT_TIMEOUT_MS;
+  int Opt;
+  while ((Opt = getopt(argc, argv, "j:t:")) != -1) {
+    if (Opt == 'j') {
+      Jobs = std::max(1, atoi(optarg));
+    } else if (Opt == 't') {
+      TimeoutMs = atoi(optarg);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string Target = argv[optind], FuzzDir = argv[optind + 1];
+  std::string Output =
+      argc - optind > 2 ? argv[optind + 2] : Target + ".cbi.runs";
+  if (access(Target.c_str(), X_OK)) {
+    fprintf(stderr, "%s not found\n", Target.c_str());
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<Run> Runs;
+  listRuns(FuzzDir + "/success", CBI_RUN_SUCCESS, Runs);
+  listRuns(FuzzDir + "/failure", CBI_RUN_FAILURE, Runs);
+  Jobs = std::min<size_t>(Jobs, std::max<size_t>(1, Runs.size()));
+
+  std::atomic<size_t> Next(0), Done(0);
+  std::atomic<bool> Failed(false);
+  auto Work = [&]() {
+    cbi::ForkServer Server(Target);
+    if (!Server.start()) {
+      Failed = true;
+      return;
+    }
+    std::string Input;
+    for (size_t I = Next++; I < Runs.size() && !Failed; I = Next++) {
+      Run &R = Runs[I];
+      if (!cbi::readFile(R.Path, Input)) {
+        fprintf(stderr, "Cannot read %s\n", R.Path.c_str());
+        continue;
+      }
+      // Restart a server that died once, then give up on the input.
+      for (int Attempt = 0; Attempt < 2 && !R.Ran; ++Attempt) {
+        R.Ran = Server.run(Input, TimeoutMs, R.Status, R.Sites);
+        if (!R.Ran) {
+          Server.stop();
+          if (!Server.start()) {
+            Failed = true;
+            return;
+          }
+        }
+      }
+      size_t Count = ++Done;
+      if (Count % 1000 == 0)
+        fprintf(stderr, "Collected %zu/%zu runs\n", Count, Runs.size());
+    }
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned I = 0; I < Jobs; ++I)
+    Workers.emplace_back(Work);
+  for (auto &Worker : Workers)
+    Worker.join();
+  if (Failed) {
+    fprintf(stderr, "%s did not start a fork server, is it linked with the "
+                    "lab5 runtime?\n",
+            Target.c_str());
+    return 1;
+  }
+
+  uint32_t NumSites = 0;
+  size_t Unexpected = 0, Missing = 0;
+  for (auto &R : Runs) {
+    NumSites = std::max<uint32_t>(NumSites, R.Sites.size());
+    int Expected = R.Expected == CBI_RUN_SUCCESS ? 0 : 1;
+    if (!R.Ran || !WIFEXITED(R.Status) || WEXITSTATUS(R.Status) != Expected)
+      ++Unexpected;
+  }
+  for (auto &R : Runs) {
+    if (R.Sites.size() != NumSites) {
+      ++Missing;
+      R.Sites.resize(NumSites);
+    }
+  }
+
+  FILE *Out = fopen(Output.c_str(), "wb");
+  if (!Out) {
+    fprintf(stderr, "Cannot write %s\n", Output.c_str());
+    return 1;
+  }
+  CBIRunsHeader Header = {};
+  memcpy(Header.Magic, CBI_RUNS_MAGIC, sizeof(Header.Magic));
+  Header.Version = CBI_RUNS_VERSION;
+  Header.NumSites = NumSites;
+  fwrite(&Header, sizeof(Header), 1, Out);
+  for (auto &R : Runs) {
+    uint8_t Outcome = R.Expected;
+    fwrite(&Outcome, 1, 1, Out);
+    fwrite(R.Sites.data(), 1, R.Sites.size(), Out);
+  }
+  fclose(Out);
+
+  fprintf(stderr, "Collected %zu runs of %u sites into %s\n", Runs.size(),
+          NumSites, Output.c_str());
+  if (Unexpected)
+    fprintf(stderr, "%zu runs did not exit with the expected code\n",
+            Unexpected);
+  if (Missing)
+    fprintf(stderr,
+            "%zu runs left no counters, was %s built with -cbi-counters?\n",
+            Missing, Target.c_str());
+  return 0;
+}
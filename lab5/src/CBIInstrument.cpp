@@ -1,4 +1,17 @@
 #include "CBIInstrument.h"
+#include "CBISampling.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
 
 using namespace llvm;
 
@@ -8,6 +21,78 @@ const auto PASS_NAME = "CBIInstrument";
 const auto PASS_DESC = "Instrumentation for CBI";
 const auto CBI_BRANCH_FUNCTION_NAME = "__cbi_branch__";
 const auto CBI_RETURN_FUNCTION_NAME = "__cbi_return__";
+const auto CBI_SAMPLE_BRANCH_FUNCTION_NAME = "__cbi_sample_branch__";
+const auto CBI_SAMPLE_RETURN_FUNCTION_NAME = "__cbi_sample_return__";
+const auto CBI_COUNTDOWN_VARIABLE_NAME = "__cbi_countdown__";
+const auto CBI_BRANCH_COUNT_FUNCTION_NAME = "__cbi_branch_count__";
+const auto CBI_RETURN_COUNT_FUNCTION_NAME = "__cbi_return_count__";
+const auto CBI_SAMPLE_BRANCH_COUNT_FUNCTION_NAME =
+    "__cbi_sample_branch_count__";
+const auto CBI_SAMPLE_RETURN_COUNT_FUNCTION_NAME =
+    "__cbi_sample_return_count__";
+const auto CBI_RETURN64_COUNT_FUNCTION_NAME = "__cbi_return64_count__";
+const auto CBI_PAIR_COUNT_FUNCTION_NAME = "__cbi_pair_count__";
+const auto CBI_FLOAT_COUNT_FUNCTION_NAME = "__cbi_float_count__";
+const auto CBI_SAMPLE_RETURN64_COUNT_FUNCTION_NAME =
+    "__cbi_sample_return64_count__";
+const auto CBI_SAMPLE_PAIR_COUNT_FUNCTION_NAME = "__cbi_sample_pair_count__";
+const auto CBI_SAMPLE_FLOAT_COUNT_FUNCTION_NAME = "__cbi_sample_float_count__";
+const auto CBI_INIT_COUNTERS_FUNCTION_NAME = "__cbi_init_counters__";
+
+/**
+ * With -cbi-sampling, every function is split into an uninstrumented fast
+ * path and an instrumented slow path, and predicates are only observed when
+ * the runtime's countdown expires (CBI_SAMPLING_RATE, 1/100 by default).
+ */
+static cl::opt<bool> Sampling("cbi-sampling",
+                              cl::desc("Sample CBI predicates with fast and "
+                                       "slow paths"));
+
+/**
+ * With -cbi-counters, sites are numbered and the runtime only counts the
+ * outcomes of every site, writing one record per run to <exe>.cbi.bin
+ * instead of one JSON line per executed site.
+ */
+static cl::opt<bool> Counters("cbi-counters",
+                              cl::desc("Count predicate outcomes per site "
+                                       "instead of logging every event"));
+
+static cl::list<Scheme> Schemes(
+    "cbi-schemes", cl::CommaSeparated,
+    cl::desc("CBI instrumentation schemes (default: branches,returns)"),
+    cl::values(clEnumValN(BranchScheme, "branches", "Conditional branches"),
+               clEnumValN(ReturnScheme, "returns", "Calls returning an int"),
+               clEnumValN(WideReturnScheme, "wide-returns",
+                          "Calls returning other integers or pointers"),
+               clEnumValN(ScalarPairScheme, "scalar-pairs",
+                          "Integer assignments against other locals"),
+               clEnumValN(FloatScheme, "floats",
+                          "Sign of floating point values")));
+
+static bool hasScheme(Scheme S) {
+  if (Schemes.empty())
+    return S == BranchScheme || S == ReturnScheme;
+  return std::find(Schemes.begin(), Schemes.end(), S) != Schemes.end();
+}
+
+static cl::opt<std::string>
+    SiteTable("cbi-site-table",
+              cl::desc("Path of the site table written with -cbi-counters "
+                       "(default: <module>.cbi.sites)"),
+              cl::value_desc("filename"));
+
+/**
+ * @brief Get the default site table path for M: test1.ll -> test1.cbi.sites
+ */
+static std::string getSiteTablePath(Module &M) {
+  if (!SiteTable.empty())
+    return SiteTable;
+  std::string Path = M.getModuleIdentifier();
+  auto Dot = Path.find_last_of('.');
+  if (Dot != std::string::npos && Path.find('/', Dot) == std::string::npos)
+    Path = Path.substr(0, Dot);
+  return Path + ".cbi.sites";
+}
 
 /**
  * @brief Instrument a BranchInst with calls to __cbi_branch__
@@ -16,8 +101,10 @@ const auto CBI_RETURN_FUNCTION_NAME = "__cbi_return__";
  * @param Branch A conditional Branch Instruction
  * @param Line Line number of Branch
  * @param Col Coulmn number of Branch
+ * @param Hook Function to call
  */
-void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col);
+void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col,
+                      Function *Hook);
 
 /**
  * @brief Instrument the return value of CallInst using calls to __cbi_return__
@@ -26,37 +113,253 @@ void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col);
  * @param Call A Call instruction that returns an Int32.
  * @param Line Line number of the Call
  * @param Col Column number of the Call
+ * @param Hook Function to call
  */
-void instrumentReturn(Module *M, CallInst *Call, int Line, int Col);
+void instrumentReturn(Module *M, CallInst *Call, int Line, int Col,
+                      Function *Hook);
 
-bool CBIInstrument::runOnFunction(Function &F) {
-  auto FunctionName = F.getName().str();
-  outs() << "Running " << PASS_DESC << " on function " << FunctionName << "\n";
+/**
+ * @brief Instrument a site with a call to Hook(Id, value), where value is
+ * the branch condition, the returned or the stored value. Scalar pairs also
+ * pass the value of the other local. Wide returns and scalar pairs pass
+ * int64s, floats a double. Unsigned values are zero-extended, and the
+ * unsigned ones of 64 bits mapped to int64s that keep their sign (wide
+ * returns) or their order (scalar pairs).
+ *
+ * @param M Module containing Site
+ * @param Site The site as collected
+ * @param Copy Where to instrument Site, its slow path copy when sampling
+ * @param Id Dense id of Site
+ * @param Hook Function to call
+ */
+void instrumentCounter(Module *M, const CBISite &Site, Instruction *Copy,
+                       unsigned Id, Function *Hook) {
+  if (auto *Branch = dyn_cast<BranchInst>(Copy)) {
+    IRBuilder<> Builder(Branch);
+    Value *Args[] = {Builder.getInt32(Id), Branch->getCondition()};
+    Builder.CreateCall(Hook, Args);
+    return;
+  }
+  IRBuilder<> Builder(Copy->getNextNode());
+  Type *Int64Type = Builder.getInt64Ty();
+  Value *Val = Copy;
+  if (auto *Store = dyn_cast<StoreInst>(Copy))
+    Val = Store->getValueOperand();
+  Value *Args[3] = {Builder.getInt32(Id)};
+  unsigned NumArgs = 2;
+  switch (Site.Kind) {
+  case BranchScheme:
+  case ReturnScheme:
+    Args[1] = Val;
+    break;
+  case WideReturnScheme:
+    if (Val->getType()->isPointerTy()) {
+      Args[1] = Builder.CreatePtrToInt(Val, Int64Type);
+    } else {
+      Args[1] = Builder.CreateIntCast(
+          Val, Int64Type, !Site.Unsigned && !Val->getType()->isIntegerTy(1));
+      // An unsigned int64 is never negative.
+      if (Site.Unsigned && Val->getType()->isIntegerTy(64))
+        Args[1] = Builder.CreateSelect(
+            Builder.CreateICmpSLT(Args[1], Builder.getInt64(0)),
+            Builder.getInt64(INT64_MAX), Args[1]);
+    }
+    break;
+  case ScalarPairScheme: {
+    Value *Other =
+        Builder.CreateLoad(Site.Other->getAllocatedType(), Site.Other);
+    Args[1] = Builder.CreateIntCast(Val, Int64Type, !Site.Unsigned);
+    Args[2] = Builder.CreateIntCast(Other, Int64Type, !Site.Unsigned);
+    // Flipping the sign bit turns the unsigned order into the signed one.
+    if (Site.Unsigned && Val->getType()->isIntegerTy(64)) {
+      Args[1] = Builder.CreateXor(Args[1], Builder.getInt64(INT64_MIN));
+      Args[2] = Builder.CreateXor(Args[2], Builder.getInt64(INT64_MIN));
+    }
+    NumArgs = 3;
+    break;
+  }
+  case FloatScheme:
+    Args[1] = Builder.CreateFPCast(Val, Builder.getDoubleTy());
+    break;
+  }
+  Builder.CreateCall(Hook, makeArrayRef(Args, NumArgs));
+}
+
+/**
+ * @brief Name of the counter hook of a scheme.
+ */
+static const char *counterHook(Scheme Kind, bool Sampled) {
+  switch (Kind) {
+  case BranchScheme:
+    return Sampled ? CBI_SAMPLE_BRANCH_COUNT_FUNCTION_NAME
+                   : CBI_BRANCH_COUNT_FUNCTION_NAME;
+  case ReturnScheme:
+    return Sampled ? CBI_SAMPLE_RETURN_COUNT_FUNCTION_NAME
+                   : CBI_RETURN_COUNT_FUNCTION_NAME;
+  case WideReturnScheme:
+    return Sampled ? CBI_SAMPLE_RETURN64_COUNT_FUNCTION_NAME
+                   : CBI_RETURN64_COUNT_FUNCTION_NAME;
+  case ScalarPairScheme:
+    return Sampled ? CBI_SAMPLE_PAIR_COUNT_FUNCTION_NAME
+                   : CBI_PAIR_COUNT_FUNCTION_NAME;
+  case FloatScheme:
+    return Sampled ? CBI_SAMPLE_FLOAT_COUNT_FUNCTION_NAME
+                   : CBI_FLOAT_COUNT_FUNCTION_NAME;
+  }
+  return nullptr;
+}
 
-  LLVMContext &Context = F.getContext();
-  Module *M = F.getParent();
+/**
+ * @brief Kind of a site in the site table, wide returns are returns.
+ */
+static const char *siteTableKind(Scheme Kind) {
+  switch (Kind) {
+  case BranchScheme:
+    return "branch";
+  case ReturnScheme:
+  case WideReturnScheme:
+    return "return";
+  case ScalarPairScheme:
+    return "scalar-pair";
+  case FloatScheme:
+    return "float";
+  }
+  return nullptr;
+}
 
-  Type *VoidType = Type::getVoidTy(Context);
-  Type *Int32Type = Type::getInt32Ty(Context);
-  Type *BoolType = Type::getInt1Ty(Context);
+/**
+ * @brief Is Var declared and in scope at Loc?
+ */
+static bool inScope(const DILocalVariable *Var, const DebugLoc &Loc) {
+  if (Var->getLine() > Loc.getLine())
+    return false;
+  auto *Scope = dyn_cast_or_null<DILocalScope>(Loc.getScope());
+  while (Scope) {
+    if (Scope == Var->getScope())
+      return true;
+    auto *Block = dyn_cast<DILexicalBlockBase>(Scope);
+    Scope = Block ? Block->getScope() : nullptr;
+  }
+  return false;
+}
+
+/**
+ * @brief Is Ty an unsigned integer (or bool) type, through typedefs and
+ * qualifiers?
+ */
+static bool isUnsignedType(const DIType *Ty) {
+  while (auto *Derived = dyn_cast_or_null<DIDerivedType>(Ty)) {
+    unsigned Tag = Derived->getTag();
+    if (Tag != dwarf::DW_TAG_typedef && Tag != dwarf::DW_TAG_const_type &&
+        Tag != dwarf::DW_TAG_volatile_type)
+      return false;
+    Ty = Derived->getBaseType();
+  }
+  auto *Basic = dyn_cast_or_null<DIBasicType>(Ty);
+  if (!Basic)
+    return false;
+  unsigned Encoding = Basic->getEncoding();
+  return Encoding == dwarf::DW_ATE_unsigned ||
+         Encoding == dwarf::DW_ATE_unsigned_char ||
+         Encoding == dwarf::DW_ATE_boolean;
+}
+
+/**
+ * @brief Does Call return an unsigned integer? From the debug information
+ * of the callee, else from its zeroext return attribute.
+ */
+static bool returnsUnsigned(const CallInst *Call) {
+  const Function *Callee = Call->getCalledFunction();
+  const DISubprogram *Sub = Callee ? Callee->getSubprogram() : nullptr;
+  if (Sub && Sub->getType() && Sub->getType()->getTypeArray().size() > 0)
+    return isUnsignedType(Sub->getType()->getTypeArray()[0]);
+  return Call->hasRetAttr(Attribute::ZExt);
+}
 
-  M->getOrInsertFunction(CBI_BRANCH_FUNCTION_NAME, VoidType, Int32Type,
-                         Int32Type, BoolType);
+typedef std::vector<std::pair<AllocaInst *, DILocalVariable *>> LocalList;
 
-  M->getOrInsertFunction(CBI_RETURN_FUNCTION_NAME, VoidType, Int32Type,
-                         Int32Type, Int32Type);
+/**
+ * @brief Collect the sites of the counter-only schemes at Inst: wide
+ * returns, scalar pairs and floats.
+ *
+ * @param Locals Source level locals of the function of Inst
+ */
+static void collectCounterSites(Instruction &Inst, const LocalList &Locals,
+                                std::vector<CBISite> &Sites) {
+  if (auto *Call = dyn_cast<CallInst>(&Inst)) {
+    if (isa<IntrinsicInst>(Call))
+      return;
+    Type *Ty = Call->getType();
+    if (hasScheme(WideReturnScheme) &&
+        ((Ty->isIntegerTy() && !Ty->isIntegerTy(32)) || Ty->isPointerTy())) {
+      Sites.emplace_back(Call, WideReturnScheme);
+      Sites.back().Unsigned = returnsUnsigned(Call);
+    }
+    if (hasScheme(FloatScheme) && Ty->isFloatingPointTy())
+      Sites.emplace_back(Call, FloatScheme);
+    return;
+  }
+  auto *Store = dyn_cast<StoreInst>(&Inst);
+  if (!Store)
+    return;
+  auto Local = std::find_if(Locals.begin(), Locals.end(),
+                            [&](const LocalList::value_type &L) {
+                              return L.first == Store->getPointerOperand();
+                            });
+  if (Local == Locals.end())
+    return;
+  Type *Ty = Store->getValueOperand()->getType();
+  if (hasScheme(FloatScheme) && Ty->isFloatingPointTy())
+    Sites.emplace_back(Store, FloatScheme);
+  if (!hasScheme(ScalarPairScheme) || !Ty->isIntegerTy())
+    return;
+  for (auto &Other : Locals) {
+    if (Other.first == Local->first ||
+        Other.first->getAllocatedType() != Ty ||
+        !inScope(Other.second, Store->getDebugLoc()))
+      continue;
+    CBISite Site(Store, ScalarPairScheme);
+    Site.Other = Other.first;
+    Site.Names =
+        Local->second->getName().str() + " " + Other.second->getName().str();
+    Site.Unsigned = isUnsignedType(Local->second->getType()) ||
+                    isUnsignedType(Other.second->getType());
+    Sites.push_back(Site);
+  }
+}
 
+/**
+ * @brief Collect the CBI sites of F with debug information, in the order
+ * of their ids: conditional branches and calls returning an int, then with
+ * -cbi-counters the sites of the other selected schemes. Functions and hot
+ * blocks left out by Selected have no sites.
+ */
+static void collectSites(Function &F, const Selection &Selected,
+                         std::vector<CBISite> &Sites) {
+  if (!Selected.shouldInstrument(F))
+    return;
+  Type *Int32Type = Type::getInt32Ty(F.getContext());
+  // Source level locals, in declaration order.
+  LocalList Locals;
+  for (auto &Inst : instructions(F)) {
+    if (auto *Declare = dyn_cast<DbgDeclareInst>(&Inst)) {
+      if (auto *Alloca = dyn_cast_or_null<AllocaInst>(Declare->getAddress()))
+        Locals.push_back(std::make_pair(Alloca, Declare->getVariable()));
+    }
+  }
+  DenseSet<const BasicBlock *> Hot;
+  for (auto &BB : F) {
+    if (Selected.isHot(BB))
+      Hot.insert(&BB);
+  }
   for (inst_iterator Iter = inst_begin(F), E = inst_end(F); Iter != E; ++Iter) {
     Instruction &Inst = (*Iter);
     llvm::DebugLoc DebugLoc = Inst.getDebugLoc();
-    if (!DebugLoc) {
-      // Skip Instruction if it doesn't have debug information.
+    if (!DebugLoc || Hot.count(Inst.getParent())) {
+      // Skip Instruction if it doesn't have debug information or is hot.
       continue;
     }
 
-    int Line = DebugLoc.getLine();
-    int Col = DebugLoc.getCol();
-
     /**
      * TODO: Add code to check the type of instruction
      * and call appropriate instrumentation function.
@@ -70,25 +373,214 @@ bool CBIInstrument::runOnFunction(Function &F) {
     //Here we are trying to catch the branch/CallInst instructions and call the corresponding function to instrument
     //try cast current instruction to branch
     if(auto *branch = dyn_cast<BranchInst>(&Inst) ){
-      if( branch->isConditional()){
-        instrumentBranch(M,branch,Line,Col);
+      if( branch->isConditional() && hasScheme(BranchScheme)){
+        Sites.emplace_back(branch, BranchScheme);
       }
       
     }
     //try cast current instruction to CallIst
 
     if(auto *Call = dyn_cast<CallInst>(&Inst)){
-      instrumentReturn(M,Call,Line,Col);
+      if (Call->getType() == Int32Type && hasScheme(ReturnScheme))
+        Sites.emplace_back(Call, ReturnScheme);
+    }
+
+    if (Counters)
+      collectCounterSites(Inst, Locals, Sites);
+
+  }
+}
+
+/**
+ * @brief Declare the counter hooks of every scheme in M.
+ *
+ * @param Hooks Set to the hook of every scheme
+ */
+static void declareCounterHooks(Module &M, bool Sampled,
+                                Function *Hooks[NumSchemes]) {
+  LLVMContext &Context = M.getContext();
+  Type *VoidType = Type::getVoidTy(Context);
+  Type *Int32Type = Type::getInt32Ty(Context);
+  Type *Int64Type = Type::getInt64Ty(Context);
+  M.getOrInsertFunction(counterHook(BranchScheme, Sampled), VoidType,
+                        Int32Type, Type::getInt1Ty(Context));
+  M.getOrInsertFunction(counterHook(ReturnScheme, Sampled), VoidType,
+                        Int32Type, Int32Type);
+  M.getOrInsertFunction(counterHook(WideReturnScheme, Sampled), VoidType,
+                        Int32Type, Int64Type);
+  M.getOrInsertFunction(counterHook(ScalarPairScheme, Sampled), VoidType,
+                        Int32Type, Int64Type, Int64Type);
+  M.getOrInsertFunction(counterHook(FloatScheme, Sampled), VoidType,
+                        Int32Type, Type::getDoubleTy(Context));
+  for (unsigned Kind = 0; Kind < NumSchemes; ++Kind)
+    Hooks[Kind] = M.getFunction(counterHook((Scheme)Kind, Sampled));
+}
+
+CBIInstrumenter::CBIInstrumenter(Module &M) : M(M) {
+  Selected.load(M);
+  LLVMContext &Context = M.getContext();
+  Type *VoidType = Type::getVoidTy(Context);
+  Type *Int32Type = Type::getInt32Ty(Context);
+  Type *BoolType = Type::getInt1Ty(Context);
+
+  if (!Counters) {
+    if (hasScheme(WideReturnScheme) || hasScheme(ScalarPairScheme) ||
+        hasScheme(FloatScheme))
+      errs() << "wide-returns, scalar-pairs and floats are only counted, "
+                "ignored without -cbi-counters\n";
+  } else {
+    std::string Path = getSiteTablePath(M);
+    std::ofstream Table(Path);
+    if (!Table)
+      errs() << "Cannot write site table " << Path << "\n";
+    Table << "# kind id line col [var other]\n";
+    unsigned NumSites = 0;
+    for (auto &F : M) {
+      Sites.clear();
+      collectSites(F, Selected, Sites);
+      FirstSiteIds[&F] = NumSites;
+      for (auto &Site : Sites) {
+        const DebugLoc &Loc = Site.Inst->getDebugLoc();
+        Table << siteTableKind(Site.Kind) << " " << NumSites++ << " "
+              << Loc.getLine() << " " << Loc.getCol();
+        if (!Site.Names.empty())
+          Table << " " << Site.Names;
+        Table << "\n";
+      }
     }
 
+    // Tell the runtime how many counters to allocate before main runs.
+    M.getOrInsertFunction(CBI_INIT_COUNTERS_FUNCTION_NAME, VoidType,
+                          Int32Type);
+    auto *Init = Function::Create(FunctionType::get(VoidType, false),
+                                  GlobalValue::InternalLinkage, "cbi.init", &M);
+    auto *Entry = BasicBlock::Create(Context, "entry", Init);
+    Value *Args[] = {ConstantInt::get(Int32Type, NumSites)};
+    CallInst::Create(M.getFunction(CBI_INIT_COUNTERS_FUNCTION_NAME), Args, "",
+                     Entry);
+    ReturnInst::Create(Context, Entry);
+    appendToGlobalCtors(M, Init, 0);
+  }
+
+  M.getOrInsertFunction(CBI_BRANCH_FUNCTION_NAME, VoidType, Int32Type,
+                        Int32Type, BoolType);
+  M.getOrInsertFunction(CBI_RETURN_FUNCTION_NAME, VoidType, Int32Type,
+                        Int32Type, Int32Type);
+  BranchHook = M.getFunction(CBI_BRANCH_FUNCTION_NAME);
+  ReturnHook = M.getFunction(CBI_RETURN_FUNCTION_NAME);
+  if (Counters)
+    declareCounterHooks(M, false, CounterHooks[0]);
+
+  if (!Sampling)
+    return;
+  if (Counters) {
+    declareCounterHooks(M, true, CounterHooks[1]);
+  } else {
+    M.getOrInsertFunction(CBI_SAMPLE_BRANCH_FUNCTION_NAME, VoidType,
+                          Int32Type, Int32Type, BoolType);
+    M.getOrInsertFunction(CBI_SAMPLE_RETURN_FUNCTION_NAME, VoidType,
+                          Int32Type, Int32Type, Int32Type);
+    SampleBranchHook = M.getFunction(CBI_SAMPLE_BRANCH_FUNCTION_NAME);
+    SampleReturnHook = M.getFunction(CBI_SAMPLE_RETURN_FUNCTION_NAME);
+  }
+  Countdown = cast<GlobalVariable>(
+      M.getOrInsertGlobal(CBI_COUNTDOWN_VARIABLE_NAME, Int32Type));
+  Countdown->setThreadLocal(true);
+}
+
+/**
+ * @brief Instrument Sites[I], as collected, at Copy (its slow path copy
+ * when sampling).
+ */
+void CBIInstrumenter::instrumentSite(size_t I, Instruction *Copy,
+                                     bool Sampled, unsigned FirstId) {
+  const CBISite &Site = Sites[I];
+  if (Counters) {
+    instrumentCounter(&M, Site, Copy, FirstId + I,
+                      CounterHooks[Sampled][Site.Kind]);
+    return;
   }
+  const DebugLoc &Loc = Site.Inst->getDebugLoc();
+  if (auto *Branch = dyn_cast<BranchInst>(Copy))
+    instrumentBranch(&M, Branch, Loc.getLine(), Loc.getCol(),
+                     Sampled ? SampleBranchHook : BranchHook);
+  else
+    instrumentReturn(&M, cast<CallInst>(Copy), Loc.getLine(), Loc.getCol(),
+                     Sampled ? SampleReturnHook : ReturnHook);
+}
+
+bool CBIInstrumenter::instrumentFunction(Function &F) {
+  if (F.isDeclaration())
+    return false;
+  auto FunctionName = F.getName().str();
+  outs() << "Running " << PASS_DESC << " on function " << FunctionName << "\n";
+
+  if (!Selected.shouldInstrument(F))
+    return false;
+
+  Sites.clear();
+  collectSites(F, Selected, Sites);
+  unsigned FirstId = FirstSiteIds.lookup(&F);
+
+  if (Sampling) {
+    // A store with several scalar pairs is listed once per pair, so that
+    // every hook call counts down once.
+    std::vector<Instruction *> Insts;
+    for (auto &Site : Sites)
+      Insts.push_back(Site.Inst);
+    auto InstrumentSampled = [&](size_t I, Instruction *Copy) {
+      instrumentSite(I, Copy, true, FirstId);
+    };
+    if (!cloneForSampling(F, Insts, Countdown, InstrumentSampled)) {
+      // No fast path, but predicates are still only sampled.
+      for (size_t I = 0; I < Sites.size(); ++I)
+        instrumentSite(I, Sites[I].Inst, true, FirstId);
+    }
+    return true;
+  }
+
+  for (size_t I = 0; I < Sites.size(); ++I)
+    instrumentSite(I, Sites[I].Inst, false, FirstId);
+  return true;
+}
+
+bool CBIInstrumenter::instrumentModule() {
+  bool Changed = false;
+  for (auto &F : M)
+    Changed |= instrumentFunction(F);
+  return Changed;
+}
+
+bool CBIInstrument::doInitialization(Module &M) {
+  Impl.reset(new CBIInstrumenter(M));
   return true;
 }
 
+bool CBIInstrument::runOnFunction(Function &F) {
+  return Impl->instrumentFunction(F);
+}
+
+bool CBIInstrument::doFinalization(Module &M) {
+  Impl.reset();
+  return false;
+}
+
+bool CBIInstrumentModule::runOnModule(Module &M) {
+  return CBIInstrumenter(M).instrumentModule();
+}
+
+PreservedAnalyses CBIInstrumentPass::run(Module &M,
+                                         ModuleAnalysisManager &MAM) {
+  if (!CBIInstrumenter(M).instrumentModule())
+    return PreservedAnalyses::all();
+  return PreservedAnalyses::none();
+}
+
 /**
  * Implement instrumentation for the branch scheme of CBI. (Lab 9)
  */
-void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col) {
+void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col,
+                      Function *Hook) {
   auto &Context = M->getContext();
   auto Int32Type = Type::getInt32Ty(Context);
   auto *BoolType = Type::getInt1Ty(Context);
@@ -101,10 +593,8 @@ void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col) {
   auto LineVal = ConstantInt::get(Int32Type, Line);
   auto ColVal = ConstantInt::get(Int32Type, Col);
   //Fill all parameters into an Args.
-  std::vector<Value *> Args = {LineVal,ColVal,condition};
-  //Register the fucntion into the Modole
-  auto *BranchFunction = M->getFunction(CBI_BRANCH_FUNCTION_NAME);
-  CallInst::Create(BranchFunction, Args,"",Branch);
+  Value *Args[] = {LineVal,ColVal,condition};
+  CallInst::Create(Hook, Args,"",Branch);
   
 
 }
@@ -112,7 +602,8 @@ void instrumentBranch(Module *M, BranchInst *Branch, int Line, int Col) {
 /**
  * Implement instrumentation for the return scheme of CBI. (Lab 9)
  */
-void instrumentReturn(Module *M, CallInst *Call, int Line, int Col) {
+void instrumentReturn(Module *M, CallInst *Call, int Line, int Col,
+                      Function *Hook) {
   auto &Context = M->getContext();
   auto *Int32Type = Type::getInt32Ty(Context);
   
@@ -130,10 +621,8 @@ void instrumentReturn(Module *M, CallInst *Call, int Line, int Col) {
   auto LineVal = ConstantInt::get(Int32Type, Line);
   auto ColVal = ConstantInt::get(Int32Type, Col);
   //Fill all parameters into an Args.
-  std::vector<Value *> Args = {LineVal,ColVal,Call};
-  //Register the fucntion into the Modole
-  auto *ReturnFunction = M->getFunction(CBI_RETURN_FUNCTION_NAME);
-  CallInst::Create(ReturnFunction, Args,"",nextFunc);}
+  Value *Args[] = {LineVal,ColVal,Call};
+  CallInst::Create(Hook, Args,"",nextFunc);}
 
 }
 
@@ -141,4 +630,23 @@ void instrumentReturn(Module *M, CallInst *Call, int Line, int Col) {
 char CBIInstrument::ID = 1;
 static RegisterPass<CBIInstrument> X(PASS_NAME, PASS_DESC, false, false);
 
+char CBIInstrumentModule::ID = 2;
+static RegisterPass<CBIInstrumentModule>
+    Y("CBIInstrumentModule", "Instrumentation for CBI (module pass)", false,
+      false);
+
 } // namespace instrument
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "CBIInstrument", "v0.1",
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "cbi-instrument")
+                    return false;
+                  MPM.addPass(instrument::CBIInstrumentPass());
+                  return true;
+                });
+          }};
+}
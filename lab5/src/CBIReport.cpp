@@ -0,0 +1,443 @@
+#include "CBIReport.h"
+#include "CBIRuns.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <sstream>
+#include <tuple>
+
+namespace cbi {
+
+void Bitset::setAll() {
+  std::fill(Words.begin(), Words.end(), ~uint64_t(0));
+  if (Size % 64)
+    Words.back() = (uint64_t(1) << (Size % 64)) - 1;
+}
+
+uint64_t Bitset::count() const {
+  uint64_t Count = 0;
+  for (uint64_t Word : Words)
+    Count += __builtin_popcountll(Word);
+  return Count;
+}
+
+uint64_t Bitset::countAnd(const Bitset &Other,
+                          const std::vector<size_t> &Indices) const {
+  uint64_t Count = 0;
+  for (size_t I : Indices)
+    Count += __builtin_popcountll(Words[I] & Other.Words[I]);
+  return Count;
+}
+
+std::vector<size_t> Bitset::nonZeroWords() const {
+  std::vector<size_t> Indices;
+  for (size_t I = 0; I < Words.size(); ++I) {
+    if (Words[I])
+      Indices.push_back(I);
+  }
+  return Indices;
+}
+
+uint64_t Bitset::countAnd(const Bitset &Other) const {
+  uint64_t Count = 0;
+  size_t N = std::min(Words.size(), Other.Words.size());
+  for (size_t I = 0; I < N; ++I)
+    Count += __builtin_popcountll(Words[I] & Other.Words[I]);
+  return Count;
+}
+
+Bitset Bitset::operator&(const Bitset &Other) const {
+  Bitset Result(std::min(Size, Other.Size));
+  for (size_t I = 0; I < Result.Words.size(); ++I)
+    Result.Words[I] = Words[I] & Other.Words[I];
+  return Result;
+}
+
+Bitset &Bitset::operator-=(const Bitset &Other) {
+  size_t N = std::min(Words.size(), Other.Words.size());
+  for (size_t I = 0; I < N; ++I)
+    Words[I] &= ~Other.Words[I];
+  return *this;
+}
+
+bool readSiteTable(const std::string &Path, std::vector<Site> &Sites) {
+  std::ifstream Table(Path);
+  if (!Table)
+    return false;
+  std::string Line;
+  while (std::getline(Table, Line)) {
+    if (Line.empty() || Line[0] == '#')
+      continue;
+    std::istringstream Fields(Line);
+    Site S;
+    size_t Id;
+    if (!(Fields >> S.Kind >> Id >> S.Line >> S.Col))
+      return false;
+    Fields >> S.Var >> S.Other;
+    if (Id >= Sites.size())
+      Sites.resize(Id + 1);
+    Sites[Id] = S;
+  }
+  return true;
+}
+
+int numOutcomes(const Site &S) { return S.Kind == "branch" ? 2 : 3; }
+
+std::string predicateType(const Site &S, int Outcome) {
+  static const char *Branch[] = {"BranchFalse", "BranchTrue"};
+  static const char *Return[] = {"ReturnNegative", "ReturnZero",
+                                 "ReturnPositive"};
+  static const char *Pair[] = {"ScalarLess", "ScalarEqual", "ScalarGreater"};
+  static const char *Float[] = {"FloatNegative", "FloatZero",
+                                "FloatPositive"};
+  if (S.Kind == "branch")
+    return Branch[Outcome];
+  if (S.Kind == "scalar-pair")
+    return std::string(Pair[Outcome]) + "(" + S.Var + ", " + S.Other + ")";
+  if (S.Kind == "float")
+    return Float[Outcome];
+  return Return[Outcome];
+}
+
+bool ObservationMatrix::load(const std::string &Path) {
+  FILE *In = fopen(Path.c_str(), "rb");
+  if (!In)
+    return false;
+  CBIRunsHeader Header;
+  if (fread(&Header, sizeof(Header), 1, In) != 1 ||
+      memcmp(Header.Magic, CBI_RUNS_MAGIC, sizeof(Header.Magic)) ||
+      Header.Version != CBI_RUNS_VERSION) {
+    fclose(In);
+    return false;
+  }
+  NumSites = Header.NumSites;
+  fseek(In, 0, SEEK_END);
+  size_t RecordSize = NumSites + 1;
+  NumRuns = (ftell(In) - sizeof(Header)) / RecordSize;
+  fseek(In, sizeof(Header), SEEK_SET);
+
+  Succeeded = Failed = Bitset(NumRuns);
+  Observed.assign(NumSites, Bitset());
+  True.assign(NumSites * 3, Bitset());
+  // Transpose 64 runs at a time, so every bitset word is written once.
+  std::vector<uint8_t> Records(64 * RecordSize);
+  for (size_t Base = 0; Base < NumRuns; Base += 64) {
+    size_t Count = std::min<size_t>(64, NumRuns - Base);
+    if (fread(Records.data(), RecordSize, Count, In) != Count) {
+      fclose(In);
+      return false;
+    }
+    size_t Word = Base / 64;
+    uint64_t FailedWord = 0, SucceededWord = 0;
+    for (size_t Run = 0; Run < Count; ++Run) {
+      uint64_t Bit = uint64_t(1) << Run;
+      if (Records[Run * RecordSize] == CBI_RUN_FAILURE)
+        FailedWord |= Bit;
+      else
+        SucceededWord |= Bit;
+    }
+    Failed.setWord(Word, FailedWord);
+    Succeeded.setWord(Word, SucceededWord);
+
+    for (size_t Id = 0; Id < NumSites; ++Id) {
+      uint64_t ObservedWord = 0, TrueWords[3] = {0, 0, 0};
+      for (size_t Run = 0; Run < Count; ++Run) {
+        uint8_t Mask = Records[Run * RecordSize + Id + 1];
+        if (!Mask)
+          continue;
+        uint64_t Bit = uint64_t(1) << Run;
+        ObservedWord |= Bit;
+        for (int Outcome = 0; Outcome < 3; ++Outcome) {
+          if (Mask >> Outcome & 1)
+            TrueWords[Outcome] |= Bit;
+        }
+      }
+      if (!ObservedWord)
+        continue;
+      if (Observed[Id].empty()) {
+        Observed[Id] = Bitset(NumRuns);
+        for (int Outcome = 0; Outcome < 3; ++Outcome)
+          True[Id * 3 + Outcome] = Bitset(NumRuns);
+      }
+      Observed[Id].setWord(Word, ObservedWord);
+      for (int Outcome = 0; Outcome < 3; ++Outcome)
+        True[Id * 3 + Outcome].setWord(Word, TrueWords[Outcome]);
+    }
+  }
+  fclose(In);
+  return true;
+}
+
+void scorePredicates(const ObservationMatrix &Matrix,
+                     const std::vector<Site> &Sites, const Bitset &Live,
+                     std::vector<PredicateInfo> &Infos) {
+  Infos.clear();
+  Bitset LiveSucceeded = Matrix.Succeeded & Live;
+  Bitset LiveFailed = Matrix.Failed & Live;
+  for (size_t Id = 0; Id < Matrix.NumSites && Id < Sites.size(); ++Id) {
+    const Bitset &Observed = Matrix.Observed[Id];
+    if (Observed.empty())
+      continue;
+    uint64_t SObs = Observed.countAnd(LiveSucceeded);
+    uint64_t FObs = Observed.countAnd(LiveFailed);
+    if (!SObs && !FObs)
+      continue;
+    for (int Outcome = 0; Outcome < numOutcomes(Sites[Id]); ++Outcome) {
+      PredicateInfo Info;
+      Info.SiteId = Id;
+      Info.Outcome = Outcome;
+      Info.S = Matrix.trueIn(Id, Outcome).countAnd(LiveSucceeded);
+      Info.F = Matrix.trueIn(Id, Outcome).countAnd(LiveFailed);
+      Info.SObs = SObs;
+      Info.FObs = FObs;
+      Infos.push_back(Info);
+    }
+  }
+  sortPredicates(Sites, Infos);
+}
+
+void sortPredicates(const std::vector<Site> &Sites,
+                    std::vector<PredicateInfo> &Infos) {
+  auto Key = [&](const PredicateInfo &Info) {
+    const Site &S = Sites[Info.SiteId];
+    return std::make_tuple(S.Line, S.Col, predicateType(S, Info.Outcome));
+  };
+  std::sort(Infos.begin(), Infos.end(),
+            [&](const PredicateInfo &A, const PredicateInfo &B) {
+              return Key(A) < Key(B);
+            });
+}
+
+double importance(const PredicateInfo &Info, uint64_t NumF) {
+  double Increase = Info.increase();
+  if (Increase <= 0 || Info.F == 0)
+    return 0;
+  double Sensitivity =
+      NumF > 1 ? std::log(double(Info.F)) / std::log(double(NumF)) : 1;
+  if (Sensitivity <= 0)
+    return 0;
+  return 2 / (1 / Increase + 1 / Sensitivity);
+}
+
+void eliminatePredicates(const ObservationMatrix &Matrix,
+                         const std::vector<Site> &Sites, size_t MaxPredictors,
+                         std::vector<Predictor> &Predictors) {
+  Predictors.clear();
+  Bitset Live(Matrix.NumRuns);
+  Live.setAll();
+  std::vector<PredicateInfo> Infos;
+  scorePredicates(Matrix, Sites, Live, Infos);
+  uint64_t NumF = Matrix.Failed.count();
+
+  // (importance, predicate), Current holds the up to date importance.
+  typedef std::pair<double, size_t> Entry;
+  std::priority_queue<Entry> Heap;
+  std::vector<double> Current(Infos.size());
+  for (size_t I = 0; I < Infos.size(); ++I) {
+    Current[I] = importance(Infos[I], NumF);
+    if (Current[I] > 0)
+      Heap.push(Entry(Current[I], I));
+  }
+
+  // Sites observed in every word of runs, and predicates of every site: a
+  // round only revisits the sites observed in the words it removes runs
+  // from.
+  std::vector<std::vector<size_t>> SitePredicates(Matrix.NumSites);
+  for (size_t I = 0; I < Infos.size(); ++I)
+    SitePredicates[Infos[I].SiteId].push_back(I);
+  std::vector<std::vector<size_t>> ByWord((Matrix.NumRuns + 63) / 64);
+  for (size_t Id = 0; Id < Matrix.NumSites; ++Id) {
+    if (SitePredicates[Id].empty())
+      continue;
+    for (size_t Word : Matrix.Observed[Id].nonZeroWords())
+      ByWord[Word].push_back(Id);
+  }
+  // Last round that revisited every site.
+  std::vector<size_t> Visited(Matrix.NumSites, SIZE_MAX);
+
+  while (Predictors.size() < MaxPredictors && !Heap.empty()) {
+    Entry Top = Heap.top();
+    Heap.pop();
+    if (Top.first != Current[Top.second])
+      continue;
+    const PredicateInfo &Best = Infos[Top.second];
+    Bitset Removed = Matrix.trueIn(Best.SiteId, Best.Outcome) & Live;
+    Bitset RemovedSucceeded = Removed & Matrix.Succeeded;
+    Bitset RemovedFailed = Removed & Matrix.Failed;
+    Predictor P;
+    P.Info = Best;
+    P.Importance = Top.first;
+    P.Explained = RemovedFailed.count();
+    size_t Round = Predictors.size();
+    Predictors.push_back(P);
+
+    Live -= Removed;
+    std::vector<size_t> Words = Removed.nonZeroWords();
+    for (size_t Word : Words) {
+      for (size_t Id : ByWord[Word]) {
+        if (Visited[Id] == Round)
+          continue;
+        Visited[Id] = Round;
+        const Bitset &Observed = Matrix.Observed[Id];
+        uint64_t SObs = Observed.countAnd(RemovedSucceeded, Words);
+        uint64_t FObs = Observed.countAnd(RemovedFailed, Words);
+        if (!SObs && !FObs)
+          continue;
+        for (size_t I : SitePredicates[Id]) {
+          PredicateInfo &Info = Infos[I];
+          const Bitset &True = Matrix.trueIn(Id, Info.Outcome);
+          Info.S -= True.countAnd(RemovedSucceeded, Words);
+          Info.F -= True.countAnd(RemovedFailed, Words);
+          Info.SObs -= SObs;
+          Info.FObs -= FObs;
+          double Importance = importance(Info, NumF);
+          if (Importance != Current[I]) {
+            Current[I] = Importance;
+            if (Importance > 0)
+              Heap.push(Entry(Importance, I));
+          }
+        }
+      }
+    }
+  }
+}
+
+namespace {
+
+/**
+ * Format like Python's repr of a float: the shortest digits that read back
+ * the same, and a ".0" for integral values.
+ */
+std::string formatFloat(double Value) {
+  char Buf[32];
+  for (int Precision = 1; Precision <= 17; ++Precision) {
+    snprintf(Buf, sizeof(Buf), "%.*g", Precision, Value);
+    if (strtod(Buf, nullptr) == Value)
+      break;
+  }
+  std::string Result = Buf;
+  if (Result.find_first_of(".en") == std::string::npos)
+    Result += ".0";
+  return Result;
+}
+
+/**
+ * The scores of cbi.py are the int 0 when their denominator is 0.
+ */
+std::string formatFailure(const PredicateInfo &Info) {
+  return Info.S + Info.F ? formatFloat(Info.failure()) : "0";
+}
+
+std::string formatContext(const PredicateInfo &Info) {
+  return Info.SObs + Info.FObs ? formatFloat(Info.context()) : "0";
+}
+
+std::string formatIncrease(const PredicateInfo &Info) {
+  return Info.S + Info.F || Info.SObs + Info.FObs
+             ? formatFloat(Info.increase())
+             : "0";
+}
+
+std::string formatPredicate(const Site &S, int Outcome) {
+  char Buf[256];
+  snprintf(Buf, sizeof(Buf), "Line %03d, Col %03d, %14s", S.Line, S.Col,
+           predicateType(S, Outcome).c_str());
+  return Buf;
+}
+
+} // namespace
+
+void writeReportJson(std::ostream &Out, const std::vector<Site> &Sites,
+                     const std::vector<PredicateInfo> &Infos) {
+  Out << "{\n    \"predicate_info_list\": [";
+  for (size_t I = 0; I < Infos.size(); ++I) {
+    const PredicateInfo &Info = Infos[I];
+    const Site &S = Sites[Info.SiteId];
+    Out << (I ? "," : "") << "\n        {\n"
+        << "            \"predicate\": {\n"
+        << "                \"line\": " << S.Line << ",\n"
+        << "                \"column\": " << S.Col << ",\n"
+        << "                \"pred_type\": \""
+        << predicateType(S, Info.Outcome) << "\"\n"
+        << "            },\n"
+        << "            \"num_true_in_success\": " << Info.S << ",\n"
+        << "            \"num_true_in_failure\": " << Info.F << ",\n"
+        << "            \"num_observed_in_success\": " << Info.SObs << ",\n"
+        << "            \"num_observed_in_failure\": " << Info.FObs << ",\n"
+        << "            \"failure\": " << formatFailure(Info) << ",\n"
+        << "            \"context\": " << formatContext(Info) << ",\n"
+        << "            \"increase\": " << formatIncrease(Info) << "\n"
+        << "        }";
+  }
+  Out << (Infos.empty() ? "]\n}" : "\n    ]\n}");
+}
+
+void printReport(std::ostream &Out, const std::vector<Site> &Sites,
+                 const std::vector<PredicateInfo> &Infos) {
+  struct Section {
+    const char *Title;
+    std::string (*Value)(const PredicateInfo &);
+  };
+  const Section Sections[] = {
+      {"S(P)", [](const PredicateInfo &I) { return std::to_string(I.S); }},
+      {"F(P)", [](const PredicateInfo &I) { return std::to_string(I.F); }},
+      {"Failure(P)", formatFailure},
+      {"Context(P)", formatContext},
+      {"Increase(P)", formatIncrease},
+  };
+  bool FirstSection = true;
+  for (auto &Sec : Sections) {
+    Out << (FirstSection ? "" : "\n") << "== " << Sec.Title << " ==\n";
+    FirstSection = false;
+    for (size_t I = 0; I < Infos.size(); ++I)
+      Out << (I ? "\n" : "")
+          << formatPredicate(Sites[Infos[I].SiteId], Infos[I].Outcome) << ": "
+          << Sec.Value(Infos[I]);
+  }
+  Out << "\n";
+}
+
+void printPredictors(std::ostream &Out, const std::vector<Site> &Sites,
+                     const std::vector<Predictor> &Predictors) {
+  Out << "== Predictors ==\n";
+  for (size_t I = 0; I < Predictors.size(); ++I) {
+    const Predictor &P = Predictors[I];
+    Out << I + 1 << ". "
+        << formatPredicate(Sites[P.Info.SiteId], P.Info.Outcome)
+        << ": Importance " << formatFloat(P.Importance) << ", Increase "
+        << formatIncrease(P.Info) << ", F " << P.Info.F << ", S "
+        << P.Info.S << ", explains " << P.Explained << " failing runs\n";
+  }
+}
+
+void printTopPredicates(std::ostream &Out, const std::vector<Site> &Sites,
+                        const std::vector<PredicateInfo> &Infos,
+                        uint64_t NumF, size_t N) {
+  typedef std::pair<double, const PredicateInfo *> Ranked;
+  std::vector<Ranked> Top;
+  for (auto &Info : Infos) {
+    double Importance = importance(Info, NumF);
+    if (Importance > 0)
+      Top.push_back(Ranked(Importance, &Info));
+  }
+  N = std::min(N, Top.size());
+  std::partial_sort(Top.begin(), Top.begin() + N, Top.end(),
+                    [](const Ranked &A, const Ranked &B) {
+                      return A.first > B.first;
+                    });
+  for (size_t I = 0; I < N; ++I) {
+    const PredicateInfo &Info = *Top[I].second;
+    Out << I + 1 << ". "
+        << formatPredicate(Sites[Info.SiteId], Info.Outcome)
+        << ": Importance " << formatFloat(Top[I].first) << ", Increase "
+        << formatIncrease(Info) << ", F " << Info.F << ", S " << Info.S
+        << "\n";
+  }
+}
+
+} // namespace cbi
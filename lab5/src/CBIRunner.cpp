@@ -0,0 +1,225 @@
+#include "CBIRunner.h"
+#include "CBICounters.h"
+#include "CBIForkServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace cbi {
+
+namespace {
+
+const int HELLO_TIMEOUT_MS = 10000;
+
+bool writeAll(int Fd, const void *Buf, size_t Len) {
+  auto *Ptr = static_cast<const char *>(Buf);
+  while (Len > 0) {
+    ssize_t Ret = write(Fd, Ptr, Len);
+    if (Ret < 0 && errno == EINTR)
+      continue;
+    if (Ret <= 0)
+      return false;
+    Ptr += Ret;
+    Len -= Ret;
+  }
+  return true;
+}
+
+/**
+ * Read exactly 4 bytes from Fd, waiting at most TimeoutMs (forever if
+ * negative).
+ *
+ * @return 1 on success, 0 on timeout, -1 if the pipe broke.
+ */
+int readInt(int Fd, int &Value, int TimeoutMs) {
+  struct pollfd P = {Fd, POLLIN, 0};
+  int Ret;
+  do {
+    Ret = poll(&P, 1, TimeoutMs);
+  } while (Ret < 0 && errno == EINTR);
+  if (Ret == 0)
+    return 0;
+  ssize_t Len;
+  do {
+    Len = read(Fd, &Value, sizeof(Value));
+  } while (Len < 0 && errno == EINTR);
+  return Len == sizeof(Value) ? 1 : -1;
+}
+
+/**
+ * Anonymous temporary file, inherited by the target as stdin or as the
+ * record fd.
+ */
+int makeTempFile() {
+  char Path[] = "/tmp/cbi-collect.XXXXXX";
+  int Fd = mkostemp(Path, O_CLOEXEC);
+  if (Fd != -1)
+    unlink(Path);
+  return Fd;
+}
+
+} // namespace
+
+bool isInputName(const std::string &Name) {
+  return Name.compare(0, 5, "input") == 0 &&
+         Name.find('.') == std::string::npos;
+}
+
+std::vector<std::string> listInputs(const std::string &Dir) {
+  std::vector<std::string> Names;
+  DIR *D = opendir(Dir.c_str());
+  if (!D)
+    return Names;
+  while (struct dirent *Entry = readdir(D)) {
+    if (isInputName(Entry->d_name))
+      Names.push_back(Entry->d_name);
+  }
+  closedir(D);
+  std::sort(Names.begin(), Names.end());
+  return Names;
+}
+
+bool readFile(const std::string &Path, std::string &Data) {
+  std::ifstream In(Path, std::ios::binary);
+  if (!In)
+    return false;
+  Data.assign(std::istreambuf_iterator<char>(In),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+
+ForkServer::ForkServer(const std::string &Target) : Target(Target) {
+  // The environment is built up front: only async-signal-safe calls are
+  // allowed between fork and exec when other workers are running.
+  for (char **E = environ; *E; ++E)
+    EnvStrings.push_back(*E);
+  EnvStrings.push_back(std::string(CBI_FORKSRV_ENV) + "=1");
+  for (auto &E : EnvStrings)
+    Env.push_back(const_cast<char *>(E.c_str()));
+  Env.push_back(nullptr);
+}
+
+ForkServer::~ForkServer() {
+  stop();
+  if (InputFd != -1)
+    close(InputFd);
+  if (RecordFd != -1)
+    close(RecordFd);
+}
+
+bool ForkServer::start() {
+  if (InputFd == -1)
+    InputFd = makeTempFile();
+  if (RecordFd == -1)
+    RecordFd = makeTempFile();
+  int Ctl[2], Status[2];
+  if (InputFd == -1 || RecordFd == -1 || pipe2(Ctl, O_CLOEXEC))
+    return false;
+  if (pipe2(Status, O_CLOEXEC)) {
+    close(Ctl[0]);
+    close(Ctl[1]);
+    return false;
+  }
+
+  Pid = fork();
+  if (Pid == 0) {
+    int Null = open("/dev/null", O_RDWR);
+    dup2(InputFd, 0);
+    dup2(Null, 1);
+    dup2(Null, 2);
+    dup2(RecordFd, CBI_RECORD_FD);
+    dup2(Ctl[0], CBI_FORKSRV_FD);
+    dup2(Status[1], CBI_FORKSRV_FD + 1);
+    char *Argv[] = {const_cast<char *>(Target.c_str()), nullptr};
+    execve(Target.c_str(), Argv, Env.data());
+    _exit(127);
+  }
+  close(Ctl[0]);
+  close(Status[1]);
+  CtlFd = Ctl[1];
+  StatusFd = Status[0];
+  if (Pid < 0) {
+    stop();
+    return false;
+  }
+
+  int Hello;
+  if (readInt(StatusFd, Hello, HELLO_TIMEOUT_MS) != 1 ||
+      Hello != CBI_FORKSRV_HELLO) {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void ForkServer::stop() {
+  if (CtlFd != -1)
+    close(CtlFd);
+  if (StatusFd != -1)
+    close(StatusFd);
+  CtlFd = StatusFd = -1;
+  if (Pid > 0) {
+    kill(Pid, SIGKILL);
+    waitpid(Pid, nullptr, 0);
+  }
+  Pid = -1;
+}
+
+bool ForkServer::run(const std::string &Input, int TimeoutMs, int &WaitStatus,
+                     std::vector<uint8_t> &Sites) {
+  if (ftruncate(InputFd, 0) ||
+      pwrite(InputFd, Input.data(), Input.size(), 0) != (ssize_t)Input.size())
+    return false;
+  lseek(InputFd, 0, SEEK_SET);
+  if (ftruncate(RecordFd, 0))
+    return false;
+  lseek(RecordFd, 0, SEEK_SET);
+
+  int Cmd = 0, Child;
+  if (!writeAll(CtlFd, &Cmd, sizeof(Cmd)) ||
+      readInt(StatusFd, Child, -1) != 1)
+    return false;
+  int Ret = readInt(StatusFd, WaitStatus, TimeoutMs);
+  if (Ret == 0) {
+    kill(Child, SIGKILL);
+    Ret = readInt(StatusFd, WaitStatus, -1);
+  }
+  if (Ret != 1)
+    return false;
+  readRecord(Sites);
+  return true;
+}
+
+void ForkServer::readRecord(std::vector<uint8_t> &Sites) {
+  Sites.clear();
+  CBICounterHeader Header;
+  if (pread(RecordFd, &Header, sizeof(Header), 0) != sizeof(Header) ||
+      memcmp(Header.Magic, CBI_COUNTER_MAGIC, sizeof(Header.Magic)) ||
+      Header.Version != CBI_COUNTER_VERSION ||
+      Header.SiteSize != sizeof(CBISiteCounters))
+    return;
+  std::vector<CBISiteCounters> Counters(Header.NumSites);
+  size_t Size = Counters.size() * sizeof(CBISiteCounters);
+  if (pread(RecordFd, Counters.data(), Size, sizeof(Header)) != (ssize_t)Size)
+    return;
+  Sites.resize(Counters.size());
+  for (size_t Id = 0; Id < Counters.size(); ++Id) {
+    for (int I = 0; I < 3; ++I) {
+      if (Counters[Id].Counts[I])
+        Sites[Id] |= 1 << I;
+    }
+  }
+}
+
+} // namespace cbi
@@ -0,0 +1,235 @@
+#include "CBISampling.h"
+
+#include "llvm/Analysis/CFG.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+namespace instrument {
+
+static bool canClone(Function &F) {
+  for (auto &BB : F) {
+    if (BB.isEHPad() || isa<IndirectBrInst>(BB.getTerminator()))
+      return false;
+    for (auto &Inst : BB) {
+      if (isa<InvokeInst>(Inst))
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Can Call run instrumentation sites, and so move the countdown?
+ * Functions only declared in the module, the runtime and the C library, are
+ * not instrumented.
+ */
+static bool mayRunSites(const CallInst &Call) {
+  if (Call.isInlineAsm())
+    return false;
+  const Function *Callee = Call.getCalledFunction();
+  return !Callee || !Callee->isDeclaration();
+}
+
+/**
+ * @brief Is Inst used outside its block (or by a PHI node)?
+ */
+static bool valueEscapes(const Instruction &Inst) {
+  for (const User *U : Inst.users()) {
+    const auto *UserInst = cast<Instruction>(U);
+    if (UserInst->getParent() != Inst.getParent() || isa<PHINode>(UserInst))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Demote every value living across blocks, and every PHI node, to an
+ * alloca in the entry block (what the reg2mem pass does).
+ */
+static void demoteRegisters(Function &F) {
+  BasicBlock &Entry = F.getEntryBlock();
+  auto It = Entry.begin();
+  while (isa<AllocaInst>(*It))
+    ++It;
+  Type *Int32Type = Type::getInt32Ty(F.getContext());
+  auto *AllocaPoint =
+      new BitCastInst(Constant::getNullValue(Int32Type), Int32Type,
+                      "reg2mem alloca point", &*It);
+
+  std::vector<Instruction *> Escaping;
+  for (auto &BB : F) {
+    for (auto &Inst : BB) {
+      if (!(isa<AllocaInst>(Inst) && &BB == &Entry) && valueEscapes(Inst))
+        Escaping.push_back(&Inst);
+    }
+  }
+  for (auto *Inst : Escaping)
+    DemoteRegToStack(*Inst, false, AllocaPoint);
+
+  std::vector<PHINode *> Phis;
+  for (auto &BB : F) {
+    for (auto &Phi : BB.phis())
+      Phis.push_back(&Phi);
+  }
+  for (auto *Phi : Phis)
+    DemotePHIToStack(Phi, AllocaPoint);
+
+  AllocaPoint->eraseFromParent();
+}
+
+static void replaceSuccessor(Instruction *Terminator, BasicBlock *From,
+                             BasicBlock *To) {
+  for (unsigned I = 0; I < Terminator->getNumSuccessors(); ++I) {
+    if (Terminator->getSuccessor(I) == From)
+      Terminator->setSuccessor(I, To);
+  }
+}
+
+/**
+ * @brief Fill Dispatch with a check of the countdown: take Fast if it is
+ * larger than Weight, Slow otherwise.
+ */
+static void buildDispatch(BasicBlock *Dispatch, GlobalVariable *Countdown,
+                          unsigned Weight, BasicBlock *Fast,
+                          BasicBlock *Slow) {
+  IRBuilder<> Builder(Dispatch);
+  auto *Value = Builder.CreateLoad(Countdown->getValueType(), Countdown,
+                                   "cbi.countdown");
+  auto *Enough = Builder.CreateICmpSGT(Value, Builder.getInt32(Weight));
+  Builder.CreateCondBr(Enough, Fast, Slow);
+}
+
+static void decrementCountdown(Instruction *InsertBefore,
+                               GlobalVariable *Countdown) {
+  IRBuilder<> Builder(InsertBefore);
+  auto *Value = Builder.CreateLoad(Countdown->getValueType(), Countdown,
+                                   "cbi.countdown");
+  Builder.CreateStore(Builder.CreateSub(Value, Builder.getInt32(1)),
+                      Countdown);
+}
+
+bool cloneForSampling(Function &F, const std::vector<Instruction *> &Sites,
+                      GlobalVariable *Countdown,
+                      std::function<void(size_t, Instruction *)> InstrumentSite) {
+  if (Sites.empty() || !canClone(F))
+    return false;
+
+  // A call that may run sites moves the countdown, so it ends its region:
+  // its block is split after it, and the rest is dispatched again.
+  std::vector<CallInst *> Calls;
+  for (auto &BB : F) {
+    for (auto &Inst : BB) {
+      auto *Call = dyn_cast<CallInst>(&Inst);
+      if (Call && mayRunSites(*Call))
+        Calls.push_back(Call);
+    }
+  }
+  std::set<const Instruction *> RegionCalls(Calls.begin(), Calls.end());
+  typedef std::pair<const BasicBlock *, const BasicBlock *> BlockEdge;
+  SmallVector<BlockEdge, 8> RegionEdges;
+  for (auto *Call : Calls) {
+    BasicBlock *Before = Call->getParent();
+    BasicBlock *After =
+        Before->splitBasicBlock(Call->getNextNode(), "cbi.call");
+    RegionEdges.push_back({Before, After});
+  }
+
+  demoteRegisters(F);
+
+  // Allocas go to a new entry block that is shared by both paths.
+  BasicBlock *OldEntry = &F.getEntryBlock();
+  BasicBlock *Entry =
+      BasicBlock::Create(F.getContext(), "cbi.entry", &F, OldEntry);
+  std::vector<Instruction *> Allocas;
+  for (auto &Inst : *OldEntry) {
+    if (isa<AllocaInst>(Inst))
+      Allocas.push_back(&Inst);
+  }
+  for (auto *Alloca : Allocas)
+    Alloca->moveBefore(*Entry, Entry->end());
+
+  std::vector<BasicBlock *> FastBlocks;
+  for (auto &BB : F) {
+    if (&BB != Entry)
+      FastBlocks.push_back(&BB);
+  }
+
+  // Weight of a block: most sites crossed from its start to the next
+  // dispatch (a loop header reached through a back edge, or the code after
+  // a call) or an exit. The sites of the calls are sampled by the runtime.
+  SmallVector<BlockEdge, 8> BackEdges;
+  BranchInst::Create(OldEntry, Entry);
+  FindFunctionBackedges(F, BackEdges);
+  Entry->getTerminator()->eraseFromParent();
+  RegionEdges.append(BackEdges.begin(), BackEdges.end());
+  std::set<BlockEdge> EndsRegion(RegionEdges.begin(), RegionEdges.end());
+
+  std::map<const BasicBlock *, unsigned> SiteCount, Weight;
+  for (auto *Site : Sites) {
+    if (!RegionCalls.count(Site))
+      ++SiteCount[Site->getParent()];
+  }
+  std::function<unsigned(const BasicBlock *)> GetWeight =
+      [&](const BasicBlock *BB) {
+        auto It = Weight.find(BB);
+        if (It != Weight.end())
+          return It->second;
+        unsigned Longest = 0;
+        for (auto *Succ : successors(BB)) {
+          if (!EndsRegion.count({BB, Succ}))
+            Longest = std::max(Longest, GetWeight(Succ));
+        }
+        return Weight[BB] = SiteCount[BB] + Longest;
+      };
+
+  ValueToValueMapTy VMap;
+  SmallVector<BasicBlock *, 16> SlowBlocks;
+  for (auto *BB : FastBlocks) {
+    auto *Slow = CloneBasicBlock(BB, VMap, ".slow", &F);
+    VMap[BB] = Slow;
+    SlowBlocks.push_back(Slow);
+  }
+  remapInstructionsInBlocks(SlowBlocks, VMap);
+  auto SlowCopy = [&](BasicBlock *BB) { return cast<BasicBlock>(VMap[BB]); };
+
+  buildDispatch(Entry, Countdown, GetWeight(OldEntry), OldEntry,
+                SlowCopy(OldEntry));
+
+  std::map<BasicBlock *, BasicBlock *> Dispatches;
+  for (auto &Edge : RegionEdges) {
+    auto *From = const_cast<BasicBlock *>(Edge.first);
+    auto *Head = const_cast<BasicBlock *>(Edge.second);
+    auto *&Dispatch = Dispatches[Head];
+    if (!Dispatch) {
+      Dispatch = BasicBlock::Create(F.getContext(), "cbi.dispatch", &F);
+      buildDispatch(Dispatch, Countdown, GetWeight(Head), Head,
+                    SlowCopy(Head));
+    }
+    replaceSuccessor(From->getTerminator(), Head, Dispatch);
+    replaceSuccessor(SlowCopy(From)->getTerminator(), SlowCopy(Head),
+                     Dispatch);
+  }
+
+  for (size_t I = 0; I < Sites.size(); ++I) {
+    Instruction *Site = Sites[I];
+    InstrumentSite(I, cast<Instruction>(VMap[Site]));
+    // The value of a call is recorded after the callee moved the countdown,
+    // before the next dispatch, so both paths leave it to the runtime.
+    if (RegionCalls.count(Site))
+      InstrumentSite(I, Site);
+    else
+      decrementCountdown(isa<BranchInst>(Site) ? Site : Site->getNextNode(),
+                         Countdown);
+  }
+  return true;
+}
+
+} // namespace instrument
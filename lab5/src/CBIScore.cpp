@@ -0,0 +1,71 @@
+/**
+ * cbi-score: compute the CBI report of the runs gathered by cbi-collect,
+ * with bitsets of runs instead of per-run dictionaries.
+ *
+ * Usage:
+ *   cbi-score target [runs]                     full report
+ *   cbi-score --eliminate[=N] target [runs]     iterative elimination
+ *
+ * runs defaults to <target>.cbi.runs and the site table is read from
+ * <target>.cbi.sites. Prints the report like `cbi` does and writes it to
+ * <target>.report.json. With --eliminate, only prints the (at most N)
+ * predictors picked by iterative elimination instead.
+ */
+
+#include "CBIReport.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  bool Eliminate = false;
+  size_t MaxPredictors = SIZE_MAX;
+  std::vector<std::string> Args;
+  for (int I = 1; I < argc; ++I) {
+    if (!strcmp(argv[I], "--eliminate")) {
+      Eliminate = true;
+    } else if (!strncmp(argv[I], "--eliminate=", 12)) {
+      Eliminate = true;
+      MaxPredictors = strtoul(argv[I] + 12, nullptr, 10);
+    } else {
+      Args.push_back(argv[I]);
+    }
+  }
+  if (Args.empty()) {
+    fprintf(stderr, "usage: %s [--eliminate[=N]] target [runs]\n", argv[0]);
+    return 1;
+  }
+  std::string Target = Args[0];
+  std::string RunsPath = Args.size() > 1 ? Args[1] : Target + ".cbi.runs";
+
+  std::vector<cbi::Site> Sites;
+  if (!cbi::readSiteTable(Target + ".cbi.sites", Sites)) {
+    fprintf(stderr, "Cannot read %s.cbi.sites\n", Target.c_str());
+    return 1;
+  }
+  cbi::ObservationMatrix Matrix;
+  if (!Matrix.load(RunsPath)) {
+    fprintf(stderr, "%s is not a cbi-collect file\n", RunsPath.c_str());
+    return 1;
+  }
+
+  if (Eliminate) {
+    std::vector<cbi::Predictor> Predictors;
+    cbi::eliminatePredicates(Matrix, Sites, MaxPredictors, Predictors);
+    cbi::printPredictors(std::cout, Sites, Predictors);
+    return 0;
+  }
+
+  cbi::Bitset All(Matrix.NumRuns);
+  All.setAll();
+  std::vector<cbi::PredicateInfo> Infos;
+  cbi::scorePredicates(Matrix, Sites, All, Infos);
+
+  cbi::printReport(std::cout, Sites, Infos);
+  std::ofstream Json(Target + ".report.json");
+  cbi::writeReportJson(Json, Sites, Infos);
+  return 0;
+}
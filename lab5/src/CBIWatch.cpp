@@ -0,0 +1,271 @@
+/**
+ * cbi-watch: CBI while the fuzzer is still running. Watches the success/
+ * and failure/ directories of the fuzzer output with inotify, runs every
+ * new input once through the target's fork server and keeps the predicate
+ * counters up to date, printing the top predicates every few seconds.
+ *
+ * Usage:
+ *   cbi-watch [-n top] [-i interval-s] [-t timeout-ms] target fuzz-dir
+ *
+ * The target must be built with -cbi-counters, its site table is read from
+ * <target>.cbi.sites. Inputs already in the directories are processed
+ * first. The counters are also written to <target>.report.json at every
+ * refresh and when stopped with SIGINT or SIGTERM.
+ */
+
+#include "CBIReport.h"
+#include "CBIRunner.h"
+#include "CBIRuns.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <set>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t DEFAULT_TOP = 10;
+const int DEFAULT_INTERVAL_S = 2;
+const int DEFAULT_TIMEOUT_MS = 1000;
+
+volatile sig_atomic_t Stop = 0;
+
+void stopWatching(int) { Stop = 1; }
+
+struct Input {
+  std::string Path;
+  CBIRunOutcome Outcome;
+  /* The server died on the input once already. */
+  bool Retried;
+};
+
+/**
+ * Running counters of every predicate, PredicateInfo indexed by
+ * site id * 3 + outcome.
+ */
+class Counters {
+public:
+  explicit Counters(const std::vector<cbi::Site> &Sites) : Sites(Sites) {
+    Infos.resize(Sites.size() * 3);
+    for (size_t I = 0; I < Infos.size(); ++I) {
+      Infos[I].SiteId = I / 3;
+      Infos[I].Outcome = I % 3;
+    }
+  }
+
+  void addRun(const std::vector<uint8_t> &Masks, CBIRunOutcome Outcome) {
+    bool Failed = Outcome == CBI_RUN_FAILURE;
+    ++(Failed ? NumF : NumS);
+    for (size_t Id = 0; Id < Masks.size() && Id < Sites.size(); ++Id) {
+      if (!Masks[Id])
+        continue;
+      for (int Outcome = 0; Outcome < cbi::numOutcomes(Sites[Id]);
+           ++Outcome) {
+        cbi::PredicateInfo &Info = Infos[Id * 3 + Outcome];
+        ++(Failed ? Info.FObs : Info.SObs);
+        if (Masks[Id] >> Outcome & 1)
+          ++(Failed ? Info.F : Info.S);
+      }
+    }
+  }
+
+  /**
+   * The predicates of the sites observed so far, sorted like the report.
+   */
+  std::vector<cbi::PredicateInfo> observed() const {
+    std::vector<cbi::PredicateInfo> Result;
+    for (auto &Info : Infos) {
+      if (Info.SObs + Info.FObs)
+        Result.push_back(Info);
+    }
+    cbi::sortPredicates(Sites, Result);
+    return Result;
+  }
+
+  uint64_t NumS = 0, NumF = 0;
+
+private:
+  const std::vector<cbi::Site> &Sites;
+  std::vector<cbi::PredicateInfo> Infos;
+};
+
+void usage(const char *Argv0) {
+  fprintf(stderr,
+          "usage: %s [-n top] [-i interval-s] [-t timeout-ms] target "
+          "fuzz-dir\n",
+          Argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t Top = DEFAULT_TOP;
+  int IntervalS = DEFAULT_INTERVAL_S, TimeoutMs = DEFAULT_TIMEOUT_MS;
+  int Opt;
+  while ((Opt = getopt(argc, argv, "n:i:t:")) != -1) {
+    if (Opt == 'n') {
+      Top = strtoul(optarg, nullptr, 10);
+    } else if (Opt == 'i') {
+      IntervalS = std::max(1, atoi(optarg));
+    } else if (Opt == 't') {
+      TimeoutMs = atoi(optarg);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string Target = argv[optind], FuzzDir = argv[optind + 1];
+
+  std::vector<cbi::Site> Sites;
+  if (!cbi::readSiteTable(Target + ".cbi.sites", Sites)) {
+    fprintf(stderr, "Cannot read %s.cbi.sites, was %s built with "
+                    "-cbi-counters?\n",
+            Target.c_str(), Target.c_str());
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction Action = {};
+  Action.sa_handler = stopWatching;
+  sigaction(SIGINT, &Action, nullptr);
+  sigaction(SIGTERM, &Action, nullptr);
+
+  cbi::ForkServer Server(Target);
+  if (!Server.start()) {
+    fprintf(stderr, "%s did not start a fork server, is it linked with the "
+                    "lab5 runtime?\n",
+            Target.c_str());
+    return 1;
+  }
+
+  // Watch before listing, so no input falls between the two.
+  int Inotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (Inotify == -1) {
+    perror("inotify_init1");
+    return 1;
+  }
+  const std::pair<const char *, CBIRunOutcome> Dirs[] = {
+      {"success", CBI_RUN_SUCCESS}, {"failure", CBI_RUN_FAILURE}};
+  std::map<int, std::pair<std::string, CBIRunOutcome>> Watches;
+  for (auto &Dir : Dirs) {
+    std::string Path = FuzzDir + "/" + Dir.first;
+    mkdir(FuzzDir.c_str(), 0755);
+    mkdir(Path.c_str(), 0755);
+    int Watch =
+        inotify_add_watch(Inotify, Path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (Watch == -1) {
+      perror(Path.c_str());
+      return 1;
+    }
+    Watches[Watch] = std::make_pair(Path, Dir.second);
+  }
+
+  std::set<std::string> Seen;
+  std::deque<Input> Pending;
+  auto Enqueue = [&](const std::string &Dir, const std::string &Name,
+                     CBIRunOutcome Outcome) {
+    std::string Path = Dir + "/" + Name;
+    if (cbi::isInputName(Name) && Seen.insert(Path).second)
+      Pending.push_back(Input{Path, Outcome, false});
+  };
+  auto Rescan = [&]() {
+    for (auto &Watch : Watches) {
+      for (auto &Name : cbi::listInputs(Watch.second.first))
+        Enqueue(Watch.second.first, Name, Watch.second.second);
+    }
+  };
+  Rescan();
+
+  Counters Counts(Sites);
+  bool Changed = true;
+  auto Refresh = [&]() {
+    std::vector<cbi::PredicateInfo> Infos = Counts.observed();
+    std::cout << "\n== Top predicates after " << Counts.NumS + Counts.NumF
+              << " runs (" << Counts.NumF << " failing, " << Pending.size()
+              << " pending) ==\n";
+    cbi::printTopPredicates(std::cout, Sites, Infos, Counts.NumF, Top);
+    std::cout.flush();
+    std::ofstream Json(Target + ".report.json");
+    cbi::writeReportJson(Json, Sites, Infos);
+    Changed = false;
+  };
+
+  typedef std::chrono::steady_clock Clock;
+  // The first report is due one interval in, once some inputs ran.
+  auto NextRefresh = Clock::now() + std::chrono::seconds(IntervalS);
+  std::string Data;
+  std::vector<uint8_t> Masks;
+  char Events[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (!Stop) {
+    // Run pending inputs until the next refresh is due.
+    while (!Pending.empty() && !Stop && Clock::now() < NextRefresh) {
+      Input In = Pending.front();
+      Pending.pop_front();
+      if (!cbi::readFile(In.Path, Data))
+        continue;
+      int Status;
+      if (!Server.run(Data, TimeoutMs, Status, Masks)) {
+        Server.stop();
+        if (!Server.start()) {
+          fprintf(stderr, "Cannot restart %s\n", Target.c_str());
+          return 1;
+        }
+        // Restart a server that died once, then give up on the input.
+        if (!In.Retried) {
+          In.Retried = true;
+          Pending.push_front(In);
+        } else {
+          fprintf(stderr, "Dropped %s\n", In.Path.c_str());
+        }
+        continue;
+      }
+      Counts.addRun(Masks, In.Outcome);
+      Changed = true;
+    }
+    if (Clock::now() >= NextRefresh) {
+      if (Changed)
+        Refresh();
+      NextRefresh = Clock::now() + std::chrono::seconds(IntervalS);
+    }
+
+    int Wait = Pending.empty()
+                   ? std::chrono::duration_cast<std::chrono::milliseconds>(
+                         NextRefresh - Clock::now())
+                         .count()
+                   : 0;
+    struct pollfd P = {Inotify, POLLIN, 0};
+    if (poll(&P, 1, std::max(0, Wait)) <= 0)
+      continue;
+    ssize_t Len;
+    while ((Len = read(Inotify, Events, sizeof(Events))) > 0) {
+      for (char *Ptr = Events; Ptr < Events + Len;) {
+        auto *Event = reinterpret_cast<struct inotify_event *>(Ptr);
+        Ptr += sizeof(struct inotify_event) + Event->len;
+        if (Event->mask & IN_Q_OVERFLOW) {
+          Rescan();
+          continue;
+        }
+        auto Watch = Watches.find(Event->wd);
+        if (Watch != Watches.end() && Event->len)
+          Enqueue(Watch->second.first, Event->name, Watch->second.second);
+      }
+    }
+  }
+  if (Changed)
+    Refresh();
+  return 0;
+}
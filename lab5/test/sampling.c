@@ -0,0 +1,22 @@
+/*
+ * Every site of this program runs once per iteration, around a call to a
+ * function that has sites of its own. Under -cbi-sampling, all of them must
+ * be sampled at the same rate, see sampling_rate.py.
+ */
+#include <stdio.h>
+
+int g(int x) {
+  if (x % 3 == 0)
+    return 1;
+  return 0;
+}
+
+int main() {
+  int n = 0;
+  for (int i = 0; i < 100000; i++) {
+    if (g(i))
+      n++;
+  }
+  printf("%d\n", n);
+  return 0;
+}
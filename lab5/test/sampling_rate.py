@@ -0,0 +1,144 @@
+#! /usr/bin/env python3
+"""
+Sampling rate test of -cbi-sampling.
+
+Builds a test program with -cbi-counters -cbi-sampling, runs it once with
+CBI_SAMPLING_RATE=1, which samples every site, and once with the rate under
+test, and checks that every outcome of every site was sampled at that rate:
+within --sigmas standard deviations (plus one) of its exact count divided
+by the rate.
+
+usage: sampling_rate.py [--build-dir DIR] [--rate N] [--seed N]
+                        [--sigmas S] [program]
+
+The program defaults to sampling (test/sampling.c), whose sites all run
+around calls to a function with sites of its own. The compiler and the LLVM
+optimizer can be overridden through the CLANG and OPT environment variables.
+"""
+
+import argparse
+import math
+import os
+import shlex
+import struct
+import subprocess
+import sys
+import tempfile
+
+from pathlib import Path
+from typing import Dict, List, Tuple
+
+TEST_DIR = Path(__file__).resolve().parent
+LAB5_DIR = TEST_DIR.parent
+
+# See include/CBICounters.h.
+CBI_COUNTER_HEADER = struct.Struct("=8sHHI")
+CBI_SITE_COUNTERS = struct.Struct("=3I")
+
+OUTCOMES = {
+    "branch": ["false", "true"],
+    "return": ["negative", "zero", "positive"],
+}
+
+
+def run_tool(command: List[str]) -> None:
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+
+
+def build(source: Path, binary: Path, build_dir: Path) -> None:
+    """
+    Compile source and instrument it the way the test Makefile does, with
+    -cbi-counters -cbi-sampling, next to its site table.
+    """
+    clang = shlex.split(os.environ.get("CLANG", "clang"))
+    opt = shlex.split(os.environ.get("OPT", "opt"))
+    ll = binary.with_suffix(".ll")
+    instrumented = binary.with_suffix(".cbi.instrumented.ll")
+    run_tool(clang + ["-emit-llvm", "-S", "-fno-discard-value-names", "-c",
+                      "-g", "-o", str(ll), str(source)])
+    run_tool(opt + ["-load", str(build_dir / "CBIInstrumentPass.so"),
+                    "-CBIInstrument", "-cbi-counters", "-cbi-sampling",
+                    f"-cbi-site-table={binary}.cbi.sites", "-S", str(ll),
+                    "-o", str(instrumented)])
+    run_tool(clang + ["-o", str(binary), str(instrumented),
+                      f"-L{build_dir}", f"-Wl,-rpath,{build_dir}",
+                      "-lruntime", "-lm"])
+
+
+def read_sites(binary: Path) -> Dict[int, Tuple[str, int, int]]:
+    sites = dict()
+    with open(f"{binary}.cbi.sites") as fp:
+        for line in fp:
+            if line.startswith("#"):
+                continue
+            kind, site_id, site_line, column = line.split()[:4]
+            sites[int(site_id)] = (kind, int(site_line), int(column))
+    return sites
+
+
+def run_counters(binary: Path, rate: int, seed: int) -> List[Tuple[int]]:
+    """
+    Run binary with a sampling rate.
+
+    :return: the counters of every site, by site id.
+    """
+    counters = Path(f"{binary}.cbi.bin")
+    if counters.exists():
+        counters.unlink()
+    env = {**os.environ, "CBI_SAMPLING_RATE": str(rate),
+           "CBI_SEED": str(seed)}
+    subprocess.run([str(binary)], check=True, stdout=subprocess.DEVNULL,
+                   stdin=subprocess.DEVNULL, env=env)
+    data = counters.read_bytes()
+    _, _, _, num_sites = CBI_COUNTER_HEADER.unpack_from(data)
+    return [CBI_SITE_COUNTERS.unpack_from(
+                data, CBI_COUNTER_HEADER.size + i * CBI_SITE_COUNTERS.size)
+            for i in range(num_sites)]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--build-dir", type=Path, default=LAB5_DIR / "build",
+                        help="lab5 build directory (default: lab5/build)")
+    parser.add_argument("--rate", type=int, default=100,
+                        help="sampling rate under test (default: 100)")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="CBI_SEED of the sampled run (default: 1)")
+    parser.add_argument("--sigmas", type=float, default=5,
+                        help="standard deviations allowed (default: 5)")
+    parser.add_argument("program", nargs="?", default="sampling",
+                        help="test program, without .c (default: sampling)")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        binary = Path(work_dir) / args.program
+        build(TEST_DIR / f"{args.program}.c", binary,
+              args.build_dir.resolve())
+        sites = read_sites(binary)
+        exact = run_counters(binary, 1, args.seed)
+        sampled = run_counters(binary, args.rate, args.seed)
+
+    p = 1 / args.rate
+    failed = 0
+    print(f"{'site':>12} {'outcome':>9} {'runs':>9} {'expected':>9} "
+          f"{'sampled':>9}")
+    for site_id, (kind, line, column) in sorted(sites.items()):
+        outcomes = OUTCOMES.get(kind, OUTCOMES["return"])
+        for index, outcome in enumerate(outcomes):
+            runs = exact[site_id][index]
+            if runs == 0:
+                continue
+            expected = runs * p
+            # One sample of slack, for outcomes that only ran a few times.
+            deviation = args.sigmas * math.sqrt(runs * p * (1 - p)) + 1
+            ok = abs(sampled[site_id][index] - expected) <= deviation
+            failed += not ok
+            print(f"{f'{line}:{column}':>12} {outcome:>9} {runs:>9} "
+                  f"{expected:>9.0f} {sampled[site_id][index]:>9}"
+                  f"{'' if ok else '  FAILED'}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
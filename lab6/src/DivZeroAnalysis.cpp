@@ -1,8 +1,37 @@
 #include "DivZeroAnalysis.h"
 #include "Utils.h"
 
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <fstream>
+
 namespace dataflow {
 
+static cl::opt<std::string>
+    DivAlarms("div-alarms",
+              cl::desc("Export every division site with the domain of its "
+                       "divisor to this file"),
+              cl::value_desc("filename"));
+
+static bool isDivSite(const Instruction *Inst) {
+  return Inst->getOpcode() == Instruction::SDiv ||
+         Inst->getOpcode() == Instruction::UDiv;
+}
+
+static const char *getDomainName(Domain::Element Value) {
+  switch (Value) {
+  case Domain::NonZero:
+    return "NonZero";
+  case Domain::Zero:
+    return "Zero";
+  case Domain::MaybeZero:
+    return "MaybeZero";
+  default:
+    return "Uninit";
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // DivZero Analysis Implementation
 //===----------------------------------------------------------------------===//
@@ -76,6 +105,11 @@ bool DivZeroAnalysis::runOnFunction(Function &F) {
       ErrorInsts.insert(Inst);
   }
 
+  if (!DivAlarms.empty()) {
+    for (auto Iter = inst_begin(F), End = inst_end(F); Iter != End; ++Iter)
+      exportDivSite(&(*Iter));
+  }
+
   printMap(F, InMap, OutMap);
   outs() << "Potential Instructions by " << getAnalysisName() << ": \n";
   for (auto Inst : ErrorInsts) {
@@ -89,6 +123,48 @@ bool DivZeroAnalysis::runOnFunction(Function &F) {
   return false;
 }
 
+bool DivZeroAnalysis::doInitialization(Module &M) {
+  unsigned Id = 0;
+  for (auto &F : M) {
+    for (auto Iter = inst_begin(F), End = inst_end(F); Iter != End; ++Iter) {
+      if (isDivSite(&(*Iter)))
+        DivSiteIds[&(*Iter)] = Id++;
+    }
+  }
+  return false;
+}
+
+void DivZeroAnalysis::exportDivSite(Instruction *Inst) {
+  auto It = DivSiteIds.find(Inst);
+  if (It == DivSiteIds.end())
+    return;
+  auto Divisor = getOrExtract(InMap[Inst], Inst->getOperand(1));
+
+  int Line = 0, Col = 0;
+  if (const auto &DebugLoc = Inst->getDebugLoc()) {
+    Line = DebugLoc.getLine();
+    Col = DebugLoc.getCol();
+  }
+  DivSiteReport[It->second] = std::to_string(It->second) + " " +
+                               std::to_string(Line) + " " +
+                               std::to_string(Col) + " " +
+                               getDomainName(Divisor->Value);
+}
+
+bool DivZeroAnalysis::doFinalization(Module &M) {
+  if (DivAlarms.empty())
+    return false;
+  std::ofstream Out(DivAlarms);
+  if (!Out) {
+    errs() << "Cannot write " << DivAlarms << "\n";
+    return false;
+  }
+  Out << "# id line col domain\n";
+  for (auto &Entry : DivSiteReport)
+    Out << Entry.second << "\n";
+  return false;
+}
+
 char DivZeroAnalysis::ID = 1;
 static RegisterPass<DivZeroAnalysis> X("DivZero", "Divide-by-zero Analysis",
                                        false, false);
@@ -1,6 +1,7 @@
 #ifndef DIV_ZERO_ANALYSIS_H
 #define DIV_ZERO_ANALYSIS_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Function.h"
@@ -28,6 +29,23 @@ struct DivZeroAnalysis : public FunctionPass {
   ValueMap<Instruction *, Memory *> OutMap;
   SetVector<Instruction *> ErrorInsts;
 
+  /**
+   * Module-wide id of every SDiv/UDiv, numbered in module order. These match
+   * the division site ids of the Instrument pass (lab3 site table).
+   */
+  DenseMap<const Instruction *, unsigned> DivSiteIds;
+
+  /**
+   * One "<id> <line> <col> <domain>" line per division site, written to the
+   * -div-alarms file once the whole module has been analyzed.
+   */
+  std::map<unsigned, std::string> DivSiteReport;
+
+  /**
+   * Number the division sites of M.
+   */
+  bool doInitialization(Module &M) override;
+
   /**
    * This function is called for each function F in the input C program
    * that the compiler encounters during a pass.
@@ -35,6 +53,11 @@ struct DivZeroAnalysis : public FunctionPass {
    */
   bool runOnFunction(Function &F) override;
 
+  /**
+   * Export the division sites and their divisor domain to -div-alarms.
+   */
+  bool doFinalization(Module &M) override;
+
 protected:
   /**
    * This function creates a transfer function that updates the Out Memory based
@@ -80,6 +103,13 @@ protected:
    */
   bool check(Instruction *Inst);
 
+  /**
+   * Record the divisor domain of the division site Inst in DivSiteReport.
+   *
+   * @param Inst Instruction to record, ignored unless it is a SDiv/UDiv.
+   */
+  void exportDivSite(Instruction *Inst);
+
   std::string getAnalysisName() { return "DivZero"; }
 };
 } // namespace dataflow